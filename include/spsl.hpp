@@ -22,6 +22,8 @@
 #ifndef SPSL_SPSL_HPP_
 #define SPSL_SPSL_HPP_
 
+#include <vector>
+
 #include "spsl/storage_array.hpp"
 #include "spsl/storage_password.hpp"
 #include "spsl/stringbase.hpp"
@@ -52,6 +54,39 @@ using ArrayStringW = StringBase<StorageArray<wchar_t, MaxSize, OverflowPolicy>>;
  */
 using PasswordString = StringCore<StoragePassword<char>>;
 using PasswordStringW = StringCore<StoragePassword<wchar_t>>;
+
+/*
+ * InlinePasswordString / InlinePasswordStringW:
+ * Password strings that store up to InlineSize characters (e.g. PINs and one-time passwords)
+ * inside the object instead of allocating them. The inline buffer is wiped as well.
+ */
+template <size_t InlineSize = 15>
+using InlinePasswordString =
+  StringCore<StoragePassword<char, 128, SensitiveSegmentAllocator<char>, InlineSize>>;
+template <size_t InlineSize = 15>
+using InlinePasswordStringW =
+  StringCore<StoragePassword<wchar_t, 128, SensitiveSegmentAllocator<wchar_t>, InlineSize>>;
+
+/**
+ * Creates password strings for all strings of a container (e.g. the entries of a credential
+ * store), allocating all buffers at once (see StoragePassword::createBulk()).
+ * @param[in] values    the strings to copy (anything with data() and size())
+ * @param[in] alloc     the allocator to use
+ * @return the password strings (in the same order)
+ */
+template <typename StringType = PasswordString, typename Container>
+std::vector<StringType> makePasswordStrings(
+  const Container& values,
+  const typename StringType::storage_type::allocator& alloc =
+    typename StringType::storage_type::allocator())
+{
+    auto storages = StringType::storage_type::createBulk(values, alloc);
+    std::vector<StringType> result;
+    result.reserve(storages.size());
+    for (auto& storage : storages)
+        result.emplace_back(std::move(storage));
+    return result;
+}
 } // namespace spsl
 
 
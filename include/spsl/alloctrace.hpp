@@ -0,0 +1,364 @@
+/**
+ * @file    Special Purpose Strings Library: alloctrace.hpp
+ * @author  Daniel Evers
+ * @brief   Lock-free ring buffer for tracing allocations
+ * @license MIT
+ */
+
+#ifndef SPSL_ALLOCTRACE_HPP_
+#define SPSL_ALLOCTRACE_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace spsl
+{
+namespace detail
+{
+/// one SipRound of SipHash
+inline void sipRound(uint64_t& v0, uint64_t& v1, uint64_t& v2, uint64_t& v3) noexcept
+{
+    v0 += v1;
+    v1 = (v1 << 13) | (v1 >> 51);
+    v1 ^= v0;
+    v0 = (v0 << 32) | (v0 >> 32);
+    v2 += v3;
+    v3 = (v3 << 16) | (v3 >> 48);
+    v3 ^= v2;
+    v0 += v3;
+    v3 = (v3 << 21) | (v3 >> 43);
+    v3 ^= v0;
+    v2 += v1;
+    v1 = (v1 << 17) | (v1 >> 47);
+    v1 ^= v2;
+    v2 = (v2 << 32) | (v2 >> 32);
+}
+
+/**
+ * SipHash-2-4 of a single 64 bit value (i.e. the 8 bytes of @c m in little endian order).
+ * @param[in] m         the value to hash
+ * @param[in] k0        the first half of the 128 bit key
+ * @param[in] k1        the second half of the 128 bit key
+ * @return the 64 bit hash
+ */
+inline uint64_t sipHash24(uint64_t m, uint64_t k0, uint64_t k1) noexcept
+{
+    uint64_t v0 = k0 ^ 0x736f6d6570736575;
+    uint64_t v1 = k1 ^ 0x646f72616e646f6d;
+    uint64_t v2 = k0 ^ 0x6c7967656e657261;
+    uint64_t v3 = k1 ^ 0x7465646279746573;
+
+    v3 ^= m;
+    sipRound(v0, v1, v2, v3);
+    sipRound(v0, v1, v2, v3);
+    v0 ^= m;
+
+    // the last block only contains the message length
+    const uint64_t b = uint64_t(8) << 56;
+    v3 ^= b;
+    sipRound(v0, v1, v2, v3);
+    sipRound(v0, v1, v2, v3);
+    v0 ^= b;
+
+    v2 ^= 0xff;
+    for (int i = 0; i < 4; ++i)
+        sipRound(v0, v1, v2, v3);
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+} // namespace detail
+
+/// The traced operations
+enum class TraceOperation : uint8_t
+{
+    /// memory was allocated
+    allocate,
+    /// memory was deallocated (including deferred deallocations)
+    deallocate,
+    /// an allocation was grown in place (the size is the new size)
+    expand
+};
+
+/**
+ * One record of an allocation trace. Addresses are never recorded: Allocations are identified
+ * by a "handle", which is a keyed hash (SipHash-2-4) of the address. The key is chosen randomly
+ * per trace buffer and never leaves it, so the addresses can't be recovered from a trace. The
+ * handle is the same for an allocation and its deallocation (as long as the trace buffer
+ * exists), which is all that is needed to replay a trace.
+ */
+struct AllocationTraceRecord
+{
+    /// nanoseconds since the trace buffer was created
+    uint64_t timestamp;
+    /// identifies the allocation (see above)
+    uint64_t handle;
+    /// the requested size in bytes
+    uint64_t size;
+    /// small number identifying the thread (1, 2, ... in the order of their first record)
+    uint32_t thread;
+    /// the requested alignment (0 = default)
+    uint32_t alignment;
+    /// the number of segments (0 if the allocation is larger than a chunk)
+    uint16_t segments;
+    /// the index of the chunk within its page
+    uint16_t chunk;
+    /// the index of the first segment within its chunk
+    uint8_t segment;
+    /// the operation
+    TraceOperation op;
+};
+
+/**
+ * Fixed-size ring buffer of AllocationTraceRecord, which can be written by any number of
+ * threads without locking (and without any I/O). If the buffer is full, the oldest records are
+ * overwritten and reported as dropped by the next drain().
+ *
+ * Each slot is protected by a sequence number ("seqlock"): The writer marks the slot as being
+ * written, stores the record and then publishes the record's position. drain() only returns
+ * records that were completely written and not overwritten while reading them.
+ */
+class AllocationTraceBuffer
+{
+public:
+    /**
+     * Constructor: Allocates the buffer.
+     * @param[in] capacity      the number of records (rounded up to a power of 2)
+     */
+    explicit AllocationTraceBuffer(std::size_t capacity)
+      : m_capacity(roundCapacity(capacity)), m_slots(new Slot[m_capacity]), m_head(0), m_tail(0),
+        m_start(std::chrono::steady_clock::now())
+    {
+        // std::random_device might be deterministic on some platforms: also mix in the time
+        std::random_device random;
+        const uint64_t seed = mix(static_cast<uint64_t>(m_start.time_since_epoch().count()) ^
+                                  reinterpret_cast<std::uintptr_t>(this));
+        m_key[0] = ((static_cast<uint64_t>(random()) << 32) ^ random()) ^ seed;
+        m_key[1] = ((static_cast<uint64_t>(random()) << 32) ^ random()) ^ mix(seed);
+        for (std::size_t i = 0; i < m_capacity; ++i)
+        {
+            Slot& slot = m_slots[i];
+            slot.seq.store(0, std::memory_order_relaxed);
+            for (auto& word : slot.words)
+                word.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // disable copy & move
+    AllocationTraceBuffer(const AllocationTraceBuffer&) = delete;
+    AllocationTraceBuffer(AllocationTraceBuffer&&) = delete;
+    AllocationTraceBuffer& operator=(const AllocationTraceBuffer&) = delete;
+    AllocationTraceBuffer& operator=(AllocationTraceBuffer&&) = delete;
+
+    std::size_t capacity() const noexcept { return m_capacity; }
+
+    /**
+     * Adds a record (lock-free). The timestamp, the thread and the handle are determined here.
+     * @param[in] op            the operation
+     * @param[in] addr          the allocation's address (only used for the handle)
+     * @param[in] size          the requested size
+     * @param[in] alignment     the requested alignment (0 = default)
+     * @param[in] segments      the number of segments (0 if larger than a chunk)
+     * @param[in] chunk         the index of the chunk within its page
+     * @param[in] segment       the index of the first segment within its chunk
+     */
+    void record(TraceOperation op, const void* addr, std::size_t size, std::size_t alignment,
+                std::size_t segments, std::size_t chunk, std::size_t segment) noexcept
+    {
+        const uint64_t timestamp = static_cast<uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                                                               m_start)
+            .count());
+        const uint64_t handle =
+          detail::sipHash24(reinterpret_cast<std::uintptr_t>(addr), m_key[0], m_key[1]);
+        const uint64_t packed1 = (static_cast<uint64_t>(getThreadNumber()) & 0xffffffff) |
+                                 (static_cast<uint64_t>(segments & 0xffff) << 32) |
+                                 (static_cast<uint64_t>(chunk & 0xffff) << 48);
+        const uint64_t packed2 = static_cast<uint64_t>(segment & 0xff) |
+                                 (static_cast<uint64_t>(op) << 8) |
+                                 (static_cast<uint64_t>(alignment & 0xffffffff) << 16);
+
+        const uint64_t pos = m_head.fetch_add(1, std::memory_order_relaxed);
+        Slot& slot = m_slots[pos & (m_capacity - 1)];
+        // odd: the slot is being written
+        slot.seq.store(2 * pos + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.words[0].store(timestamp, std::memory_order_relaxed);
+        slot.words[1].store(handle, std::memory_order_relaxed);
+        slot.words[2].store(static_cast<uint64_t>(size), std::memory_order_relaxed);
+        slot.words[3].store(packed1, std::memory_order_relaxed);
+        slot.words[4].store(packed2, std::memory_order_relaxed);
+        slot.seq.store(2 * pos + 2, std::memory_order_release);
+    }
+
+    /**
+     * Moves all records written since the last call to a vector (in the order of their
+     * positions in the buffer). Records that are still being written are left for the next call.
+     * @param[out] out      the records are appended here
+     * @return the number of records that were lost because they were overwritten
+     */
+    std::size_t drain(std::vector<AllocationTraceRecord>& out)
+    {
+        std::lock_guard<std::mutex> lock(m_drainMutex);
+        const uint64_t head = m_head.load(std::memory_order_acquire);
+        std::size_t dropped = 0;
+        if (head - m_tail > m_capacity)
+        {
+            dropped = static_cast<std::size_t>(head - m_capacity - m_tail);
+            m_tail = head - m_capacity;
+        }
+
+        for (; m_tail < head; ++m_tail)
+        {
+            const Slot& slot = m_slots[m_tail & (m_capacity - 1)];
+            const uint64_t expected = 2 * m_tail + 2;
+            const uint64_t seq = slot.seq.load(std::memory_order_acquire);
+            if (seq < expected)
+                break; // not yet written
+
+            uint64_t words[numWords];
+            for (std::size_t i = 0; i < numWords; ++i)
+                words[i] = slot.words[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq != expected || slot.seq.load(std::memory_order_relaxed) != expected)
+            {
+                // overwritten in the meantime
+                ++dropped;
+                continue;
+            }
+
+            AllocationTraceRecord r;
+            r.timestamp = words[0];
+            r.handle = words[1];
+            r.size = words[2];
+            r.thread = static_cast<uint32_t>(words[3] & 0xffffffff);
+            r.segments = static_cast<uint16_t>((words[3] >> 32) & 0xffff);
+            r.chunk = static_cast<uint16_t>(words[3] >> 48);
+            r.segment = static_cast<uint8_t>(words[4] & 0xff);
+            r.op = static_cast<TraceOperation>((words[4] >> 8) & 0xff);
+            r.alignment = static_cast<uint32_t>((words[4] >> 16) & 0xffffffff);
+            out.push_back(r);
+        }
+        return dropped;
+    }
+
+private:
+    static constexpr std::size_t numWords = 5;
+
+    /// one record + its sequence number (2 * position + 2 once written)
+    struct Slot
+    {
+        std::atomic<uint64_t> seq;
+        std::atomic<uint64_t> words[numWords];
+    };
+
+    static std::size_t roundCapacity(std::size_t capacity) noexcept
+    {
+        std::size_t result = 2;
+        while (result < capacity)
+            result *= 2;
+        return result;
+    }
+
+    /// 64 bit finalizer of "splitmix64" (only used to seed the key)
+    static uint64_t mix(uint64_t x) noexcept
+    {
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+        return x ^ (x >> 31);
+    }
+
+    /// @return a small number for the calling thread
+    static uint32_t getThreadNumber() noexcept
+    {
+        static std::atomic<uint32_t> counter(0);
+        static thread_local uint32_t number = ++counter;
+        return number;
+    }
+
+    /// the number of slots (a power of 2)
+    std::size_t m_capacity;
+    std::unique_ptr<Slot[]> m_slots;
+    /// the next position to write
+    std::atomic<uint64_t> m_head;
+    /// the next position to read (protected by m_drainMutex)
+    uint64_t m_tail;
+    std::mutex m_drainMutex;
+    /// the time of the creation (timestamps are relative to this)
+    std::chrono::steady_clock::time_point m_start;
+    /// random key of the handles' hash function (hides the addresses)
+    uint64_t m_key[2];
+};
+
+
+/*
+ * Text format of a trace: A header line, then one line per record with the fields
+ *   <op> <timestamp> <thread> <handle> <size> <alignment> <segments> <chunk> <segment>
+ * where <op> is 'a' (allocate), 'd' (deallocate) or 'e' (expand) and the handle is written as
+ * 16 hex digits. Lines starting with '#' are comments.
+ */
+
+/// the first line of a trace
+constexpr const char* traceHeader = "# spsl allocation trace v1";
+
+/**
+ * Writes a trace in the text format (including the header).
+ * @param[in] os        the stream to write to
+ * @param[in] records   the records
+ */
+inline void writeTrace(std::ostream& os, const std::vector<AllocationTraceRecord>& records)
+{
+    static const char ops[] = { 'a', 'd', 'e' };
+    os << traceHeader << '\n';
+    for (const auto& r : records)
+    {
+        os << ops[static_cast<std::size_t>(r.op) % 3] << ' ' << r.timestamp << ' ' << r.thread
+           << ' ' << std::hex << std::setw(16) << std::setfill('0') << r.handle << std::dec
+           << std::setfill(' ') << ' ' << r.size << ' ' << r.alignment << ' ' << r.segments
+           << ' ' << r.chunk << ' ' << static_cast<unsigned>(r.segment) << '\n';
+    }
+}
+
+/**
+ * Reads a trace in the text format.
+ * @param[in] is        the stream to read from
+ * @return the records
+ * @throws std::runtime_error if a line cannot be parsed
+ */
+inline std::vector<AllocationTraceRecord> readTrace(std::istream& is)
+{
+    std::vector<AllocationTraceRecord> records;
+    std::string line;
+    while (std::getline(is, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::istringstream ss(line);
+        char op = 0;
+        unsigned segment = 0;
+        AllocationTraceRecord r{};
+        ss >> op >> r.timestamp >> r.thread >> std::hex >> r.handle >> std::dec >> r.size >>
+          r.alignment >> r.segments >> r.chunk >> segment;
+        if (!ss || (op != 'a' && op != 'd' && op != 'e') || segment > 0xff)
+            throw std::runtime_error("invalid trace line: " + line);
+        r.segment = static_cast<uint8_t>(segment);
+        r.op = (op == 'a') ? TraceOperation::allocate
+                           : (op == 'd') ? TraceOperation::deallocate : TraceOperation::expand;
+        records.push_back(r);
+    }
+    return records;
+}
+
+} // namespace spsl
+
+#endif /* SPSL_ALLOCTRACE_HPP_ */
@@ -8,6 +8,8 @@
 #ifndef SPSL_COMPAT_HPP_
 #define SPSL_COMPAT_HPP_
 
+#include <cstddef>
+#include <cstdint>
 #include <system_error>
 
 #define SPSL_HAS_CONSTEXPR_ARRAY
@@ -67,6 +69,27 @@ inline void deallocatePageAligned(void* addr)
     VirtualFree(addr, 0U, MEM_RELEASE);
 }
 
+/**
+ * Reserves a region of multiple pages directly from the OS.
+ * @param[in] size          the required size (a multiple of the page size)
+ * @return memory address or nullptr
+ */
+inline void* allocateRegion(std::size_t size)
+{
+    return VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+}
+
+/**
+ * Releases a region returned by allocateRegion(). This implicitly unlocks the memory.
+ * @param[in] addr      the memory address
+ * @param[in] size      the size of the region
+ */
+inline void deallocateRegion(void* addr, std::size_t size)
+{
+    (void)size;
+    VirtualFree(addr, 0U, MEM_RELEASE);
+}
+
 /**
  * Exclude an area of memory from core dumps.
  * * This function is a dummy *
@@ -89,6 +112,17 @@ inline void enableDump(void* addr, std::size_t len, std::error_code* ec = nullpt
     (void)ec;
 }
 
+/**
+ * Ask the OS to back an area of memory with huge pages.
+ * * This function is a dummy *
+ */
+inline void adviseHugePages(void* addr, std::size_t len, std::error_code* ec = nullptr)
+{
+    (void)addr;
+    (void)len;
+    (void)ec;
+}
+
 
 /**
  * Protect an area of memory from being swapped by "locking" it into RAM.
@@ -123,15 +157,44 @@ inline void unlockMemory(void* addr, std::size_t len, std::error_code* ec = null
             throw std::system_error(err);
     }
 }
+
+/// @return the index of the CPU the calling thread is running on
+inline std::size_t getCurrentCpu()
+{
+    return static_cast<std::size_t>(GetCurrentProcessorNumber());
+}
+
+/// @return the NUMA node of the CPU the calling thread is running on (0 if unknown)
+inline std::size_t getCurrentNumaNode()
+{
+    UCHAR node = 0;
+    if (!GetNumaProcessorNode(static_cast<UCHAR>(GetCurrentProcessorNumber()), &node))
+        return 0;
+    return node;
+}
 } // namespace os
 } // namespace spsl
 
 #else // Linux
 
 #include <cerrno>
+#include <sched.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
+// explicit_bzero() is available since glibc 2.25 (declared in <string.h>)
+#if defined(__GLIBC__) && defined(_GNU_SOURCE)
+#if __GLIBC_PREREQ(2, 25)
+#include <cstring>
+#define SPSL_HAS_EXPLICIT_BZERO
+#endif
+// getcpu() is available since glibc 2.29 (declared in <sched.h>)
+#if __GLIBC_PREREQ(2, 29)
+#define SPSL_HAS_GETCPU
+#endif
+#endif
+
 namespace spsl
 {
 namespace os
@@ -226,6 +289,34 @@ inline void enableDump(void* addr, std::size_t len, std::error_code* ec = nullpt
 #endif
 }
 
+/**
+ * Ask the OS to back an area of memory with (transparent) huge pages.
+ * @param[in] addr      the address of the memory area
+ * @param[in] len       the length of the area
+ * @param[out] ec       optional error code to be used instead of throwing
+ * @throws std::system_error on error and if ec == nullptr
+ *
+ * The memory area should be aligned to the huge page size (usually 2 MB).
+ */
+inline void adviseHugePages(void* addr, std::size_t len, std::error_code* ec = nullptr)
+{
+// since Linux 2.6.38
+#ifdef MADV_HUGEPAGE
+    if (0 != madvise(addr, len, MADV_HUGEPAGE))
+    {
+        std::error_code err(errno, std::generic_category());
+        if (ec)
+            *ec = err;
+        else
+            throw std::system_error(err);
+    }
+#else
+    (void)addr;
+    (void)len;
+    (void)ec;
+#endif
+}
+
 /**
  * Protect an area of memory from being swapped by "locking" it into RAM.
  * @param[in] addr      the address of the memory area
@@ -262,10 +353,115 @@ inline void unlockMemory(void* addr, std::size_t len, std::error_code* ec = null
             throw std::system_error(err);
     }
 }
+
+/**
+ * Reserves a region of multiple pages directly from the OS (using mmap(), if available).
+ * @param[in] size          the required size (a multiple of the page size)
+ * @return memory address or nullptr
+ */
+inline void* allocateRegion(std::size_t size)
+{
+#ifdef MAP_ANONYMOUS
+    void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return addr == MAP_FAILED ? nullptr : addr;
+#else
+    return allocatePageAligned(getPageSize(), size);
+#endif
+}
+
+/**
+ * Releases a region returned by allocateRegion(). This implicitly unlocks the memory.
+ * @param[in] addr      the memory address
+ * @param[in] size      the size of the region
+ */
+inline void deallocateRegion(void* addr, std::size_t size)
+{
+#ifdef MAP_ANONYMOUS
+    munmap(addr, size);
+#else
+    std::error_code ec;
+    unlockMemory(addr, size, &ec);
+    enableDump(addr, size, &ec);
+    deallocatePageAligned(addr);
+#endif
+}
+
+/// @return the index of the CPU the calling thread is running on (0 if unknown)
+inline std::size_t getCurrentCpu()
+{
+// note: glibc uses the vDSO (or rseq), which is a lot faster than the system call
+#if defined(__GLIBC__) && defined(_GNU_SOURCE)
+    const int cpu = sched_getcpu();
+    return (cpu >= 0) ? static_cast<std::size_t>(cpu) : 0;
+#elif defined(SYS_getcpu)
+    unsigned cpu = 0;
+    if (0 == syscall(SYS_getcpu, &cpu, nullptr, nullptr))
+        return cpu;
+    return 0;
+#else
+    return 0;
+#endif
+}
+
+/// @return the NUMA node of the CPU the calling thread is running on (0 if unknown)
+inline std::size_t getCurrentNumaNode()
+{
+#if defined(SPSL_HAS_GETCPU)
+    unsigned cpu = 0;
+    unsigned node = 0;
+    if (0 == getcpu(&cpu, &node))
+        return node;
+    return 0;
+#elif defined(SYS_getcpu)
+    unsigned node = 0;
+    if (0 == syscall(SYS_getcpu, nullptr, &node, nullptr))
+        return node;
+    return 0;
+#else
+    return 0;
+#endif
+}
 } // namespace os
 } // namespace spsl
 
 #endif
 
-// define a secure memset function
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace spsl
+{
+namespace bits
+{
+
+/**
+ * Counts the number of trailing zero bits.
+ * @param[in] x     the value to check
+ * @return the index of the lowest bit set in @c x or 64 if @c x is 0
+ */
+inline std::size_t countTrailingZeros(uint64_t x) noexcept
+{
+    if (x == 0)
+        return 64;
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<std::size_t>(__builtin_ctzll(x));
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return static_cast<std::size_t>(index);
+#else
+    std::size_t n = 0;
+    while ((x & 0x1) == 0)
+    {
+        x >>= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+} // namespace bits
+} // namespace spsl
+
 #endif /* SPSL_COMPAT_HPP_ */
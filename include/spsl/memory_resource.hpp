@@ -0,0 +1,113 @@
+/**
+ * @file    Special Purpose Strings Library: memory_resource.hpp
+ * @author  Daniel Evers
+ * @brief   std::pmr::memory_resource implementation based on the page allocators (C++17)
+ * @license MIT
+ */
+
+#ifndef SPSL_MEMORY_RESOURCE_HPP_
+#define SPSL_MEMORY_RESOURCE_HPP_
+
+// std::pmr requires C++17 (note: MSVC only sets __cplusplus correctly with /Zc:__cplusplus)
+#if (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L) || __cplusplus >= 201703L
+#if defined(__has_include)
+#if __has_include(<memory_resource>)
+#define SPSL_HAS_MEMORY_RESOURCE 1
+#endif
+#endif
+#endif
+
+#ifdef SPSL_HAS_MEMORY_RESOURCE
+
+#include <algorithm>
+#include <cstddef>
+#include <memory_resource>
+
+#include "spsl/pagealloc.hpp"
+
+namespace spsl
+{
+
+/**
+ * Memory resource for the polymorphic allocators of the standard library: All memory is
+ * provided by a page allocator, i.e. it is locked into RAM and excluded from core dumps.
+ * In contrast to SensitiveSegmentAllocator, there is only one type for all element types, e.g.
+ * @code
+ *   spsl::sensitive_memory_resource resource;
+ *   std::pmr::vector<std::byte> key(32, std::byte(0), &resource);
+ * @endcode
+ *
+ * Note that the memory isn't wiped when it's released - that's the job of the container (or use
+ * a PasswordString).
+ *
+ * Alignment requests are honored up to the OS's page size (see
+ * SensitivePageAllocator::allocate(std::size_t, std::size_t)). The page allocator type defaults
+ * to SensitivePageAllocator, but ConcurrentSensitivePageAllocator and
+ * ShardedSensitivePageAllocator work as well.
+ */
+template <typename PageAllocator = SensitivePageAllocator>
+class basic_sensitive_memory_resource : public std::pmr::memory_resource
+{
+public:
+    using page_allocator_type = PageAllocator;
+
+    /// Uses the default instance of the page allocator.
+    basic_sensitive_memory_resource()
+      : basic_sensitive_memory_resource(PageAllocator::getDefaultInstance())
+    {
+    }
+    /// Uses the given page allocator, which must outlive this resource.
+    explicit basic_sensitive_memory_resource(PageAllocator& alloc) : m_alloc(&alloc) {}
+
+    basic_sensitive_memory_resource(const basic_sensitive_memory_resource&) = default;
+    basic_sensitive_memory_resource& operator=(const basic_sensitive_memory_resource&) = default;
+    ~basic_sensitive_memory_resource() override = default;
+
+    /**
+     * Returns the default instance of this class, using the default page allocator.
+     * @return a pointer to the instance (e.g. for std::pmr::set_default_resource())
+     */
+    static basic_sensitive_memory_resource* getDefaultInstance()
+    {
+        // "phoenix singleton"
+        static basic_sensitive_memory_resource _instance;
+        return &_instance;
+    }
+
+    PageAllocator* pageAllocator() const noexcept { return m_alloc; }
+
+    /// @return the largest supported alignment
+    std::size_t max_alignment() const noexcept { return m_alloc->getMaxAlignment(); }
+
+protected:
+    // note: the page allocator doesn't support empty allocations
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        return m_alloc->allocate(std::max<std::size_t>(bytes, 1), alignment);
+    }
+
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override
+    {
+        m_alloc->deallocate(p, std::max<std::size_t>(bytes, 1), alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        // memory can be released by any instance that uses the same page allocator
+        auto* that = dynamic_cast<const basic_sensitive_memory_resource*>(&other);
+        return that != nullptr && that->m_alloc == m_alloc;
+    }
+
+private:
+    /// non-owning pointer to the "real" allocator
+    PageAllocator* m_alloc;
+};
+
+/// the memory resource for the default page allocator
+using sensitive_memory_resource = basic_sensitive_memory_resource<>;
+
+} // namespace spsl
+
+#endif /* SPSL_HAS_MEMORY_RESOURCE */
+
+#endif /* SPSL_MEMORY_RESOURCE_HPP_ */
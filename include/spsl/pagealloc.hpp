@@ -9,15 +9,73 @@
 #define SPSL_PAGEALLOC_HPP_
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
 #include <vector>
+#include "spsl/alloctrace.hpp"
 #include "spsl/compat.hpp"
 
 
 namespace spsl
 {
+namespace detail
+{
+/// Errors of protectPages() and unprotectPages() (both steps are best effort)
+struct PageProtectionErrors
+{
+    /// error of locking the pages into RAM (or unlocking them)
+    std::error_code lock;
+    /// error of excluding the pages from core dumps (or including them again)
+    std::error_code dump;
+};
+
+/**
+ * Locks page(s) into RAM and excludes them from core dumps.
+ * @param[in] addr          the memory address
+ * @param[in] size          the size (a multiple of the page size)
+ * @param[in] log           log errors to @c std::cerr?
+ * @return the errors of both steps
+ */
+inline PageProtectionErrors protectPages(void* addr, std::size_t size, bool log = true)
+{
+    PageProtectionErrors errors;
+    os::lockMemory(addr, size, &errors.lock);
+    os::disableDump(addr, size, &errors.dump);
+    if (log && errors.lock)
+        std::cerr << "Failed to lock memory page: " << errors.lock.message() << '\n';
+    if (log && errors.dump)
+        std::cerr << "Failed to disable core dump: " << errors.dump.message() << '\n';
+    return errors;
+}
+
+/**
+ * Unlocks page(s) and includes them in core dumps again (reverts protectPages()).
+ * @param[in] addr          the memory address
+ * @param[in] size          the size (a multiple of the page size)
+ * @return the errors of both steps (always logged to @c std::cerr)
+ */
+inline PageProtectionErrors unprotectPages(void* addr, std::size_t size) noexcept
+{
+    PageProtectionErrors errors;
+    os::unlockMemory(addr, size, &errors.lock);
+    os::enableDump(addr, size, &errors.dump);
+    if (errors.lock)
+        std::cerr << "Failed to unlock memory page: " << errors.lock.message() << '\n';
+    if (errors.dump)
+        std::cerr << "Failed to re-enable core dump: " << errors.dump.message() << '\n';
+    return errors;
+}
+} // namespace detail
 
 /**
  * This class allocates full pages, marks them as "do not swap" and "do not dump".
@@ -25,31 +83,88 @@ namespace spsl
  * The page size is system-dependent, but usually 4K. To handle larger pages, they are divided
  * into "chunks" of 4K size (so usually a 1:1 relationship), thus requiring that the page size
  * must be a multiple of 4K.
- * Each of these 4K chunks is divided into 64 "segments" of 64K that can be reserved and passed
+ * Each of these 4K chunks is divided into 64 "segments" of 64 bytes that can be reserved and passed
  * to the application. This requires 64 bit of "management" info for each chunk to keep track of
  * free and reserved pages.
  *
+ * The segment size is a template parameter (see SensitivePageAllocator for the default of 64
+ * bytes): Smaller segments waste less memory for short secrets like PINs and tokens. A chunk
+ * always consists of 64 segments, i.e. 16 byte segments result in 1K chunks.
+ *
  * The allocator will always allocate one or more pages at once, depending on the required space.
+ * The page size passed to the constructor may also be a multiple of the OS's page size, e.g. 2 MB
+ * to use huge pages. Allocations that are larger than a chunk, but fit into a page, are served
+ * from contiguous free chunks of a page: Each page keeps a bitmap of completely free chunks on
+ * top of the chunks' segment bitmaps.
  * If an application tries to allocate more than one page, multiple contiguous pages are
  * allocated.
  * Due to this allocation strategy, this class should be used like a singleton. Multiple instances
  * are possible, but fewer instances result in less wasted memory.
  * To use only a single instance, use @see getDefaultInstance().
  *
+ * Chunks with free segments are kept in lists ("bins") according to their largest contiguous
+ * range of free segments. An allocation of n segments takes a chunk from the smallest non-empty bin
+ * that can satisfy it and locates the free range using bit operations on the chunk's bitmask, so
+ * full chunks are never visited.
+ *
+ * Optionally, chunks can be dedicated to "size classes" (see setSizeClasses()): A chunk that is
+ * taken while completely free only serves allocations of the same class (1, 2, 3-4, 5-8, 9-16 or
+ * 17-64 segments) until it is completely free again. This prevents long-lived small allocations
+ * from being scattered over many pages, which would keep them allocated (and locked).
+ *
+ * Pages that become completely free can be retained as "spare pages" (still locked) instead of
+ * returning them to the OS immediately (see setSparePageLimits()). This avoids the system calls
+ * for allocating, locking and unlocking pages when allocations are created and destroyed
+ * repeatedly. Likewise, released areas larger than a page can be retained and reused for
+ * allocations of the same number of pages (see setUnmanagedRetentionLimit()).
+ *
+ * Optionally, small allocations can be served from per-thread caches of free segments (see
+ * setThreadCacheSize()). Only cache misses (and overflows) need to take the allocator's mutex,
+ * which then moves a whole batch of segments between the cache and the shared chunks.
+ *
+ * Memory released by other threads can be handed back without taking the mutex (see
+ * deallocateRemote() and setDeferContendedFrees()): It is pushed onto a lock-free list that the
+ * next allocation drains in a batch.
+ *
+ * Single pages can be taken from larger "regions" (see setRegionSize()): A region of multiple pages
+ * is reserved from the OS, locked and excluded from core dumps with a single system call each.
+ * Pages are handed out from and returned to their region without any system calls. A region is
+ * released when all its pages are free (except for one free region that is kept for reuse).
+ *
+ * The allocator keeps statistics in relaxed atomic counters, so getStatistics() can be called at
+ * any time without taking the mutex. Allocations served by the thread caches are only added when
+ * the cache takes the mutex again (refill, drain or flush).
+ *
  * Final note: The internal bitmask assumes a little endian system...
  */
-class SensitivePageAllocator
+template <std::size_t SegmentSize = 64>
+class BasicSensitivePageAllocator
 {
+    static_assert(SegmentSize >= 16 && (SegmentSize & (SegmentSize - 1)) == 0,
+                  "The segment size must be a power of 2 and at least 16 bytes");
+
 public:
-    /// memory is reserved in segments of 64 bytes
-    static constexpr std::size_t segment_size = 64;
-    /// pages are split in chunks of 4K
-    static constexpr std::size_t chunk_size = 4096;
+    /// memory is reserved in segments of SegmentSize bytes
+    static constexpr std::size_t segment_size = SegmentSize;
     /// number of segments per chunk
-    static constexpr std::size_t segmentsPerChunk = chunk_size / segment_size;
+    static constexpr std::size_t segmentsPerChunk = 64;
+    /// pages are split in chunks of 64 segments (4K for 64 byte segments)
+    static constexpr std::size_t chunk_size = segmentsPerChunk * segment_size;
 
     static constexpr uint64_t all64 = 0xffffffffffffffff;
 
+    /// allocations of up to this number of segments may be served from the per-thread caches
+    static constexpr std::size_t threadCacheMaxSegments = 16;
+
+    /// number of size classes (see setSizeClasses())
+    static constexpr std::size_t numSizeClasses = 6;
+
+    /// pages of (multiples of) this size are backed by huge pages if possible
+    static constexpr std::size_t hugePageSize = 2 * 1024 * 1024;
+
+    /// default number of records of the trace buffer (see enableTracing())
+    static constexpr std::size_t defaultTraceCapacity = 65536;
+
     using pointer = void*;
 
     /// information about an allocated area of memory
@@ -75,16 +190,75 @@ public:
 
     /// Callback function type (see below)
     using LeakCallbackFunction =
-      std::function<void(const SensitivePageAllocator*, const AllocationInfo&, bool)>;
+      std::function<void(const BasicSensitivePageAllocator*, const AllocationInfo&, bool)>;
+
+    /// Callback function type for memory obtained from or returned to the OS (see
+    /// setMemoryMapCallback())
+    using MemoryMapCallbackFunction =
+      std::function<void(const BasicSensitivePageAllocator*, const AllocationInfo&, bool)>;
+
+    /// Snapshot of the allocator's statistics (see getStatistics())
+    struct Statistics
+    {
+        /// number of allocations by segment count (index 0: areas larger than a chunk)
+        std::array<uint64_t, segmentsPerChunk + 1> allocations;
+        /// number of deallocations by segment count (index 0: areas larger than a chunk)
+        std::array<uint64_t, segmentsPerChunk + 1> deallocations;
+        /// bytes requested by the allocations that are currently in use
+        uint64_t bytesRequested;
+        /// bytes reserved for the allocations that are currently in use (rounded up to the
+        /// segment or page size)
+        uint64_t bytesReserved;
+        /// bytes in all pages held by the allocator (managed, spare and unmanaged), which are
+        /// locked into RAM unless locking failed
+        uint64_t lockedBytes;
+        /// number of failures to lock memory pages (e.g. due to RLIMIT_MEMLOCK)
+        uint64_t lockFailures;
+        /// number of failures to unlock memory pages
+        uint64_t unlockFailures;
+        /// number of failures to exclude pages from core dumps or to include them again
+        uint64_t dumpFailures;
+        /// number of pages allocated from the OS
+        uint64_t pagesCreated;
+        /// number of pages returned to the OS
+        uint64_t pagesReleased;
+        /// number of calls into the OS to allocate, lock, advise, unlock or release pages
+        uint64_t systemCalls;
+        /// number of pages managed in segments
+        uint64_t managedPages;
+        /// number of spare pages
+        uint64_t sparePages;
+        /// number of areas that aren't managed in segments
+        uint64_t unmanagedAreas;
+        /// number of pages in released unmanaged areas that are kept for reuse
+        uint64_t retainedUnmanagedPages;
+        /// number of regions reserved from the OS (see setRegionSize())
+        uint64_t regions;
+        /// number of deallocations that were deferred using deallocateRemote()
+        uint64_t remoteFrees;
+        /// number of times a thread had to wait for the mutex
+        uint64_t lockWaits;
+        /// total time spent waiting for the mutex
+        uint64_t lockWaitNanoseconds;
+        /// fraction of free segments in the managed pages (0 = all segments in use)
+        double fragmentation;
+    };
 
     /**
      * Constructor: Initializes the allocator, but doesn't yet allocate anything.
      * @param[in] pageSize      the OS's page size (or a multiple thereof)
      * @throws std::runtime_error  if the pageSize isn't a multiple of the segment or the chunk size
      */
-    explicit SensitivePageAllocator(std::size_t pageSize = os::getPageSize())
+    explicit BasicSensitivePageAllocator(std::size_t pageSize = os::getPageSize())
       : m_mutex(), m_pageSize(pageSize), m_chunksPerPage(m_pageSize / chunk_size),
-        m_managedChunks(), m_unmanagedAreas(), m_leakCallback(logLeaks)
+        m_maxAlignment(std::min(os::getPageSize(), m_pageSize & (~m_pageSize + 1))),
+        m_managedPages(), m_pageSerial(0), m_freeBins(), m_sizeClasses(false), m_sparePages(),
+        m_sparePagesLow(0), m_sparePagesHigh(0), m_regions(), m_regionPages(1),
+        m_unmanagedAreas(), m_retainedUnmanagedAreas(), m_retainedUnmanagedPages(0),
+        m_unmanagedRetentionLimit(0), m_threadCacheSize(0), m_threadCaches(),
+        m_threadCacheControl(std::make_shared<ThreadCacheControl>(this)),
+        m_remoteFrees(nullptr), m_deferContendedFrees(false), m_stats(), m_traceBuffer(),
+        m_trace(nullptr), m_leakCallback(logLeaks), m_memoryMapCallback()
     {
         // the page size is expected to be a multiple of the segment size
         if (m_pageSize % segment_size != 0)
@@ -96,10 +270,6 @@ public:
 
         static_assert(chunk_size % segment_size == 0,
                       "The segment size must be a multiple of the chunk size");
-
-        // reserve some memory upfront
-        m_managedChunks.reserve(16);
-        m_unmanagedAreas.reserve(16);
     }
 
     /**
@@ -107,91 +277,100 @@ public:
      * or unmanaged areas that are still in use. If so, the leak callback is called for every
      * location.
      */
-    ~SensitivePageAllocator()
+    ~BasicSensitivePageAllocator()
     {
+        // segments in the thread caches aren't in use -> return them first, and make sure that
+        // the threads won't touch this instance again (exiting threads detach their caches while
+        // holding the control block's mutex, so they either finish first or see no owner)
+        {
+            std::lock_guard<std::mutex> controlLock(m_threadCacheControl->mutex);
+            m_threadCacheControl->owner = nullptr;
+            auto lock = lockMutex();
+            for (ThreadCache* cache : m_threadCaches)
+            {
+                flushThreadCacheLocked(*cache);
+                cache->owner.store(nullptr);
+            }
+            m_threadCaches.clear();
+        }
+        drainRemoteFrees();
+
         // check for memory that is still in use
         bool firstCbCall = true;
 
         // check each chunk and tell the callback
         if (m_leakCallback)
         {
-            for (auto& chunk : m_managedChunks)
+            // report in the order the pages were allocated
+            std::vector<PageInfo*> usedPages;
+            for (auto& page : m_managedPages)
+            {
+                if (page.second.usedSegments != 0)
+                    usedPages.push_back(&page.second);
+            }
+            std::sort(usedPages.begin(), usedPages.end(),
+                      [](const PageInfo* a, const PageInfo* b) { return a->serial < b->serial; });
+
+            for (PageInfo* page : usedPages)
             {
-                if (chunk.segments != all64)
+                for (std::size_t c = 0; c < m_chunksPerPage; ++c)
                 {
-                    // call the callback function for every contiguous range of addresses
-                    while (chunk.segments != all64)
+                    const ChunkManagementInfo& chunk = page->chunks[c];
+                    if (chunk.chunkRun != 0)
+                    {
+                        // an allocation larger than a chunk is reported as a whole
+                        m_leakCallback(this,
+                                       AllocationInfo{ chunk.addr, chunk.chunkRun * chunk_size },
+                                       firstCbCall);
+                        firstCbCall = false;
+                        c += chunk.chunkRun - 1;
+                        continue;
+                    }
+
+                    // call the callback function for every contiguous range of used segments
+                    uint64_t used = ~chunk.segments;
+                    while (used != 0)
                     {
-                        // search for the first used segment
-                        uint64_t mask = 0x1;
-                        uint64_t resetMask = 0;
-                        std::size_t startIndex = 0;
-                        std::size_t endIndex = 0;
-                        bool searchingForStart = true;
-                        for (std::size_t i = 0; i < 64; ++i)
-                        {
-                            if (searchingForStart)
-                            {
-                                if ((chunk.segments & mask) == 0)
-                                {
-                                    startIndex = i;
-                                    endIndex = 63;
-                                    searchingForStart = false;
-                                }
-                            }
-                            else if ((chunk.segments & mask) == mask)
-                            {
-                                endIndex = i - 1;
-                                break;
-                            }
-                            resetMask |= mask;
-                            mask <<= 1;
-                        }
-
-                        // mask as free
-                        chunk.segments |= resetMask;
-
-                        // notify the callback
+                        const std::size_t start = bits::countTrailingZeros(used);
+                        const std::size_t len = bits::countTrailingZeros(~(used >> start));
+                        used &= ~(getBitmask(len) << start);
+
                         m_leakCallback(this,
-                                       AllocationInfo{ reinterpret_cast<char*>(chunk.addr) +
-                                                         startIndex * segment_size,
-                                                       (endIndex - startIndex + 1) * segment_size },
+                                       AllocationInfo{ static_cast<char*>(chunk.addr) +
+                                                         start * segment_size,
+                                                       len * segment_size },
                                        firstCbCall);
                         firstCbCall = false;
                     }
                 }
             }
-        }
-        // finally, remove all associated pages
-        while (!m_managedChunks.empty())
-        {
-            auto pageAddr = m_managedChunks.front().pageAddr;
-            deallocatePage(pageAddr, m_pageSize);
-
-            m_managedChunks.erase(std::remove_if(m_managedChunks.begin(), m_managedChunks.end(),
-                                                 [pageAddr](const ChunkManagementInfo& chunk) {
-                                                     return chunk.pageAddr == pageAddr;
-                                                 }),
-                                  m_managedChunks.end());
-        }
 
-        // and now the "unmanaged" pages
-        for (auto& area : m_unmanagedAreas)
-        {
-            if (m_leakCallback)
+            // and now the "unmanaged" areas (again in the order of their allocation)
+            std::vector<const typename UnmanagedMap::value_type*> usedAreas;
+            for (const auto& area : m_unmanagedAreas)
+                usedAreas.push_back(&area);
+            std::sort(usedAreas.begin(), usedAreas.end(),
+                      [](const typename UnmanagedMap::value_type* a,
+                         const typename UnmanagedMap::value_type* b) {
+                          return a->second.serial < b->second.serial;
+                      });
+            for (auto* area : usedAreas)
             {
-                m_leakCallback(this, area, firstCbCall);
+                m_leakCallback(this, AllocationInfo{ area->first, area->second.size },
+                               firstCbCall);
                 firstCbCall = false;
             }
-            deallocatePage(area.addr, area.size);
         }
+
+        // finally, release everything at once
+        releaseAll();
     }
 
     // disable copy & move
-    SensitivePageAllocator(const SensitivePageAllocator&) = delete;
-    SensitivePageAllocator(SensitivePageAllocator&&) = delete;
-    SensitivePageAllocator& operator=(const SensitivePageAllocator&) = delete;
-    SensitivePageAllocator& operator=(SensitivePageAllocator&&) = delete;
+    BasicSensitivePageAllocator(const BasicSensitivePageAllocator&) = delete;
+    BasicSensitivePageAllocator(BasicSensitivePageAllocator&&) = delete;
+    BasicSensitivePageAllocator& operator=(const BasicSensitivePageAllocator&) = delete;
+    BasicSensitivePageAllocator& operator=(BasicSensitivePageAllocator&&) = delete;
 
     /**
      * Returns the "default instance", a.k.a. a static instance of the allocator. The instance is
@@ -199,10 +378,10 @@ public:
      * Note: This function may throw any exception that the constructor might throw.
      * @return a reference to the instance
      */
-    static SensitivePageAllocator& getDefaultInstance()
+    static BasicSensitivePageAllocator& getDefaultInstance()
     {
         // "phoenix singleton"
-        static SensitivePageAllocator _instance;
+        static BasicSensitivePageAllocator _instance;
         return _instance;
     }
 
@@ -217,6 +396,59 @@ public:
      */
     void setLeakCallback(LeakCallbackFunction fun) { m_leakCallback = std::move(fun); }
 
+    /**
+     * Sets a function that is called with @c true for every page, region or area obtained from
+     * the OS, and with @c false before it is returned to the OS again, e.g. to look up the
+     * allocator instance of an address without locking (see ShardedSensitivePageAllocator).
+     * It is called with the mutex locked (or by the destructor) and must not call this instance.
+     * If it throws for new memory, the memory is released again and the exception is passed on.
+     * It must not throw for released memory.
+     *
+     * Note: This method is intentionally *not* thread-safe.
+     *
+     * @param[in] fun       the function to call
+     */
+    void setMemoryMapCallback(MemoryMapCallbackFunction fun)
+    {
+        m_memoryMapCallback = std::move(fun);
+    }
+
+    /**
+     * Enables or disables the per-thread segment caches. Each thread that allocates or deallocates
+     * up to @c threadCacheMaxSegments segments keeps up to @c count free allocations per segment
+     * count. The caches are refilled and drained in batches of @c count / 2 allocations, which
+     * only require a single lock of the allocator's mutex.
+     *
+     * Cached segments still belong to this allocator, i.e. they keep their pages allocated (and
+     * locked) until they are returned by flushThreadCache(), when the thread exits or when the
+     * allocator is destroyed.
+     *
+     * @param[in] count     the maximum number of cached allocations per segment count and thread
+     *                      (0 disables the caches, which is the default)
+     */
+    void setThreadCacheSize(std::size_t count) noexcept
+    {
+        m_threadCacheSize.store(count, std::memory_order_relaxed);
+    }
+    std::size_t getThreadCacheSize() const noexcept
+    {
+        return m_threadCacheSize.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Returns all segments cached by the calling thread to the allocator.
+     * @throws std::system_error if locking fails
+     */
+    void flushThreadCache()
+    {
+        ThreadCache* cache = findThreadCache();
+        if (cache)
+        {
+            auto lock = lockMutex();
+            flushThreadCacheLocked(*cache);
+        }
+    }
+
 
     /**
      * Default leak callback: logs to std::cerr
@@ -224,7 +456,7 @@ public:
      * @param[in] leak          information about the area that hasn't been deallocated
      * @param[in] first         set to @c true for the first call of this function
      */
-    static void logLeaks(const SensitivePageAllocator* instance, const AllocationInfo& leak,
+    static void logLeaks(const BasicSensitivePageAllocator* instance, const AllocationInfo& leak,
                          bool first)
     {
         if (first)
@@ -247,6 +479,11 @@ public:
     {
         return calcSegmentCount(n) * segment_size;
     }
+    static inline constexpr std::size_t calcChunkCount(std::size_t n)
+    {
+        // "round" n up to a multiple of the chunk size
+        return (((n - 1) / chunk_size) + 1);
+    }
 
     inline std::size_t calcPageCount(std::size_t n)
     {
@@ -260,259 +497,2028 @@ public:
         return (n == segmentsPerChunk ? all64 : ((static_cast<uint64_t>(1) << n) - 1));
     }
 
-
-    // Some informal stuff...
-
-    std::size_t getNumberOfManagedAllocatedPages()
+    /**
+     * Searches for the first contiguous range of n free segments.
+     * @param[in] segments      bitmask of the segments (1 = free)
+     * @param[in] n             the number of segments required (1 ... segmentsPerChunk)
+     * @return the index of the first segment or @c segmentsPerChunk if there is no such range
+     */
+    static inline std::size_t findFreeRange(uint64_t segments, std::size_t n) noexcept
     {
-        std::unique_lock<std::mutex> lock(m_mutex);
-        return m_managedChunks.size() / m_chunksPerPage;
+        // "shift and AND": after each step, bit i is set if there are 'len' free segments
+        // starting at index i - doubling 'len' in each step
+        std::size_t len = 1;
+        while (len < n)
+        {
+            const std::size_t shift = std::min(len, n - len);
+            segments &= segments >> shift;
+            len += shift;
+        }
+        return bits::countTrailingZeros(segments);
     }
 
-    std::size_t getNumberOfUnmanagedAreas()
+    /**
+     * Searches for the first contiguous range of n free segments that starts at a multiple of
+     * @c step segments.
+     * @param[in] segments      bitmask of the segments (1 = free)
+     * @param[in] n             the number of segments required (1 ... segmentsPerChunk)
+     * @param[in] step          the alignment in segments (a power of 2, 1 ... segmentsPerChunk)
+     * @return the index of the first segment or @c segmentsPerChunk if there is no such range
+     */
+    static inline std::size_t findFreeAlignedRange(uint64_t segments, std::size_t n,
+                                                   std::size_t step) noexcept
     {
-        std::unique_lock<std::mutex> lock(m_mutex);
-        return m_unmanagedAreas.size();
+        // every step-th bit set: e.g. 0x5555... for step 2, 0x0101... for step 8
+        const uint64_t starts = (step == segmentsPerChunk) ? 1 : all64 / getBitmask(step);
+        // only free segments at the allowed start indexes can begin a range
+        std::size_t index = 0;
+        for (uint64_t candidates = segments & starts; candidates != 0;
+             candidates &= candidates - 1)
+        {
+            index = bits::countTrailingZeros(candidates);
+            if (index + n > segmentsPerChunk)
+                break;
+            const uint64_t mask = getBitmask(n) << index;
+            if ((segments & mask) == mask)
+                return index;
+        }
+        return segmentsPerChunk;
     }
 
+    /**
+     * Determines the size class of an allocation (see setSizeClasses()).
+     * @param[in] n     the number of segments (1 ... segmentsPerChunk)
+     * @return the size class: 1 (1 segment), 2 (2), 3 (3-4), 4 (5-8), 5 (9-16) or 6 (17-64)
+     */
+    static inline std::size_t getSizeClass(std::size_t n) noexcept
+    {
+        std::size_t sizeClass = 1;
+        for (std::size_t limit = 1; limit < n && sizeClass < numSizeClasses; limit *= 2)
+            ++sizeClass;
+        return sizeClass;
+    }
 
     /**
-     * Allocates a range of memory.
-     * @param[in] size      the minimum size of the allocation
-     * @return memory address
-     * @throws std::bad_alloc if allocation failed
-     * @throws std::system_error if locking fails
+     * Calculates the size of the largest contiguous range of free segments.
+     * @param[in] segments      bitmask of the segments (1 = free)
+     * @return the number of segments in the largest range
      */
-    pointer allocate(std::size_t size)
+    static inline std::size_t largestFreeRange(uint64_t segments) noexcept
     {
-        std::size_t n = calcSegmentCount(size);
-        if (n <= segmentsPerChunk)
-        {
-            return allocateSegment(n);
-        }
-        else
+        std::size_t largest = 0;
+        while (segments != 0)
         {
-            return allocateUnmanaged(size);
+            // skip the used segments, then count the free ones
+            segments >>= bits::countTrailingZeros(segments);
+            const std::size_t len = bits::countTrailingZeros(~segments);
+            largest = std::max(largest, len);
+            if (len == segmentsPerChunk)
+                break;
+            segments >>= len;
         }
+        return largest;
+    }
+
+
+    // Some informal stuff...
+
+    std::size_t getNumberOfManagedAllocatedPages() const noexcept
+    {
+        return m_stats.managedPages.load(std::memory_order_relaxed);
+    }
+
+    std::size_t getNumberOfUnmanagedAreas() const noexcept
+    {
+        return m_stats.unmanagedAreas.load(std::memory_order_relaxed);
+    }
+
+    std::size_t getNumberOfSparePages() const noexcept
+    {
+        return m_stats.sparePages.load(std::memory_order_relaxed);
     }
 
     /**
-     * Deallocates a range of memory.
-     * @param[in] addr      the memory address that was returned from allocate()
-     * @param[in] size      the parameter previously passed to allocate()
-     * @throws std::system_error if unlocking fails
+     * Returns a snapshot of the allocator's statistics. This doesn't take the mutex, so the
+     * values may be slightly inconsistent with each other while other threads are allocating.
+     * @return the current statistics
      */
-    void deallocate(pointer addr, std::size_t size)
+    Statistics getStatistics() const noexcept
     {
-        std::size_t n = calcSegmentCount(size);
-        if (n <= segmentsPerChunk)
-        {
-            deallocateSegment(addr, n);
-        }
-        else
+        Statistics stats;
+        for (std::size_t i = 0; i <= segmentsPerChunk; ++i)
         {
-            deallocateUnmanaged(addr, size);
+            stats.allocations[i] = load(m_stats.allocations[i]);
+            stats.deallocations[i] = load(m_stats.deallocations[i]);
         }
+        stats.bytesRequested = load(m_stats.bytesRequested);
+        stats.bytesReserved = load(m_stats.bytesReserved);
+        stats.lockedBytes = load(m_stats.lockedBytes);
+        stats.lockFailures = load(m_stats.lockFailures);
+        stats.unlockFailures = load(m_stats.unlockFailures);
+        stats.dumpFailures = load(m_stats.dumpFailures);
+        stats.pagesCreated = load(m_stats.pagesCreated);
+        stats.pagesReleased = load(m_stats.pagesReleased);
+        stats.systemCalls = load(m_stats.systemCalls);
+        stats.managedPages = load(m_stats.managedPages);
+        stats.sparePages = load(m_stats.sparePages);
+        stats.unmanagedAreas = load(m_stats.unmanagedAreas);
+        stats.retainedUnmanagedPages = load(m_stats.retainedUnmanagedPages);
+        stats.regions = load(m_stats.regions);
+        stats.remoteFrees = load(m_stats.remoteFrees);
+        stats.lockWaits = load(m_stats.lockWaits);
+        stats.lockWaitNanoseconds = load(m_stats.lockWaitNanoseconds);
+
+        const uint64_t totalSegments = stats.managedPages * m_chunksPerPage * segmentsPerChunk;
+        const uint64_t usedSegments = std::min(load(m_stats.usedSegments), totalSegments);
+        stats.fragmentation =
+          totalSegments ? static_cast<double>(totalSegments - usedSegments) /
+                            static_cast<double>(totalSegments)
+                        : 0.0;
+        return stats;
     }
 
-private:
+
     /**
-     * Allocates a range of memory that isn't managed in segments, but provided to the caller
-     * completely.
-     * @param[in] size      the required size
-     * @return the allocate memory
+     * Configures the retention of spare pages: Pages that become completely free are kept (locked)
+     * until there are more than @c high spare pages. Then the spare pages are released down to
+     * @c low pages. New pages are always taken from the spare pages first.
+     * The default is to retain no spare pages.
+     * @param[in] low       the number of spare pages to keep after releasing (capped at @c high)
+     * @param[in] high      the maximum number of spare pages
      * @throws std::bad_alloc if allocation failed
      * @throws std::system_error if locking fails
      */
-    pointer allocateUnmanaged(std::size_t size)
+    void setSparePageLimits(std::size_t low, std::size_t high)
     {
-        std::unique_lock<std::mutex> lock(m_mutex);
-        size = roundToPageSize(size);
+        auto lock = lockMutex();
+        // reserve the memory upfront: retaining a page must not throw
+        m_sparePages.reserve(high);
+        m_sparePagesLow = std::min(low, high);
+        m_sparePagesHigh = high;
+        if (m_sparePages.size() > m_sparePagesHigh)
+            trimSparePages(m_sparePagesLow);
+    }
 
-        // reserve memory for the management info upfront - if it throws, we don't have to clean up
-        m_unmanagedAreas.reserve(m_unmanagedAreas.size() + 1);
+    /**
+     * Allocates and locks pages upfront and keeps them as spare pages, so that the first
+     * allocations don't have to wait for the OS. The spare page limits are raised to keep
+     * at least @c pages spare pages.
+     * Allocation stops at the first page that cannot be allocated or locked (e.g. due to
+     * RLIMIT_MEMLOCK), without logging any errors.
+     * @param[in] pages     the number of spare pages to provide
+     * @return the number of spare pages that are available now
+     * @throws std::bad_alloc if allocating the management info failed
+     * @throws std::system_error if locking the mutex fails
+     */
+    std::size_t prewarm(std::size_t pages)
+    {
+        auto lock = lockMutex();
+        m_sparePages.reserve(pages);
+        m_sparePagesHigh = std::max(m_sparePagesHigh, pages);
+        m_sparePagesLow = std::max(m_sparePagesLow, pages);
 
-        pointer addr = allocatePage(m_pageSize, size);
+        while (m_sparePages.size() < pages)
+        {
+            std::error_code ec;
+            pointer addr = nullptr;
+            try
+            {
+                addr = allocatePage(m_pageSize, m_pageSize, &ec);
+            }
+            catch (const std::bad_alloc&)
+            {
+                break;
+            }
+            if (ec)
+            {
+                // don't keep pages that aren't protected
+                deallocatePage(addr, m_pageSize);
+                break;
+            }
+            m_sparePages.push_back(addr);
+        }
+        updatePageCounts();
+        return m_sparePages.size();
+    }
 
-        // save
-        m_unmanagedAreas.emplace_back(addr, size);
-        return addr;
+    /**
+     * Same as prewarm(), but for a number of bytes.
+     * @param[in] bytes     the number of bytes to provide (rounded up to the page size)
+     * @return the number of bytes available in spare pages now
+     * @throws std::bad_alloc if allocating the management info failed
+     * @throws std::system_error if locking the mutex fails
+     */
+    std::size_t reserve(std::size_t bytes)
+    {
+        return prewarm(bytes ? calcPageCount(bytes) : 0) * m_pageSize;
     }
 
     /**
-     * Deallocates memory.
-     * @param[in] addr      the address previously returned by allocateUnmanaged()
-     * @param[in] size      the size of the allocation
-     * @throws std::system_error if unlocking fails
+     * Returns all spare pages, retained unmanaged areas (and regions without used pages) to the
+     * OS.
+     * @return the number of spare pages and pages in retained unmanaged areas released
+     * @throws std::system_error if locking fails
      */
-    void deallocateUnmanaged(pointer addr, std::size_t size)
+    std::size_t releaseUnused()
     {
-        std::unique_lock<std::mutex> lock(m_mutex);
-        size = roundToPageSize(size);
-        deallocatePage(addr, size);
-        m_unmanagedAreas.erase(
-          std::remove_if(m_unmanagedAreas.begin(), m_unmanagedAreas.end(),
-                         [=](const AllocationInfo& a) { return a.addr == addr; }),
-          m_unmanagedAreas.end());
+        auto lock = lockMutex();
+        drainRemoteFrees();
+        const std::size_t count = m_sparePages.size() + m_retainedUnmanagedPages;
+        trimSparePages(0);
+        trimRetainedUnmanagedAreas(0);
+        releaseFreeRegions(0);
+        return count;
     }
 
     /**
-     * Allocates a contiguous range of n segments.
-     * @param[in] n     the number of segments to reserver
-     * @return the allocate memory
-     * @throws std::bad_alloc if allocation failed
+     * Configures the retention of unmanaged areas (allocations larger than a page): Released
+     * areas are kept (locked) as long as they contain at most @c pages pages in total. They are
+     * reused for allocations with the same number of pages, which avoids allocating, locking and
+     * releasing them again and again.
+     * The default is to retain no unmanaged areas.
+     * @param[in] pages     the maximum number of pages in all retained areas
+     * @throws std::system_error if locking fails
+     */
+    void setUnmanagedRetentionLimit(std::size_t pages)
+    {
+        auto lock = lockMutex();
+        m_unmanagedRetentionLimit = pages;
+        trimRetainedUnmanagedAreas(pages);
+    }
+    std::size_t getUnmanagedRetentionLimit()
+    {
+        auto lock = lockMutex();
+        return m_unmanagedRetentionLimit;
+    }
+
+    /**
+     * Enables or disables size classes: Chunks that are completely free are assigned to the size
+     * class of the allocation that takes them (see getSizeClass()) and only serve allocations of
+     * the same class until they are completely free again.
+     * Chunks that are already partially in use when changing this setting keep their class (or
+     * lack thereof) and are only reused for allocations of that class.
+     * @param[in] enable    @c true to use size classes (the default is @c false)
+     * @throws std::system_error if locking fails
+     */
+    void setSizeClasses(bool enable)
+    {
+        auto lock = lockMutex();
+        m_sizeClasses = enable;
+    }
+    bool getSizeClasses()
+    {
+        auto lock = lockMutex();
+        return m_sizeClasses;
+    }
+
+    /**
+     * Configures the number of pages that are reserved from the OS at once. Single pages are then
+     * taken from these regions, which are locked and excluded from core dumps as a whole. This
+     * saves a lot of system calls, but locks more memory than required.
+     * Existing regions are not affected by changing the size.
+     * @param[in] pages     the number of pages per region (1 disables regions, which is the
+     *                      default)
      * @throws std::system_error if locking fails
      */
-    pointer allocateSegment(std::size_t n)
+    void setRegionSize(std::size_t pages)
+    {
+        auto lock = lockMutex();
+        m_regionPages = std::max<std::size_t>(pages, 1);
+    }
+    std::size_t getRegionSize()
     {
-        std::unique_lock<std::mutex> lock(m_mutex);
+        auto lock = lockMutex();
+        return m_regionPages;
+    }
 
-        // turn 'n' into a mask of n bits (while avoiding overflow)
-        const uint64_t bitmask = getBitmask(n);
 
-        // check all chunks we have allocated
-        for (auto& chunk : m_managedChunks)
+    /**
+     * Allocates a range of memory.
+     * @param[in] size      the minimum size of the allocation
+     * @return memory address
+     * @throws std::bad_alloc if allocation failed
+     * @throws std::system_error if locking fails
+     */
+    pointer allocate(std::size_t size)
+    {
+        const std::size_t n = calcSegmentCount(size);
+        if (n <= threadCacheMaxSegments)
         {
-            // bits: 1 = free, 0 = reserved
-            // search from index 0 to the last possible (size - n)
-            uint64_t mask = bitmask;
-            for (std::size_t index = 0; index <= segmentsPerChunk - n; ++index)
+            const std::size_t cacheSize = getThreadCacheSize();
+            ThreadCache* cache = cacheSize ? getThreadCache() : nullptr;
+            if (cache)
             {
-                if ((chunk.segments & mask) == mask)
-                {
-                    // found! -> mark as reserved
-                    chunk.segments &= ~mask;
-                    return reinterpret_cast<char*>(chunk.addr) + index * segment_size;
-                }
-                // shift the mask
-                mask <<= 1;
+                pointer addr = allocateCachedSegment(*cache, n, size, cacheSize);
+                traceEvent(TraceOperation::allocate, addr, size);
+                return addr;
             }
         }
 
-        // reserve memory for the management info upfront - if it throws, we don't have to clean up
-        m_managedChunks.reserve(m_managedChunks.size() + m_chunksPerPage);
+        auto lock = lockMutex();
+        drainRemoteFrees();
+        pointer addr = allocateLocked(size);
+        traceEvent(TraceOperation::allocate, addr, size);
+        return addr;
+    }
+
+    /**
+     * Allocates a range of memory with a given alignment: Up to the chunk size, a suitably
+     * aligned range of free segments is searched, larger alignments use whole chunks. Areas larger
+     * than a page are always page-aligned. Alignments larger than the segment size require
+     * deallocate(pointer, std::size_t, std::size_t) to release the memory.
+     * @param[in] size          the minimum size of the allocation
+     * @param[in] alignment     the required alignment (a power of 2, at most getMaxAlignment())
+     * @return memory address
+     * @throws std::invalid_argument if the alignment isn't a power of 2
+     * @throws std::bad_alloc if allocation failed or the alignment is too large
+     * @throws std::system_error if locking fails
+     */
+    pointer allocate(std::size_t size, std::size_t alignment)
+    {
+        if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+            throw std::invalid_argument("the alignment must be a power of 2");
+        if (alignment <= segment_size)
+            return allocate(size);
+        if (alignment > m_maxAlignment)
+            throw std::bad_alloc();
+
+        auto lock = lockMutex();
+        drainRemoteFrees();
+        pointer addr = allocateAlignedLocked(size, alignment);
+        traceEvent(TraceOperation::allocate, addr, size, alignment);
+        return addr;
+    }
 
-        // nothing found yet -> need to allocate a new page
-        pointer addr = allocatePage(m_pageSize, m_pageSize);
+    /// @return the largest alignment supported by allocate(std::size_t, std::size_t)
+    std::size_t getMaxAlignment() const noexcept { return m_maxAlignment; }
 
-        // add the chunks
-        for (std::size_t i = 0; i < m_chunksPerPage; ++i)
+    /**
+     * Allocates multiple ranges of memory with a single lock of the mutex. Either all
+     * allocations succeed or none.
+     * @param[in] sizes     the minimum sizes of the allocations
+     * @param[out] out      receives the memory addresses
+     * @param[in] count     the number of allocations
+     * @throws std::bad_alloc if allocation failed
+     * @throws std::system_error if locking fails
+     */
+    void allocate_bulk(const std::size_t* sizes, pointer* out, std::size_t count)
+    {
+        auto lock = lockMutex();
+        drainRemoteFrees();
+
+        std::size_t i = 0;
+        try
         {
-            m_managedChunks.push_back(
-              ChunkManagementInfo{ reinterpret_cast<char*>(addr) + i * chunk_size, addr, all64 });
+            for (; i < count; ++i)
+                out[i] = allocateLocked(sizes[i]);
         }
-        ChunkManagementInfo& chunk = m_managedChunks[m_managedChunks.size() - m_chunksPerPage];
-
-        // mark the first N segments as reserved
-        chunk.segments &= ~bitmask;
+        catch (...)
+        {
+            while (i-- > 0)
+                deallocateLocked(out[i], sizes[i]);
+            throw;
+        }
+        for (i = 0; i < count; ++i)
+            traceEvent(TraceOperation::allocate, out[i], sizes[i]);
+    }
 
-        return chunk.addr;
+    /**
+     * Deallocates multiple ranges of memory with a single lock of the mutex.
+     * @param[in] addrs     the memory addresses that were returned from allocate()
+     * @param[in] sizes     the parameters previously passed to allocate()
+     * @param[in] count     the number of allocations
+     * @throws std::system_error if locking fails
+     */
+    void deallocate_bulk(const pointer* addrs, const std::size_t* sizes, std::size_t count)
+    {
+        auto lock = lockMutex();
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            traceEvent(TraceOperation::deallocate, addrs[i], sizes[i]);
+            deallocateLocked(addrs[i], sizes[i]);
+        }
     }
 
     /**
-     * Deallocates memory.
-     * @param[in] addr      the address previously returned by allocateSegment()
-     * @param[in] n         the number of segments to release
+     * Deallocates a range of memory.
+     * @param[in] addr      the memory address that was returned from allocate()
+     * @param[in] size      the parameter previously passed to allocate()
      * @throws std::system_error if unlocking fails
      */
-    void deallocateSegment(pointer addr, std::size_t n)
+    void deallocate(pointer addr, std::size_t size)
     {
-        std::unique_lock<std::mutex> lock(m_mutex);
-
-        // turn 'n' into a mask of n bits (while avoiding overflow)
-        const uint64_t bitmask = getBitmask(n);
+        traceEvent(TraceOperation::deallocate, addr, size);
 
-        // find the matching chunk and save the page's address
-        pointer pageAddr = nullptr;
-        for (auto& chunk : m_managedChunks)
+        const std::size_t n = calcSegmentCount(size);
+        if (n <= threadCacheMaxSegments)
         {
-            if (addr >= chunk.addr && addr < reinterpret_cast<char*>(chunk.addr) + chunk_size)
-            {
-                // found: calculate the index and the bit mask
-                std::size_t index = static_cast<std::size_t>(reinterpret_cast<char*>(addr) -
-                                                             reinterpret_cast<char*>(chunk.addr)) /
-                                    segment_size;
-                uint64_t mask = bitmask << index;
-                chunk.segments |= mask;
-
-                // all free?
-                if (chunk.segments == all64)
-                {
-                    // save the page's address (to cleanup?)
-                    pageAddr = chunk.pageAddr;
-                }
-                break;
-            }
+            const std::size_t cacheSize = getThreadCacheSize();
+            ThreadCache* cache = cacheSize ? getThreadCache() : nullptr;
+            if (cache && deallocateCachedSegment(*cache, addr, n, size, cacheSize))
+                return;
         }
 
-        if (pageAddr)
+        if (m_deferContendedFrees.load(std::memory_order_relaxed))
         {
-            // can the whole page be released?
-            for (auto& chunk : m_managedChunks)
+            // don't wait for another thread, let its next allocation do the work
+            std::unique_lock<std::mutex> lock(m_mutex, std::try_to_lock);
+            if (!lock.owns_lock())
             {
-                if (chunk.pageAddr == pageAddr)
-                {
-                    if (chunk.segments != all64)
-                        // something is still in use
-                        return;
-                }
+                pushRemoteFree(addr, size);
+                return;
             }
-            deallocatePage(pageAddr, m_pageSize);
-            m_managedChunks.erase(std::remove_if(m_managedChunks.begin(), m_managedChunks.end(),
-                                                 [pageAddr](const ChunkManagementInfo& chunk) {
-                                                     return chunk.pageAddr == pageAddr;
-                                                 }),
-                                  m_managedChunks.end());
+            deallocateLocked(addr, size);
         }
-    }
-
-    static pointer allocatePage(std::size_t pageSize, std::size_t size)
-    {
-        pointer addr = os::allocatePageAligned(pageSize, size);
-        if (!addr)
-            throw std::bad_alloc();
-
-        std::error_code ec;
-        os::lockMemory(addr, size, &ec);
-        if (ec)
+        else
         {
-            std::cerr << "Failed to lock memory page: " << ec.message() << '\n';
-            ec.clear();
+            auto lock = lockMutex();
+            deallocateLocked(addr, size);
         }
-        os::disableDump(addr, size, &ec);
-        if (ec)
-            std::cerr << "Failed to disable core dump: " << ec.message() << '\n';
-        return addr;
     }
 
-    static void deallocatePage(pointer addr, std::size_t size) noexcept
+    /**
+     * Deallocates a range of memory that was allocated with an alignment.
+     * @param[in] addr          the memory address that was returned from allocate()
+     * @param[in] size          the size previously passed to allocate()
+     * @param[in] alignment     the alignment previously passed to allocate()
+     * @throws std::system_error if unlocking fails
+     */
+    void deallocate(pointer addr, std::size_t size, std::size_t alignment)
     {
-        std::error_code ec;
-        os::unlockMemory(addr, size, &ec);
-        if (ec)
-        {
-            std::cerr << "Failed to unlock memory page: " << ec.message() << '\n';
-            ec.clear();
-        }
-        os::enableDump(addr, size, &ec);
-        if (ec)
-            std::cerr << "Failed to re-enable core dump: " << ec.message() << '\n';
-        os::deallocatePageAligned(addr);
+        // only small allocations with large alignments are special (they use whole chunks)
+        if (alignment <= chunk_size || size > m_pageSize)
+            return deallocate(addr, size);
+
+        traceEvent(TraceOperation::deallocate, addr, size, alignment);
+        auto lock = lockMutex();
+        const std::size_t k = calcChunkCount(size);
+        deallocateChunksLocked(addr, k);
+        countDeallocation(0, size, k * chunk_size);
     }
 
-private:
-    /// Information about a chunk that is managed
-    struct ChunkManagementInfo
+    /**
+     * Deallocates a range of memory without taking the mutex, e.g. from a thread other than the
+     * one that usually uses this allocator (instance): The memory is pushed onto a lock-free list
+     * of "remote frees", which is drained in a batch by the next allocation (or by
+     * flushRemoteFrees()). The memory must not be accessed anymore, because the list is stored in
+     * the memory itself.
+     * @param[in] addr      the memory address that was returned from allocate()
+     * @param[in] size      the parameter previously passed to allocate()
+     */
+    void deallocateRemote(pointer addr, std::size_t size) noexcept
     {
-        /// points to the beginning of the chunk
+        traceEvent(TraceOperation::deallocate, addr, size);
+        pushRemoteFree(addr, size);
+    }
+
+    /**
+     * Deallocates a range of memory that was allocated with an alignment without taking the mutex
+     * (see deallocateRemote(pointer, std::size_t)). Only small allocations with alignments larger
+     * than a chunk can't be deferred (their release needs the alignment), these are released
+     * right away.
+     * @param[in] addr          the memory address that was returned from allocate()
+     * @param[in] size          the size previously passed to allocate()
+     * @param[in] alignment     the alignment previously passed to allocate()
+     * @throws std::system_error if locking fails
+     */
+    void deallocateRemote(pointer addr, std::size_t size, std::size_t alignment)
+    {
+        if (alignment <= chunk_size || size > m_pageSize)
+            deallocateRemote(addr, size);
+        else
+            deallocate(addr, size, alignment);
+    }
+
+    /**
+     * Performs all pending deallocations of deallocateRemote().
+     * @throws std::system_error if locking fails
+     */
+    void flushRemoteFrees()
+    {
+        auto lock = lockMutex();
+        drainRemoteFrees();
+    }
+
+    /**
+     * Configures deallocate() to use deallocateRemote() instead of waiting if the mutex is held
+     * by another thread. This way, threads that release memory never wait for threads that
+     * allocate memory.
+     * @param[in] enable    @c true to defer contended deallocations (the default is @c false)
+     */
+    void setDeferContendedFrees(bool enable) noexcept
+    {
+        m_deferContendedFrees.store(enable, std::memory_order_relaxed);
+    }
+    bool getDeferContendedFrees() const noexcept
+    {
+        return m_deferContendedFrees.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Tries to grow an allocation in place by claiming the free segments that directly follow it
+     * in the same chunk. If this succeeds, the allocation must be deallocated using the new size.
+     * @param[in] addr      the memory address that was returned from allocate()
+     * @param[in] oldSize   the parameter previously passed to allocate()
+     * @param[in] newSize   the required size
+     * @return @c true if the allocation has (at least) the new size now, @c false if a new
+     *         allocation is required
+     * @throws std::system_error if locking fails
+     */
+    bool try_expand(pointer addr, std::size_t oldSize, std::size_t newSize)
+    {
+        const std::size_t oldCount = calcSegmentCount(oldSize);
+        const std::size_t newCount = calcSegmentCount(newSize);
+        // note: areas larger than a chunk are never expanded and allocations never shrink
+        if (oldCount > segmentsPerChunk || newCount > segmentsPerChunk || newCount < oldCount)
+            return false;
+        if (newCount == oldCount)
+        {
+            countResize(newCount, oldSize, newSize, 0);
+            traceEvent(TraceOperation::expand, addr, newSize);
+            return true;
+        }
+
+        auto lock = lockMutex();
+        auto it = findManagedPage(addr);
+        if (it == m_managedPages.end())
+            return false;
+
+        const std::size_t offset = static_cast<std::size_t>(static_cast<char*>(addr) - it->first);
+        ChunkManagementInfo& chunk = it->second.chunks[offset / chunk_size];
+        const std::size_t index = (offset % chunk_size) / segment_size;
+        if (index + newCount > segmentsPerChunk)
+            return false;
+
+        // all segments after the current allocation must be free
+        const uint64_t mask = getBitmask(newCount - oldCount) << (index + oldCount);
+        if ((chunk.segments & mask) != mask)
+            return false;
+
+        chunk.segments &= ~mask;
+        it->second.usedSegments += newCount - oldCount;
+        m_stats.usedSegments.fetch_add(newCount - oldCount, std::memory_order_relaxed);
+        updateFreeBin(chunk);
+        countResize(newCount, oldSize, newSize, (newCount - oldCount) * segment_size);
+        traceEvent(TraceOperation::expand, addr, newSize);
+        return true;
+    }
+
+    /**
+     * Enables tracing: Every allocation, deallocation and expansion is recorded in a lock-free
+     * ring buffer (see AllocationTraceBuffer), which is created by the first call. No addresses
+     * are recorded. The records can be retrieved using drainTrace() or dumpTrace().
+     * @param[in] capacity  the number of records in the buffer (only used by the first call)
+     * @throws std::bad_alloc if the buffer cannot be allocated
+     * @throws std::system_error if locking fails
+     */
+    void enableTracing(std::size_t capacity = defaultTraceCapacity)
+    {
+        auto lock = lockMutex();
+        if (!m_traceBuffer)
+            m_traceBuffer.reset(new AllocationTraceBuffer(capacity));
+        m_trace.store(m_traceBuffer.get(), std::memory_order_release);
+    }
+    /// Disables tracing (the buffer and the records are kept).
+    void disableTracing() noexcept { m_trace.store(nullptr, std::memory_order_release); }
+    bool isTracing() const noexcept { return m_trace.load(std::memory_order_relaxed) != nullptr; }
+
+    /**
+     * Moves the records written since the last call to a vector.
+     * @param[out] out      the records are appended here
+     * @return the number of records that were lost because the buffer was full
+     * @throws std::system_error if locking fails
+     */
+    std::size_t drainTrace(std::vector<AllocationTraceRecord>& out)
+    {
+        AllocationTraceBuffer* trace = nullptr;
+        {
+            auto lock = lockMutex();
+            trace = m_traceBuffer.get();
+        }
+        return trace ? trace->drain(out) : 0;
+    }
+
+    /**
+     * Writes the records written since the last drain in the text format (see writeTrace()).
+     * Lost records are reported in a comment.
+     * @param[in] os        the stream to write to
+     * @throws std::system_error if locking fails
+     */
+    void dumpTrace(std::ostream& os)
+    {
+        std::vector<AllocationTraceRecord> records;
+        const std::size_t dropped = drainTrace(records);
+        writeTrace(os, records);
+        if (dropped != 0)
+            os << "# " << dropped << " record(s) dropped\n";
+    }
+
+    /**
+     * Checks if memory belongs to this allocator.
+     * @param[in] addr      the memory address
+     * @return @c true if @c addr is within a managed page or an unmanaged area of this allocator
+     * @throws std::system_error if locking fails
+     */
+    bool owns(pointer addr)
+    {
+        auto lock = lockMutex();
+        if (findManagedPage(addr) != m_managedPages.end())
+            return true;
+
+        // the last area starting at or before addr must contain it
+        char* p = static_cast<char*>(addr);
+        auto it = m_unmanagedAreas.upper_bound(p);
+        if (it == m_unmanagedAreas.begin())
+            return false;
+        --it;
+        return p < it->first + it->second.size;
+    }
+
+private:
+    /// Records an operation if tracing is enabled (see enableTracing())
+    void traceEvent(TraceOperation op, pointer addr, std::size_t size,
+                    std::size_t alignment = 0) noexcept
+    {
+        AllocationTraceBuffer* trace = m_trace.load(std::memory_order_acquire);
+        if (!trace)
+            return;
+
+        // note: the chunk index assumes that pages are aligned to the page size
+        const std::size_t n = calcSegmentCount(size);
+        const std::uintptr_t a = reinterpret_cast<std::uintptr_t>(addr);
+        trace->record(op, addr, size, alignment, n <= segmentsPerChunk ? n : 0,
+                      (a % m_pageSize) / chunk_size, (a % chunk_size) / segment_size);
+    }
+
+    /// Pushes memory onto the list of remote frees (see deallocateRemote())
+    void pushRemoteFree(pointer addr, std::size_t size) noexcept
+    {
+        RemoteFree* node = new (addr) RemoteFree{ nullptr, size };
+        node->next = m_remoteFrees.load(std::memory_order_relaxed);
+        while (!m_remoteFrees.compare_exchange_weak(node->next, node, std::memory_order_release,
+                                                    std::memory_order_relaxed))
+        {
+        }
+        add(m_stats.remoteFrees, 1);
+    }
+
+    /**
+     * Allocates memory of any size - requires that the mutex is locked.
+     * @param[in] size      the minimum size of the allocation
+     * @return the allocated memory
+     * @throws std::bad_alloc if allocation failed
+     */
+    pointer allocateLocked(std::size_t size)
+    {
+        const std::size_t n = calcSegmentCount(size);
+        if (n <= segmentsPerChunk)
+        {
+            pointer addr = allocateSegmentLocked(n);
+            countAllocation(n, size, n * segment_size);
+            return addr;
+        }
+        else if (size <= m_pageSize)
+        {
+            const std::size_t k = calcChunkCount(size);
+            pointer addr = allocateChunksLocked(k);
+            countAllocation(0, size, k * chunk_size);
+            return addr;
+        }
+        else
+        {
+            return allocateUnmanagedLocked(size);
+        }
+    }
+
+    /**
+     * Allocates memory of any size with an alignment larger than the segment size - requires
+     * that the mutex is locked.
+     * @param[in] size          the minimum size of the allocation
+     * @param[in] alignment     the alignment (a power of 2, at most m_maxAlignment)
+     * @return the allocated memory
+     * @throws std::bad_alloc if allocation failed
+     */
+    pointer allocateAlignedLocked(std::size_t size, std::size_t alignment)
+    {
+        const std::size_t n = calcSegmentCount(size);
+        if (n <= segmentsPerChunk && alignment <= chunk_size)
+        {
+            pointer addr = allocateAlignedSegmentLocked(n, alignment / segment_size);
+            countAllocation(n, size, n * segment_size);
+            return addr;
+        }
+        else if (size <= m_pageSize)
+        {
+            // note: pages are aligned to m_maxAlignment, so aligning the chunk index is enough
+            const std::size_t k = calcChunkCount(size);
+            const std::size_t step = std::max<std::size_t>(alignment / chunk_size, 1);
+            pointer addr = allocateChunksLocked(k, step);
+            countAllocation(0, size, k * chunk_size);
+            return addr;
+        }
+        else
+        {
+            // unmanaged areas are page-aligned anyway
+            return allocateUnmanagedLocked(size);
+        }
+    }
+
+    /**
+     * Allocates a contiguous range of n segments that starts at a multiple of @c step segments -
+     * requires that the mutex is locked.
+     * @param[in] n         the number of segments to reserve
+     * @param[in] step      the alignment in segments (a power of 2, 1 ... segmentsPerChunk)
+     * @return the allocated memory
+     * @throws std::bad_alloc if allocation failed
+     */
+    pointer allocateAlignedSegmentLocked(std::size_t n, std::size_t step)
+    {
+        // the bins only know the largest free range, so check the chunks of all matching bins
+        const std::size_t sizeClass = m_sizeClasses ? getSizeClass(n) : 0;
+        ChunkManagementInfo* chunk = nullptr;
+        std::size_t index = segmentsPerChunk;
+        for (std::size_t c : { sizeClass, std::size_t(0) })
+        {
+            const FreeBins& bins = m_freeBins[c];
+            for (std::size_t bin = n; bin <= segmentsPerChunk && !chunk; ++bin)
+            {
+                for (ChunkManagementInfo* it = bins.chunks[bin]; it; it = it->next)
+                {
+                    index = findFreeAlignedRange(it->segments, n, step);
+                    if (index != segmentsPerChunk)
+                    {
+                        chunk = it;
+                        break;
+                    }
+                }
+            }
+            if (chunk || c == 0)
+                break;
+        }
+        if (!chunk)
+        {
+            // nothing found -> need to allocate a new page
+            chunk = &addManagedPage().chunks[0];
+            index = 0;
+        }
+        return reserveSegments(*chunk, index, n, sizeClass);
+    }
+
+    /**
+     * Allocates a range of memory that isn't managed in segments, but provided to the caller
+     * completely - requires that the mutex is locked.
+     * @param[in] size      the required size
+     * @return the allocate memory
+     * @throws std::bad_alloc if allocation failed
+     */
+    pointer allocateUnmanagedLocked(std::size_t size)
+    {
+        const std::size_t requested = size;
+        const std::size_t pages = calcPageCount(size);
+        size = pages * m_pageSize;
+
+        // prefer a retained area of the same size
+        pointer addr = nullptr;
+        auto bucket = m_retainedUnmanagedAreas.find(pages);
+        if (bucket != m_retainedUnmanagedAreas.end())
+        {
+            addr = bucket->second.back();
+            bucket->second.pop_back();
+            if (bucket->second.empty())
+                m_retainedUnmanagedAreas.erase(bucket);
+            m_retainedUnmanagedPages -= pages;
+        }
+        else
+        {
+            addr = allocatePage(m_pageSize, size);
+        }
+
+        // save
+        try
+        {
+            m_unmanagedAreas.emplace(static_cast<char*>(addr),
+                                     UnmanagedArea{ size, m_pageSerial++ });
+        }
+        catch (...)
+        {
+            retainOrReleaseUnmanagedArea(addr, pages);
+            updatePageCounts();
+            throw;
+        }
+        updatePageCounts();
+        countAllocation(0, requested, size);
+        return addr;
+    }
+
+    /**
+     * Deallocates memory - requires that the mutex is locked.
+     * @param[in] addr      the address previously returned by allocateUnmanagedLocked()
+     * @param[in] size      the size of the allocation
+     * @throws std::system_error if unlocking fails
+     */
+    void deallocateUnmanagedLocked(pointer addr, std::size_t size)
+    {
+        const std::size_t requested = size;
+        auto it = m_unmanagedAreas.find(static_cast<char*>(addr));
+        if (it == m_unmanagedAreas.end())
+            return;
+        size = it->second.size;
+        m_unmanagedAreas.erase(it);
+        retainOrReleaseUnmanagedArea(addr, size / m_pageSize);
+        updatePageCounts();
+        countDeallocation(0, requested, size);
+    }
+
+    /**
+     * Keeps a released unmanaged area for reuse or releases it - requires that the mutex is
+     * locked.
+     * @param[in] addr      the area's address
+     * @param[in] pages     the area's number of pages
+     */
+    void retainOrReleaseUnmanagedArea(pointer addr, std::size_t pages) noexcept
+    {
+        if (m_retainedUnmanagedPages + pages <= m_unmanagedRetentionLimit)
+        {
+            try
+            {
+                m_retainedUnmanagedAreas[pages].push_back(addr);
+                m_retainedUnmanagedPages += pages;
+                return;
+            }
+            catch (...)
+            {
+                // release it instead
+            }
+        }
+        deallocatePage(addr, pages * m_pageSize);
+    }
+
+    /// Releases retained unmanaged areas until at most @c pages pages are left - requires that
+    /// the mutex is locked
+    void trimRetainedUnmanagedAreas(std::size_t pages) noexcept
+    {
+        // release the largest areas first
+        while (m_retainedUnmanagedPages > pages)
+        {
+            auto bucket = std::prev(m_retainedUnmanagedAreas.end());
+            deallocatePage(bucket->second.back(), bucket->first * m_pageSize);
+            m_retainedUnmanagedPages -= bucket->first;
+            bucket->second.pop_back();
+            if (bucket->second.empty())
+                m_retainedUnmanagedAreas.erase(bucket);
+        }
+        updatePageCounts();
+    }
+
+    /**
+     * Allocates a contiguous range of n segments - requires that the mutex is locked.
+     * @param[in] n     the number of segments to reserver
+     * @return the allocate memory
+     * @throws std::bad_alloc if allocation failed
+     */
+    pointer allocateSegmentLocked(std::size_t n)
+    {
+        // prefer chunks of the allocation's size class, then unassigned ones (class 0, which also
+        // contains all completely free chunks)
+        const std::size_t sizeClass = m_sizeClasses ? getSizeClass(n) : 0;
+        ChunkManagementInfo* chunk = findFreeChunk(sizeClass, n);
+        if (!chunk && sizeClass != 0)
+            chunk = findFreeChunk(0, n);
+        if (!chunk)
+        {
+            // nothing found -> need to allocate a new page
+            chunk = &addManagedPage().chunks[0];
+        }
+
+        // found! -> mark as reserved
+        return reserveSegments(*chunk, findFreeRange(chunk->segments, n), n, sizeClass);
+    }
+
+    /**
+     * Deallocates memory of any size - requires that the mutex is locked.
+     * @param[in] addr      the address previously returned by allocate()
+     * @param[in] size      the size passed to allocate()
+     * @throws std::system_error if unlocking fails
+     */
+    void deallocateLocked(pointer addr, std::size_t size)
+    {
+        const std::size_t n = calcSegmentCount(size);
+        if (n <= segmentsPerChunk)
+        {
+            deallocateSegmentLocked(addr, n);
+            countDeallocation(n, size, n * segment_size);
+        }
+        else if (size <= m_pageSize)
+        {
+            const std::size_t k = calcChunkCount(size);
+            deallocateChunksLocked(addr, k);
+            countDeallocation(0, size, k * chunk_size);
+        }
+        else
+        {
+            deallocateUnmanagedLocked(addr, size);
+        }
+    }
+
+    /**
+     * Deallocates n segments - requires that the mutex is locked.
+     * @param[in] addr      the address previously returned by allocateSegmentLocked()
+     * @param[in] n         the number of segments to release
+     */
+    void deallocateSegmentLocked(pointer addr, std::size_t n)
+    {
+        // find the page in O(log(pages))
+        auto it = findManagedPage(addr);
+        if (it == m_managedPages.end())
+            return;
+        PageInfo& page = it->second;
+
+        // calculate the chunk, the index and the bit mask
+        const std::size_t offset = static_cast<std::size_t>(static_cast<char*>(addr) - it->first);
+        ChunkManagementInfo& chunk = page.chunks[offset / chunk_size];
+        const std::size_t index = (offset % chunk_size) / segment_size;
+        chunk.segments |= getBitmask(n) << index;
+        page.usedSegments -= n;
+        m_stats.usedSegments.fetch_sub(n, std::memory_order_relaxed);
+
+        // release the page if nothing is used anymore
+        if (page.usedSegments == 0)
+            releaseManagedPage(it);
+        else
+            updateFreeBin(chunk);
+    }
+
+    /**
+     * Allocates a contiguous range of k completely free chunks within a page - requires that the
+     * mutex is locked.
+     * @param[in] k     the number of chunks to reserve (at most the number of chunks per page)
+     * @param[in] step  the first chunk's index must be a multiple of this value
+     * @return the allocate memory
+     * @throws std::bad_alloc if allocation failed
+     */
+    pointer allocateChunksLocked(std::size_t k, std::size_t step = 1)
+    {
+        PageInfo* page = nullptr;
+        std::size_t first = m_chunksPerPage;
+        for (auto& entry : m_managedPages)
+        {
+            if (entry.second.numFreeChunks < k)
+                continue;
+            first = findFreeChunkRun(entry.second, k, step);
+            if (first != m_chunksPerPage)
+            {
+                page = &entry.second;
+                break;
+            }
+        }
+        if (!page)
+        {
+            // nothing found -> need to allocate a new page
+            page = &addManagedPage();
+            first = 0;
+        }
+
+        // mark all segments of all chunks as reserved
+        for (std::size_t i = first; i < first + k; ++i)
+        {
+            page->chunks[i].segments = 0;
+            updateFreeBin(page->chunks[i]);
+        }
+        page->chunks[first].chunkRun = k;
+        page->usedSegments += k * segmentsPerChunk;
+        m_stats.usedSegments.fetch_add(k * segmentsPerChunk, std::memory_order_relaxed);
+
+        return page->chunks[first].addr;
+    }
+
+    /**
+     * Deallocates memory - requires that the mutex is locked.
+     * @param[in] addr      the address previously returned by allocateChunksLocked()
+     * @param[in] k         the number of chunks to release
+     */
+    void deallocateChunksLocked(pointer addr, std::size_t k)
+    {
+        auto it = findManagedPage(addr);
+        if (it == m_managedPages.end())
+            return;
+        PageInfo& page = it->second;
+
+        const std::size_t first =
+          static_cast<std::size_t>(static_cast<char*>(addr) - it->first) / chunk_size;
+        page.chunks[first].chunkRun = 0;
+        for (std::size_t i = first; i < first + k; ++i)
+            page.chunks[i].segments = all64;
+        page.usedSegments -= k * segmentsPerChunk;
+        m_stats.usedSegments.fetch_sub(k * segmentsPerChunk, std::memory_order_relaxed);
+
+        // release the page if nothing is used anymore
+        if (page.usedSegments == 0)
+        {
+            releaseManagedPage(it);
+        }
+        else
+        {
+            for (std::size_t i = first; i < first + k; ++i)
+                updateFreeBin(page.chunks[i]);
+        }
+    }
+
+    struct PageInfo;
+
+    /// Information about a chunk that is managed
+    struct ChunkManagementInfo
+    {
+        /// points to the beginning of the chunk
         pointer addr;
-        /// points to the beginning of the page - if != addr, this chunk cannot be deallocated
-        /// itself
-        pointer pageAddr;
         /// status of all segments in this chunk
         uint64_t segments;
+        /// the page this chunk belongs to
+        PageInfo* page;
+        /// the bin this chunk is stored in (= largest range of free segments, 0 = none)
+        std::size_t bin;
+        /// the size class this chunk is dedicated to (0 = none)
+        std::size_t sizeClass;
+        /// number of chunks of an allocation larger than a chunk that starts here (0 = none)
+        std::size_t chunkRun;
+        /// previous chunk in the same bin
+        ChunkManagementInfo* prev;
+        /// next chunk in the same bin
+        ChunkManagementInfo* next;
+    };
+
+    /// Information about a managed page
+    struct PageInfo
+    {
+        /// number of segments in use (in all chunks of this page)
+        std::size_t usedSegments;
+        /// sequence number of the page's allocation
+        std::size_t serial;
+        /// management info of all chunks of this page
+        std::unique_ptr<ChunkManagementInfo[]> chunks;
+        /// bitmap of completely free chunks (chunk i is stored in bit i % 64 of word i / 64)
+        std::unique_ptr<uint64_t[]> freeChunks;
+        /// number of completely free chunks
+        std::size_t numFreeChunks;
+    };
+
+    /// managed pages, indexed by the page address
+    using PageMap = std::map<char*, PageInfo>;
+
+    /// Information about an area that isn't managed in segments
+    struct UnmanagedArea
+    {
+        /// the area's size (a multiple of the page size)
+        std::size_t size;
+        /// sequence number of the area's allocation
+        std::size_t serial;
+    };
+
+    /// unmanaged areas, indexed by their address
+    using UnmanagedMap = std::map<char*, UnmanagedArea>;
+
+    /// Chunks with free segments, indexed by their largest range of free segments (1...64)
+    struct FreeBins
+    {
+        /// the first chunk of each bin
+        std::array<ChunkManagementInfo*, segmentsPerChunk + 1> chunks;
+        /// bitmask of non-empty bins (bin i is stored in bit i - 1)
+        uint64_t nonEmpty;
+    };
+
+    /**
+     * Allocates a new page and adds it to the managed pages - requires that the mutex is locked.
+     * @return the page's management info (all segments are free)
+     * @throws std::bad_alloc if allocation failed
+     */
+    PageInfo& addManagedPage()
+    {
+        // allocate the management info upfront - if it throws, we don't have to clean up
+        std::unique_ptr<ChunkManagementInfo[]> chunks(new ChunkManagementInfo[m_chunksPerPage]);
+        std::unique_ptr<uint64_t[]> freeChunks(new uint64_t[(m_chunksPerPage + 63) / 64]());
+
+        // prefer spare pages
+        pointer addr = nullptr;
+        if (!m_sparePages.empty())
+        {
+            addr = m_sparePages.back();
+            m_sparePages.pop_back();
+        }
+        else
+        {
+            addr = allocatePage(m_pageSize, m_pageSize);
+        }
+
+        PageInfo* page = nullptr;
+        try
+        {
+            auto res = m_managedPages.emplace(static_cast<char*>(addr),
+                                              PageInfo{ 0, m_pageSerial++, std::move(chunks),
+                                                        std::move(freeChunks), 0 });
+            page = &res.first->second;
+        }
+        catch (...)
+        {
+            retainOrReleasePage(addr);
+            updatePageCounts();
+            throw;
+        }
+        updatePageCounts();
+
+        // add the chunks to the bin of completely free chunks (in reverse order so that the
+        // first chunk is used first)
+        for (std::size_t i = m_chunksPerPage; i-- > 0;)
+        {
+            ChunkManagementInfo& chunk = page->chunks[i];
+            chunk = ChunkManagementInfo{ static_cast<char*>(addr) + i * chunk_size,
+                                         all64,
+                                         page,
+                                         0,
+                                         0,
+                                         0,
+                                         nullptr,
+                                         nullptr };
+            updateFreeBin(chunk);
+        }
+        return *page;
+    }
+
+    /// Releases a managed page - requires that the mutex is locked
+    void releaseManagedPage(typename PageMap::iterator it)
+    {
+        for (std::size_t i = 0; i < m_chunksPerPage; ++i)
+            unlinkFromFreeBin(it->second.chunks[i]);
+        pointer addr = it->first;
+        m_managedPages.erase(it);
+        retainOrReleasePage(addr);
+        updatePageCounts();
+    }
+
+    /// Keeps a free page as spare page or releases it - requires that the mutex is locked
+    void retainOrReleasePage(pointer addr) noexcept
+    {
+        if (m_sparePages.size() < m_sparePagesHigh)
+        {
+            // note: the capacity is reserved upfront
+            m_sparePages.push_back(addr);
+        }
+        else
+        {
+            deallocatePage(addr, m_pageSize);
+            trimSparePages(m_sparePagesLow);
+        }
+    }
+
+    /// Releases spare pages until at most @c count pages are left - requires a locked mutex
+    void trimSparePages(std::size_t count) noexcept
+    {
+        while (m_sparePages.size() > count)
+        {
+            deallocatePage(m_sparePages.back(), m_pageSize);
+            m_sparePages.pop_back();
+        }
+        updatePageCounts();
+    }
+
+    /// Publishes the number of managed pages, spare pages and (retained) unmanaged areas - requires
+    /// that the mutex is locked
+    void updatePageCounts() noexcept
+    {
+        m_stats.managedPages.store(m_managedPages.size(), std::memory_order_relaxed);
+        m_stats.sparePages.store(m_sparePages.size(), std::memory_order_relaxed);
+        m_stats.unmanagedAreas.store(m_unmanagedAreas.size(), std::memory_order_relaxed);
+        m_stats.retainedUnmanagedPages.store(m_retainedUnmanagedPages, std::memory_order_relaxed);
+    }
+
+    /**
+     * Marks n segments of a chunk as used - requires that the mutex is locked.
+     * @param[in] chunk         the chunk
+     * @param[in] index         the index of the first segment
+     * @param[in] n             the number of segments
+     * @param[in] sizeClass     the size class of the allocation
+     * @return the address of the first segment
+     */
+    pointer reserveSegments(ChunkManagementInfo& chunk, std::size_t index, std::size_t n,
+                            std::size_t sizeClass) noexcept
+    {
+        if (chunk.segments == all64 && chunk.sizeClass != sizeClass)
+        {
+            // dedicate the free chunk to the size class
+            unlinkFromFreeBin(chunk);
+            chunk.sizeClass = sizeClass;
+        }
+
+        chunk.segments &= ~(getBitmask(n) << index);
+        chunk.page->usedSegments += n;
+        m_stats.usedSegments.fetch_add(n, std::memory_order_relaxed);
+        updateFreeBin(chunk);
+
+        return static_cast<char*>(chunk.addr) + index * segment_size;
+    }
+
+    /**
+     * Searches for a chunk with a large enough range of free segments - requires that the mutex
+     * is locked.
+     * @param[in] sizeClass     the size class to search
+     * @param[in] n             the number of segments required
+     * @return the chunk from the smallest matching bin or @c nullptr if there is none
+     */
+    ChunkManagementInfo* findFreeChunk(std::size_t sizeClass, std::size_t n) noexcept
+    {
+        // bin i is stored in bit i - 1
+        const FreeBins& bins = m_freeBins[sizeClass];
+        const uint64_t candidates = bins.nonEmpty & ~getBitmask(n - 1);
+        return candidates ? bins.chunks[bits::countTrailingZeros(candidates) + 1] : nullptr;
+    }
+
+    /**
+     * Searches for k contiguous, completely free chunks in a page - requires that the mutex is
+     * locked.
+     * @param[in] page  the page to search
+     * @param[in] k     the number of chunks required
+     * @param[in] step  the first chunk's index must be a multiple of this value
+     * @return the index of the first chunk or m_chunksPerPage if there is no such range
+     */
+    std::size_t findFreeChunkRun(const PageInfo& page, std::size_t k,
+                                 std::size_t step = 1) const noexcept
+    {
+        std::size_t start = 0;
+        std::size_t run = 0;
+        for (std::size_t i = 0; i < m_chunksPerPage; ++i)
+        {
+            const uint64_t word = page.freeChunks[i / 64];
+            if (word == 0 && i % 64 == 0)
+            {
+                // skip 64 used chunks at once
+                run = 0;
+                i += 63;
+            }
+            else if (word & (static_cast<uint64_t>(1) << (i % 64)))
+            {
+                if (run == 0 && i % step != 0)
+                    continue;
+                if (run++ == 0)
+                    start = i;
+                if (run == k)
+                    return start;
+            }
+            else
+            {
+                run = 0;
+            }
+        }
+        return m_chunksPerPage;
+    }
+
+    /// Moves a chunk to the bin matching its largest range of free segments (and its size class)
+    void updateFreeBin(ChunkManagementInfo& chunk) noexcept
+    {
+        const std::size_t bin = largestFreeRange(chunk.segments);
+
+        // keep track of completely free chunks for allocations larger than a chunk (compared to
+        // the page's bit, not the bin: the chunk may have been unlinked from its bin already)
+        PageInfo& page = *chunk.page;
+        const std::size_t index = static_cast<std::size_t>(&chunk - page.chunks.get());
+        const uint64_t mask = static_cast<uint64_t>(1) << (index % 64);
+        const bool isFree = (bin == segmentsPerChunk);
+        if (isFree != ((page.freeChunks[index / 64] & mask) != 0))
+        {
+            page.freeChunks[index / 64] ^= mask;
+            if (isFree)
+                ++page.numFreeChunks;
+            else
+                --page.numFreeChunks;
+        }
+
+        // completely free chunks aren't dedicated to a size class anymore
+        const std::size_t sizeClass = isFree ? 0 : chunk.sizeClass;
+        if (bin == chunk.bin && sizeClass == chunk.sizeClass)
+            return;
+
+        unlinkFromFreeBin(chunk);
+        chunk.sizeClass = sizeClass;
+        if (bin != 0)
+        {
+            FreeBins& bins = m_freeBins[sizeClass];
+            chunk.bin = bin;
+            chunk.next = bins.chunks[bin];
+            if (chunk.next)
+                chunk.next->prev = &chunk;
+            bins.chunks[bin] = &chunk;
+            bins.nonEmpty |= static_cast<uint64_t>(1) << (bin - 1);
+        }
+    }
+
+    /// Removes a chunk from its bin (if any)
+    void unlinkFromFreeBin(ChunkManagementInfo& chunk) noexcept
+    {
+        if (chunk.bin == 0)
+            return;
+
+        FreeBins& bins = m_freeBins[chunk.sizeClass];
+        if (chunk.prev)
+            chunk.prev->next = chunk.next;
+        else
+            bins.chunks[chunk.bin] = chunk.next;
+        if (chunk.next)
+            chunk.next->prev = chunk.prev;
+        if (bins.chunks[chunk.bin] == nullptr)
+            bins.nonEmpty &= ~(static_cast<uint64_t>(1) << (chunk.bin - 1));
+
+        chunk.bin = 0;
+        chunk.prev = nullptr;
+        chunk.next = nullptr;
+    }
+
+    /// @return the managed page containing @c addr or m_managedPages.end()
+    typename PageMap::iterator findManagedPage(pointer addr)
+    {
+        // find the first page *after* addr, the previous one must contain addr
+        char* p = static_cast<char*>(addr);
+        auto it = m_managedPages.upper_bound(p);
+        if (it == m_managedPages.begin())
+            return m_managedPages.end();
+        --it;
+        return (p < it->first + m_pageSize) ? it : m_managedPages.end();
+    }
+
+    /// Shared by an allocator and its thread caches, so that exiting threads never call an
+    /// allocator that is being destroyed
+    struct ThreadCacheControl
+    {
+        explicit ThreadCacheControl(BasicSensitivePageAllocator* alloc) : mutex(), owner(alloc) {}
+
+        /// serializes detaching thread caches and destroying the allocator
+        std::mutex mutex;
+        /// the allocator (nullptr once its destructor has started, protected by the mutex)
+        BasicSensitivePageAllocator* owner;
+    };
+
+    /// Per-thread cache of free segments
+    struct ThreadCache
+    {
+        ThreadCache(BasicSensitivePageAllocator* alloc, std::shared_ptr<ThreadCacheControl> ctrl)
+          : owner(alloc), control(std::move(ctrl)), bins(), allocations(), deallocations(),
+            bytesRequested(0)
+        {
+        }
+
+        /// the allocator the cached segments belong to (nullptr once it has been destroyed)
+        std::atomic<BasicSensitivePageAllocator*> owner;
+        /// keeps the allocator's control block alive until the thread has exited
+        std::shared_ptr<ThreadCacheControl> control;
+        /// addresses of cached allocations, indexed by segment count - 1
+        std::array<std::vector<pointer>, threadCacheMaxSegments> bins;
+
+        // statistics that haven't been added to the allocator's counters yet
+
+        /// number of allocations served, indexed by segment count - 1
+        std::array<uint64_t, threadCacheMaxSegments> allocations;
+        /// number of deallocations, indexed by segment count - 1
+        std::array<uint64_t, threadCacheMaxSegments> deallocations;
+        /// change of the requested bytes (modulo 2^64)
+        uint64_t bytesRequested;
+    };
+
+    /// All thread caches of a thread (one per allocator instance): returns the cached segments
+    /// when the thread exits
+    struct ThreadCacheList
+    {
+        ThreadCacheList() : caches() {}
+        ThreadCacheList(const ThreadCacheList&) = delete;
+        ThreadCacheList& operator=(const ThreadCacheList&) = delete;
+        ~ThreadCacheList()
+        {
+            threadCacheListDestroyed() = true;
+            for (auto& cache : caches)
+            {
+                std::lock_guard<std::mutex> lock(cache->control->mutex);
+                if (cache->control->owner)
+                    cache->control->owner->detachThreadCache(*cache);
+            }
+        }
+
+        std::vector<std::unique_ptr<ThreadCache>> caches;
+    };
+
+    /// @return @c true if the calling thread's cache list was already destroyed (thread exit)
+    static bool& threadCacheListDestroyed() noexcept
+    {
+        static thread_local bool destroyed = false;
+        return destroyed;
+    }
+
+    /// @return the calling thread's cache list or @c nullptr if it was already destroyed
+    static ThreadCacheList* threadCacheList()
+    {
+        // note: this may be called by other thread_local or static destructors
+        if (threadCacheListDestroyed())
+            return nullptr;
+        static thread_local ThreadCacheList list;
+        return &list;
+    }
+
+    /// @return the calling thread's cache for this allocator or @c nullptr if there is none
+    ThreadCache* findThreadCache()
+    {
+        ThreadCacheList* list = threadCacheList();
+        if (list)
+        {
+            for (auto& cache : list->caches)
+            {
+                if (cache->owner.load(std::memory_order_relaxed) == this)
+                    return cache.get();
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * Returns the calling thread's cache for this allocator and creates it on first use.
+     * @return the cache or @c nullptr if the thread is already exiting
+     * @throws std::bad_alloc if allocation failed
+     * @throws std::system_error if locking fails
+     */
+    ThreadCache* getThreadCache()
+    {
+        ThreadCache* cache = findThreadCache();
+        if (cache || !threadCacheList())
+            return cache;
+
+        auto& caches = threadCacheList()->caches;
+        // forget caches of allocators that have been destroyed in the meantime
+        caches.erase(std::remove_if(caches.begin(), caches.end(),
+                                    [](const std::unique_ptr<ThreadCache>& c) {
+                                        return c->owner.load() == nullptr;
+                                    }),
+                     caches.end());
+        caches.reserve(caches.size() + 1);
+
+        std::unique_ptr<ThreadCache> newCache(new ThreadCache(this, m_threadCacheControl));
+        {
+            auto lock = lockMutex();
+            m_threadCaches.push_back(newCache.get());
+        }
+        caches.push_back(std::move(newCache));
+        return caches.back().get();
+    }
+
+    /**
+     * Allocates n segments from the thread cache and refills it if it's empty.
+     * @param[in] cache     the calling thread's cache
+     * @param[in] n         the number of segments to reserve
+     * @param[in] size      the requested size
+     * @param[in] cacheSize the maximum number of cached allocations
+     * @return the allocate memory
+     * @throws std::bad_alloc if allocation failed
+     * @throws std::system_error if locking fails
+     */
+    pointer allocateCachedSegment(ThreadCache& cache, std::size_t n, std::size_t size,
+                                  std::size_t cacheSize)
+    {
+        auto& bin = cache.bins[n - 1];
+        if (bin.empty())
+        {
+            // refill a batch of allocations with a single lock
+            const std::size_t batchSize = std::max<std::size_t>(cacheSize / 2, 1);
+            bin.reserve(batchSize);
+
+            auto lock = lockMutex();
+            drainRemoteFrees();
+            addThreadCacheStatistics(cache);
+            for (std::size_t i = 0; i < batchSize; ++i)
+            {
+                try
+                {
+                    bin.push_back(allocateSegmentLocked(n));
+                }
+                catch (...)
+                {
+                    // partial success is fine
+                    if (bin.empty())
+                        throw;
+                    break;
+                }
+            }
+        }
+
+        pointer addr = bin.back();
+        bin.pop_back();
+        ++cache.allocations[n - 1];
+        cache.bytesRequested += size;
+        return addr;
+    }
+
+    /**
+     * Moves n segments into the thread cache. If the cache is full, half of it is drained.
+     * @param[in] cache     the calling thread's cache
+     * @param[in] addr      the address previously returned by allocateSegmentLocked()
+     * @param[in] n         the number of segments to release
+     * @param[in] size      the size passed to allocate()
+     * @param[in] cacheSize the maximum number of cached allocations
+     * @return @c false if the segments couldn't be cached
+     * @throws std::system_error if locking fails
+     */
+    bool deallocateCachedSegment(ThreadCache& cache, pointer addr, std::size_t n,
+                                 std::size_t size, std::size_t cacheSize)
+    {
+        auto& bin = cache.bins[n - 1];
+        if (bin.size() >= cacheSize)
+        {
+            // drain a batch of allocations with a single lock
+            const std::size_t keep = cacheSize / 2;
+
+            auto lock = lockMutex();
+            addThreadCacheStatistics(cache);
+            while (bin.size() > keep)
+            {
+                deallocateSegmentLocked(bin.back(), n);
+                bin.pop_back();
+            }
+        }
+
+        try
+        {
+            bin.push_back(addr);
+        }
+        catch (const std::bad_alloc&)
+        {
+            return false;
+        }
+        ++cache.deallocations[n - 1];
+        cache.bytesRequested -= size;
+        return true;
+    }
+
+    /// Returns all cached segments to the chunks - requires that the mutex is locked
+    void flushThreadCacheLocked(ThreadCache& cache)
+    {
+        addThreadCacheStatistics(cache);
+        for (std::size_t i = 0; i < cache.bins.size(); ++i)
+        {
+            for (pointer addr : cache.bins[i])
+                deallocateSegmentLocked(addr, i + 1);
+            cache.bins[i].clear();
+        }
+    }
+
+    /// Adds the statistics collected by a thread cache to the allocator's counters
+    void addThreadCacheStatistics(ThreadCache& cache) noexcept
+    {
+        uint64_t reserved = 0;
+        for (std::size_t i = 0; i < threadCacheMaxSegments; ++i)
+        {
+            add(m_stats.allocations[i + 1], cache.allocations[i]);
+            add(m_stats.deallocations[i + 1], cache.deallocations[i]);
+            reserved += (cache.allocations[i] - cache.deallocations[i]) * (i + 1) * segment_size;
+            cache.allocations[i] = 0;
+            cache.deallocations[i] = 0;
+        }
+        add(m_stats.bytesRequested, cache.bytesRequested);
+        add(m_stats.bytesReserved, reserved);
+        cache.bytesRequested = 0;
+    }
+
+    /// Called when a thread exits (with the control block's mutex locked): returns the cached
+    /// segments and forgets the cache
+    void detachThreadCache(ThreadCache& cache)
+    {
+        auto lock = lockMutex();
+        flushThreadCacheLocked(cache);
+        m_threadCaches.erase(std::remove(m_threadCaches.begin(), m_threadCaches.end(), &cache),
+                             m_threadCaches.end());
+        cache.owner.store(nullptr);
+    }
+
+    /**
+     * Allocates page(s), locks them into RAM and excludes them from core dumps.
+     * @param[in] pageSize      the page size
+     * @param[in] size          the required size (a multiple of the page size)
+     * @param[out] err          optional: receives locking errors instead of logging them
+     * @return the allocated memory
+     * @throws std::bad_alloc if allocation failed
+     */
+    pointer allocatePage(std::size_t pageSize, std::size_t size, std::error_code* err = nullptr)
+    {
+        if (size == m_pageSize && m_regionPages > 1)
+            return allocateRegionPage(err);
+
+        pointer addr = os::allocatePageAligned(pageSize, size);
+        if (!addr)
+            throw std::bad_alloc();
+        try
+        {
+            notifyMapped(addr, size);
+        }
+        catch (...)
+        {
+            notifyUnmapped(addr, size);
+            os::deallocatePageAligned(addr);
+            throw;
+        }
+        add(m_stats.pagesCreated, size / m_pageSize);
+        add(m_stats.systemCalls, 1);
+        add(m_stats.lockedBytes, size);
+        lockAndDisableDump(addr, size, err);
+        return addr;
+    }
+
+    /**
+     * Locks memory into RAM and excludes it from core dumps.
+     * @param[in] addr          the memory address
+     * @param[in] size          the size (a multiple of the page size)
+     * @param[out] err          optional: receives locking errors instead of logging them
+     */
+    void lockAndDisableDump(pointer addr, std::size_t size, std::error_code* err)
+    {
+        std::error_code ec;
+        if (m_pageSize % hugePageSize == 0)
+        {
+            // must happen before locking faults the pages in - best effort only
+            os::adviseHugePages(addr, size, &ec);
+            add(m_stats.systemCalls, 1);
+            ec.clear();
+        }
+        // errors are only logged if the caller doesn't want them
+        const detail::PageProtectionErrors errors = detail::protectPages(addr, size, !err);
+        add(m_stats.systemCalls, 2);
+        if (errors.lock)
+        {
+            add(m_stats.lockFailures, 1);
+            if (err)
+                *err = errors.lock;
+        }
+        if (errors.dump)
+        {
+            add(m_stats.dumpFailures, 1);
+            if (err)
+                *err = errors.dump;
+        }
+    }
+
+    void deallocatePage(pointer addr, std::size_t size) noexcept
+    {
+        if (size == m_pageSize && deallocateRegionPage(addr))
+            return;
+
+        unlockAndEnableDump(addr, size);
+        notifyUnmapped(addr, size);
+        os::deallocatePageAligned(addr);
+        add(m_stats.pagesReleased, size / m_pageSize);
+        add(m_stats.systemCalls, 1);
+        sub(m_stats.lockedBytes, size);
+    }
+
+    /// Reports memory obtained from the OS to the memory map callback (if any)
+    void notifyMapped(pointer addr, std::size_t size)
+    {
+        if (m_memoryMapCallback)
+            m_memoryMapCallback(this, AllocationInfo{ addr, size }, true);
+    }
+
+    /// Reports memory that is about to be returned to the OS to the memory map callback (if any)
+    void notifyUnmapped(pointer addr, std::size_t size) noexcept
+    {
+        if (m_memoryMapCallback)
+            m_memoryMapCallback(this, AllocationInfo{ addr, size }, false);
+    }
+
+    /**
+     * Unlocks memory and includes it in core dumps again.
+     * @param[in] addr          the memory address
+     * @param[in] size          the size (a multiple of the page size)
+     */
+    void unlockAndEnableDump(pointer addr, std::size_t size) noexcept
+    {
+        const detail::PageProtectionErrors errors = detail::unprotectPages(addr, size);
+        if (errors.lock)
+            add(m_stats.unlockFailures, 1);
+        if (errors.dump)
+            add(m_stats.dumpFailures, 1);
+        add(m_stats.systemCalls, 2);
+    }
+
+    /// A region of pages reserved from the OS at once
+    struct Region
+    {
+        /// the region's size in pages
+        std::size_t pages;
+        /// free pages in this region (the capacity is reserved for all pages)
+        std::vector<pointer> freePages;
+    };
+
+    /// regions, indexed by their address
+    using RegionMap = std::map<char*, Region>;
+
+    /**
+     * Takes a page from a region, reserving a new region if required - requires that the mutex
+     * is locked.
+     * @param[out] err          optional: receives locking errors instead of logging them
+     * @return the page
+     * @throws std::bad_alloc if allocation failed
+     */
+    pointer allocateRegionPage(std::error_code* err)
+    {
+        for (auto& region : m_regions)
+        {
+            if (!region.second.freePages.empty())
+            {
+                pointer addr = region.second.freePages.back();
+                region.second.freePages.pop_back();
+                return addr;
+            }
+        }
+
+        // reserve the management info first: if it throws, we don't have to clean up
+        Region region{ m_regionPages, std::vector<pointer>() };
+        region.freePages.reserve(region.pages);
+        const std::size_t size = region.pages * m_pageSize;
+
+        char* addr = static_cast<char*>(os::allocateRegion(size));
+        if (!addr)
+            throw std::bad_alloc();
+        typename RegionMap::iterator it;
+        try
+        {
+            notifyMapped(addr, size);
+            it = m_regions.emplace(addr, std::move(region)).first;
+        }
+        catch (...)
+        {
+            notifyUnmapped(addr, size);
+            os::deallocateRegion(addr, size);
+            throw;
+        }
+        add(m_stats.regions, 1);
+        add(m_stats.pagesCreated, it->second.pages);
+        add(m_stats.systemCalls, 1);
+        add(m_stats.lockedBytes, size);
+        lockAndDisableDump(addr, size, err);
+
+        // hand out the pages in ascending order (the first one right away)
+        for (std::size_t i = it->second.pages; i-- > 1;)
+            it->second.freePages.push_back(addr + i * m_pageSize);
+        return addr;
+    }
+
+    /**
+     * Returns a page to its region - requires that the mutex is locked.
+     * @param[in] addr      the page address
+     * @return @c false if the page doesn't belong to a region
+     */
+    bool deallocateRegionPage(pointer addr) noexcept
+    {
+        char* p = static_cast<char*>(addr);
+        auto it = m_regions.upper_bound(p);
+        if (it == m_regions.begin())
+            return false;
+        --it;
+        Region& region = it->second;
+        if (p >= it->first + region.pages * m_pageSize)
+            return false;
+
+        // note: the capacity is reserved upfront
+        region.freePages.push_back(addr);
+        if (region.freePages.size() == region.pages)
+            releaseFreeRegions(1);
+        return true;
+    }
+
+    /// Releases regions without used pages until at most @c count of them are left - requires
+    /// that the mutex is locked
+    void releaseFreeRegions(std::size_t count) noexcept
+    {
+        std::size_t numFree = 0;
+        for (auto it = m_regions.begin(); it != m_regions.end();)
+        {
+            if (it->second.freePages.size() == it->second.pages && ++numFree > count)
+            {
+                const std::size_t size = it->second.pages * m_pageSize;
+                notifyUnmapped(it->first, size);
+                os::deallocateRegion(it->first, size);
+                add(m_stats.pagesReleased, it->second.pages);
+                add(m_stats.systemCalls, 1);
+                sub(m_stats.lockedBytes, size);
+                sub(m_stats.regions, 1);
+                it = m_regions.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    /// @return @c true if the page belongs to a region
+    bool isRegionPage(pointer addr) const noexcept
+    {
+        char* p = static_cast<char*>(addr);
+        auto it = m_regions.upper_bound(p);
+        if (it == m_regions.begin())
+            return false;
+        --it;
+        return p < it->first + it->second.pages * m_pageSize;
+    }
+
+    /**
+     * Releases all pages, areas and regions, whether they are in use or not (used by the
+     * destructor). The pages that don't belong to regions are released in ascending order, so
+     * that adjacent pages are unlocked using a single system call. Regions are released as a
+     * whole.
+     */
+    void releaseAll() noexcept
+    {
+        std::vector<AllocationInfo> areas;
+        try
+        {
+            areas.reserve(m_managedPages.size() + m_sparePages.size() + m_unmanagedAreas.size() +
+                          m_retainedUnmanagedPages);
+            for (const auto& page : m_managedPages)
+            {
+                if (!isRegionPage(page.first))
+                    areas.emplace_back(page.first, m_pageSize);
+            }
+            for (pointer page : m_sparePages)
+            {
+                if (!isRegionPage(page))
+                    areas.emplace_back(page, m_pageSize);
+            }
+            for (const auto& bucket : m_retainedUnmanagedAreas)
+            {
+                for (pointer area : bucket.second)
+                    areas.emplace_back(area, bucket.first * m_pageSize);
+            }
+            for (const auto& area : m_unmanagedAreas)
+                areas.emplace_back(area.first, area.second.size);
+        }
+        catch (...)
+        {
+            // out of memory: fall back to releasing the pages one by one
+            for (const auto& page : m_managedPages)
+                deallocatePage(page.first, m_pageSize);
+            for (const auto& area : m_unmanagedAreas)
+                deallocatePage(area.first, area.second.size);
+            m_managedPages.clear();
+            m_unmanagedAreas.clear();
+            trimSparePages(0);
+            trimRetainedUnmanagedAreas(0);
+            releaseFreeRegions(0);
+            return;
+        }
+
+        std::sort(areas.begin(), areas.end(), [](const AllocationInfo& a, const AllocationInfo& b) {
+            return a.addr < b.addr;
+        });
+        for (std::size_t i = 0; i < areas.size();)
+        {
+            char* addr = static_cast<char*>(areas[i].addr);
+            std::size_t size = areas[i].size;
+            std::size_t end = i + 1;
+            while (end < areas.size() && areas[end].addr == addr + size)
+                size += areas[end++].size;
+
+            unlockAndEnableDump(addr, size);
+            add(m_stats.systemCalls, end - i);
+            for (; i < end; ++i)
+            {
+                notifyUnmapped(areas[i].addr, areas[i].size);
+                os::deallocatePageAligned(areas[i].addr);
+            }
+            add(m_stats.pagesReleased, size / m_pageSize);
+            sub(m_stats.lockedBytes, size);
+        }
+
+        for (const auto& region : m_regions)
+        {
+            const std::size_t size = region.second.pages * m_pageSize;
+            notifyUnmapped(region.first, size);
+            os::deallocateRegion(region.first, size);
+            add(m_stats.pagesReleased, region.second.pages);
+            add(m_stats.systemCalls, 1);
+            sub(m_stats.lockedBytes, size);
+        }
+        m_managedPages.clear();
+        m_sparePages.clear();
+        m_retainedUnmanagedAreas.clear();
+        m_retainedUnmanagedPages = 0;
+        m_unmanagedAreas.clear();
+        m_regions.clear();
+        m_stats.regions.store(0, std::memory_order_relaxed);
+        updatePageCounts();
+    }
+
+    /**
+     * Locks the mutex and measures the time spent waiting if it's already locked.
+     * @return the lock
+     * @throws std::system_error if locking fails
+     */
+    std::unique_lock<std::mutex> lockMutex()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex, std::try_to_lock);
+        if (!lock.owns_lock())
+        {
+            const auto start = std::chrono::steady_clock::now();
+            lock.lock();
+            const auto waited = std::chrono::steady_clock::now() - start;
+            add(m_stats.lockWaits, 1);
+            add(m_stats.lockWaitNanoseconds,
+                static_cast<uint64_t>(
+                  std::chrono::duration_cast<std::chrono::nanoseconds>(waited).count()));
+        }
+        return lock;
+    }
+
+    /// A deallocation by deallocateRemote(), stored in the released memory
+    struct RemoteFree
+    {
+        /// the next entry in the list
+        RemoteFree* next;
+        /// the size passed to deallocateRemote()
+        std::size_t size;
+    };
+    static_assert(sizeof(RemoteFree) <= segment_size, "remote frees must fit into a segment");
+
+    /// Performs all pending remote frees in a batch - requires that the mutex is locked
+    void drainRemoteFrees()
+    {
+        if (m_remoteFrees.load(std::memory_order_relaxed) == nullptr)
+            return;
+
+        RemoteFree* node = m_remoteFrees.exchange(nullptr, std::memory_order_acquire);
+        while (node)
+        {
+            RemoteFree* next = node->next;
+            const std::size_t size = node->size;
+            node->~RemoteFree();
+            deallocateLocked(node, size);
+            node = next;
+        }
+    }
+
+    /// Counts an allocation of n segments (0 = unmanaged area)
+    void countAllocation(std::size_t n, std::size_t requested, std::size_t reserved) noexcept
+    {
+        add(m_stats.allocations[n], 1);
+        add(m_stats.bytesRequested, requested);
+        add(m_stats.bytesReserved, reserved);
+    }
+
+    /// Counts a deallocation of n segments (0 = unmanaged area)
+    void countDeallocation(std::size_t n, std::size_t requested, std::size_t reserved) noexcept
+    {
+        add(m_stats.deallocations[n], 1);
+        sub(m_stats.bytesRequested, requested);
+        sub(m_stats.bytesReserved, reserved);
+    }
+
+    /// Counts a successful try_expand() as deallocation of the old and allocation of the new size
+    void countResize(std::size_t n, std::size_t oldSize, std::size_t newSize,
+                     std::size_t addedBytes) noexcept
+    {
+        add(m_stats.deallocations[calcSegmentCount(oldSize)], 1);
+        add(m_stats.allocations[n], 1);
+        add(m_stats.bytesRequested, newSize - oldSize);
+        add(m_stats.bytesReserved, addedBytes);
+    }
+
+    /// Statistics counters - updated with relaxed atomics and read by getStatistics()
+    struct Counters
+    {
+        std::array<std::atomic<uint64_t>, segmentsPerChunk + 1> allocations;
+        std::array<std::atomic<uint64_t>, segmentsPerChunk + 1> deallocations;
+        std::atomic<uint64_t> bytesRequested;
+        std::atomic<uint64_t> bytesReserved;
+        std::atomic<uint64_t> lockedBytes;
+        std::atomic<uint64_t> lockFailures;
+        std::atomic<uint64_t> unlockFailures;
+        std::atomic<uint64_t> dumpFailures;
+        std::atomic<uint64_t> pagesCreated;
+        std::atomic<uint64_t> pagesReleased;
+        std::atomic<uint64_t> systemCalls;
+        std::atomic<uint64_t> managedPages;
+        std::atomic<uint64_t> sparePages;
+        std::atomic<uint64_t> unmanagedAreas;
+        std::atomic<uint64_t> retainedUnmanagedPages;
+        std::atomic<uint64_t> regions;
+        std::atomic<uint64_t> usedSegments;
+        std::atomic<uint64_t> remoteFrees;
+        std::atomic<uint64_t> lockWaits;
+        std::atomic<uint64_t> lockWaitNanoseconds;
     };
 
+    static void add(std::atomic<uint64_t>& counter, uint64_t value) noexcept
+    {
+        counter.fetch_add(value, std::memory_order_relaxed);
+    }
+    static void sub(std::atomic<uint64_t>& counter, uint64_t value) noexcept
+    {
+        counter.fetch_sub(value, std::memory_order_relaxed);
+    }
+    static uint64_t load(const std::atomic<uint64_t>& counter) noexcept
+    {
+        return counter.load(std::memory_order_relaxed);
+    }
+
+private:
     /// mutex to ensure allocation across threads
     std::mutex m_mutex;
 
@@ -520,41 +2526,115 @@ private:
     std::size_t m_pageSize;
     /// number of chunks per page (usually 1)
     std::size_t m_chunksPerPage;
-
-    /// the areas of memory we allocated and manage in segments and chunks
-    std::vector<ChunkManagementInfo> m_managedChunks;
-    /// allocated memory that isn't managed in segments, because they are larger than a chunk
-    std::vector<AllocationInfo> m_unmanagedAreas;
+    /// the largest alignment of all pages: the OS's page size or less
+    std::size_t m_maxAlignment;
+
+    /// the pages we allocated and manage in segments and chunks, sorted by address
+    PageMap m_managedPages;
+    /// sequence number of the next page or unmanaged area allocation
+    std::size_t m_pageSerial;
+    /// chunks with free segments, per size class (0 = chunks without a size class)
+    std::array<FreeBins, numSizeClasses + 1> m_freeBins;
+    /// use size classes?
+    bool m_sizeClasses;
+    /// free pages that are kept for reuse
+    std::vector<pointer> m_sparePages;
+    /// number of spare pages to keep when releasing them
+    std::size_t m_sparePagesLow;
+    /// maximum number of spare pages
+    std::size_t m_sparePagesHigh;
+    /// regions of pages reserved at once, sorted by address
+    RegionMap m_regions;
+    /// number of pages per region (1 = pages are allocated one by one)
+    std::size_t m_regionPages;
+    /// allocated memory that isn't managed in segments, because it is larger than a page
+    UnmanagedMap m_unmanagedAreas;
+    /// released unmanaged areas that are kept for reuse, indexed by their number of pages
+    std::map<std::size_t, std::vector<pointer>> m_retainedUnmanagedAreas;
+    /// number of pages in all retained unmanaged areas
+    std::size_t m_retainedUnmanagedPages;
+    /// maximum number of pages in retained unmanaged areas
+    std::size_t m_unmanagedRetentionLimit;
+
+    /// maximum number of cached allocations per segment count and thread (0 = disabled)
+    std::atomic<std::size_t> m_threadCacheSize;
+    /// all thread caches that currently hold segments of this allocator
+    std::vector<ThreadCache*> m_threadCaches;
+    /// shared with the thread caches (outlives this instance if threads still have caches)
+    std::shared_ptr<ThreadCacheControl> m_threadCacheControl;
+
+    /// pending deallocations of deallocateRemote() (a lock-free stack)
+    std::atomic<RemoteFree*> m_remoteFrees;
+    /// use deallocateRemote() in deallocate() if the mutex is locked?
+    std::atomic<bool> m_deferContendedFrees;
+
+    /// statistics
+    Counters m_stats;
+
+    /// the trace buffer (created by the first call of enableTracing())
+    std::unique_ptr<AllocationTraceBuffer> m_traceBuffer;
+    /// the trace buffer while tracing is enabled, nullptr otherwise
+    std::atomic<AllocationTraceBuffer*> m_trace;
 
     /// This function is called by the destructor for every memory location that hasn't been
     /// deallocated yet. The default implementation prints using std::cerr.
     LeakCallbackFunction m_leakCallback;
+    /// called for memory obtained from and returned to the OS (see setMemoryMapCallback())
+    MemoryMapCallbackFunction m_memoryMapCallback;
 };
 
+// definitions of the static members (required for ODR-use in C++11)
+template <std::size_t SegmentSize>
+constexpr std::size_t BasicSensitivePageAllocator<SegmentSize>::segment_size;
+template <std::size_t SegmentSize>
+constexpr std::size_t BasicSensitivePageAllocator<SegmentSize>::segmentsPerChunk;
+template <std::size_t SegmentSize>
+constexpr std::size_t BasicSensitivePageAllocator<SegmentSize>::chunk_size;
+template <std::size_t SegmentSize>
+constexpr uint64_t BasicSensitivePageAllocator<SegmentSize>::all64;
+template <std::size_t SegmentSize>
+constexpr std::size_t BasicSensitivePageAllocator<SegmentSize>::threadCacheMaxSegments;
+template <std::size_t SegmentSize>
+constexpr std::size_t BasicSensitivePageAllocator<SegmentSize>::numSizeClasses;
+template <std::size_t SegmentSize>
+constexpr std::size_t BasicSensitivePageAllocator<SegmentSize>::hugePageSize;
+template <std::size_t SegmentSize>
+constexpr std::size_t BasicSensitivePageAllocator<SegmentSize>::defaultTraceCapacity;
+
+/// the page allocator with the default geometry: 64 byte segments in 4K chunks
+using SensitivePageAllocator = BasicSensitivePageAllocator<>;
+
 
 /**
  * This adapter template is intended to be used with STL templates or the string templates used
  * in the SPSL. Since the PageAllocator class is intended to be used as a singleton (but doesn't
  * has to be), using it directly in STL templates may waste a lot of memory.
+ *
+ * The page allocator type defaults to SensitivePageAllocator, but any class with the same
+ * allocate()/deallocate()/max_size()/getDefaultInstance() interface can be used (e.g.
+ * ConcurrentSensitivePageAllocator). The overloads of allocate()/deallocate() with an alignment
+ * are only required for types that are aligned to more than @c PageAllocator::segment_size.
  */
-template <typename T>
+template <typename T, typename PageAllocator = SensitivePageAllocator>
 class SensitiveSegmentAllocator
 {
 public:
     using value_type = T;
+    using page_allocator_type = PageAllocator;
     using propagate_on_container_move_assignment = std::true_type;
 
     // constructors
-    SensitiveSegmentAllocator() : m_alloc(&SensitivePageAllocator::getDefaultInstance()) {}
-    SensitiveSegmentAllocator(SensitivePageAllocator& alloc) noexcept : m_alloc(&alloc) {}
+    SensitiveSegmentAllocator() : m_alloc(&PageAllocator::getDefaultInstance()) {}
+    SensitiveSegmentAllocator(PageAllocator& alloc) noexcept : m_alloc(&alloc) {}
     SensitiveSegmentAllocator(const SensitiveSegmentAllocator& other) noexcept = default;
     SensitiveSegmentAllocator(SensitiveSegmentAllocator&& other) noexcept : m_alloc(nullptr)
     {
         this->swap(other);
     }
     template <class U>
-    explicit SensitiveSegmentAllocator(const SensitiveSegmentAllocator<U>& other) noexcept
-      : m_alloc(other.m_alloc)
+    explicit SensitiveSegmentAllocator(
+      const SensitiveSegmentAllocator<U, PageAllocator>& other) noexcept
+      : m_alloc(other.pageAllocator())
     {
     }
 
@@ -574,20 +2654,117 @@ public:
      */
     void swap(SensitiveSegmentAllocator& other) noexcept { std::swap(m_alloc, other.m_alloc); }
 
-    SensitivePageAllocator* pageAllocator() const noexcept { return m_alloc; }
+    PageAllocator* pageAllocator() const noexcept { return m_alloc; }
 
     // allocation / deallocation
 
-    T* allocate(std::size_t n) { return static_cast<T*>(m_alloc->allocate(n * sizeof(T))); }
+    // note: over-aligned types (e.g. SIMD vectors) are allocated with their alignment
+    T* allocate(std::size_t n) { return static_cast<T*>(_allocate(n * sizeof(T), over_aligned())); }
+
+    void deallocate(T* p, std::size_t n) { _deallocate(p, n * sizeof(T), over_aligned()); }
+
+    /**
+     * Tries to grow an allocation in place (see SensitivePageAllocator::try_expand()).
+     * @param[in] p         the memory address that was returned from allocate()
+     * @param[in] oldSize   the number of elements previously passed to allocate()
+     * @param[in] newSize   the required number of elements
+     * @return @c true if successful (the allocation has to be deallocated using @c newSize)
+     */
+    bool try_expand(T* p, std::size_t oldSize, std::size_t newSize)
+    {
+        return m_alloc->try_expand(p, oldSize * sizeof(T), newSize * sizeof(T));
+    }
+
+    /**
+     * Allocates multiple arrays with a single call of the page allocator (see
+     * SensitivePageAllocator::allocate_bulk()). Over-aligned types are allocated one by one.
+     * @param[in] counts    the number of elements of each allocation
+     * @param[out] out      receives the allocated arrays
+     * @param[in] n         the number of allocations
+     */
+    void allocate_bulk(const std::size_t* counts, T** out, std::size_t n)
+    {
+        _allocate_bulk(counts, out, n, over_aligned());
+    }
 
-    void deallocate(T* p, std::size_t n) { m_alloc->deallocate(p, n * sizeof(T)); }
+    /**
+     * Deallocates multiple arrays with a single call of the page allocator (see
+     * SensitivePageAllocator::deallocate_bulk()). Over-aligned types are deallocated one by one.
+     * @param[in] ptrs      the arrays returned from allocate() or allocate_bulk()
+     * @param[in] counts    the number of elements of each allocation
+     * @param[in] n         the number of allocations
+     */
+    void deallocate_bulk(T* const* ptrs, const std::size_t* counts, std::size_t n)
+    {
+        _deallocate_bulk(ptrs, counts, n, over_aligned());
+    }
 
     std::size_t max_size() const noexcept { return m_alloc->max_size() / sizeof(T); }
 
 private:
+    /// std::true_type if T needs more alignment than a segment provides (chosen at compile time,
+    /// so the page allocator only needs the aligned overloads for such types)
+    using over_aligned = std::integral_constant<bool, (alignof(T) > PageAllocator::segment_size)>;
+
+    void* _allocate(std::size_t size, std::false_type) { return m_alloc->allocate(size); }
+    void* _allocate(std::size_t size, std::true_type)
+    {
+        return m_alloc->allocate(size, alignof(T));
+    }
+
+    void _deallocate(T* p, std::size_t size, std::false_type) { m_alloc->deallocate(p, size); }
+    void _deallocate(T* p, std::size_t size, std::true_type)
+    {
+        m_alloc->deallocate(p, size, alignof(T));
+    }
+
+    void _allocate_bulk(const std::size_t* counts, T** out, std::size_t n, std::false_type)
+    {
+        std::vector<std::size_t> sizes(counts, counts + n);
+        for (auto& size : sizes)
+            size *= sizeof(T);
+        std::vector<void*> addrs(n);
+        m_alloc->allocate_bulk(sizes.data(), addrs.data(), n);
+        for (std::size_t i = 0; i < n; ++i)
+            out[i] = static_cast<T*>(addrs[i]);
+    }
+
+    // over-aligned types: the bulk functions of the page allocator don't support alignments
+    void _allocate_bulk(const std::size_t* counts, T** out, std::size_t n, std::true_type)
+    {
+        std::size_t i = 0;
+        try
+        {
+            for (; i < n; ++i)
+                out[i] = allocate(counts[i]);
+        }
+        catch (...)
+        {
+            while (i-- > 0)
+                deallocate(out[i], counts[i]);
+            throw;
+        }
+    }
+
+    void _deallocate_bulk(T* const* ptrs, const std::size_t* counts, std::size_t n,
+                          std::false_type)
+    {
+        std::vector<std::size_t> sizes(counts, counts + n);
+        for (auto& size : sizes)
+            size *= sizeof(T);
+        std::vector<void*> addrs(ptrs, ptrs + n);
+        m_alloc->deallocate_bulk(addrs.data(), sizes.data(), n);
+    }
+    void _deallocate_bulk(T* const* ptrs, const std::size_t* counts, std::size_t n,
+                          std::true_type)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+            deallocate(ptrs[i], counts[i]);
+    }
+
     /// non-owning pointer to the "real" allocator
     /// (nullptr is only possible in a moved-from state)
-    SensitivePageAllocator* m_alloc;
+    PageAllocator* m_alloc;
 };
 } // namespace spsl
 
@@ -0,0 +1,768 @@
+/**
+ * @file    Special Purpose Strings Library: pagealloc_concurrent.hpp
+ * @author  Daniel Evers
+ * @brief   Page allocator implementation without locks on the common path
+ * @license MIT
+ */
+
+#ifndef SPSL_PAGEALLOC_CONCURRENT_HPP_
+#define SPSL_PAGEALLOC_CONCURRENT_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include "spsl/pagealloc.hpp"
+
+
+namespace spsl
+{
+
+/**
+ * Variant of the SensitivePageAllocator that reserves and releases segments using atomic
+ * compare-and-swap operations on the chunks' bitmasks, so that the common path doesn't need
+ * a mutex at all. Only allocating and releasing pages (and "unmanaged" areas) is serialized.
+ *
+ * The geometry (pages, chunks and segments) is the same as for SensitivePageAllocator.
+ * Page management info is never released while the allocator exists, but recycled when
+ * a new page is allocated. The pages are indexed by a hash table that is read without locking,
+ * so that deallocate() finds the chunk in O(1).
+ *
+ * Finding free segments requires scanning the pages (newest first), without the bins that
+ * SensitivePageAllocator maintains. This variant is therefore a good fit for many threads and
+ * moderate numbers of pages.
+ */
+class ConcurrentSensitivePageAllocator
+{
+public:
+    static constexpr std::size_t segment_size = SensitivePageAllocator::segment_size;
+    static constexpr std::size_t chunk_size = SensitivePageAllocator::chunk_size;
+    static constexpr std::size_t segmentsPerChunk = SensitivePageAllocator::segmentsPerChunk;
+    static constexpr uint64_t all64 = SensitivePageAllocator::all64;
+
+    using pointer = void*;
+    using AllocationInfo = SensitivePageAllocator::AllocationInfo;
+
+    /// Callback function type (see SensitivePageAllocator)
+    using LeakCallbackFunction =
+      std::function<void(const ConcurrentSensitivePageAllocator*, const AllocationInfo&, bool)>;
+
+    /**
+     * Constructor: Initializes the allocator, but doesn't yet allocate anything.
+     * @param[in] pageSize      the OS's page size (or a multiple thereof)
+     * @throws std::runtime_error  if the pageSize isn't a multiple of the chunk size
+     */
+    explicit ConcurrentSensitivePageAllocator(std::size_t pageSize = os::getPageSize())
+      : m_mutex(), m_pageSize(pageSize), m_chunksPerPage(m_pageSize / chunk_size),
+        m_pages(nullptr), m_pageTable(nullptr), m_pageTables(), m_freePages(), m_numPages(0),
+        m_numPageTableEntries(0), m_numManagedPages(0), m_unmanagedAreas(),
+        m_leakCallback(logLeaks)
+    {
+        if (m_pageSize % chunk_size != 0 || m_pageSize == 0)
+            throw std::runtime_error("expected the page size to be a multiple of the chunk size");
+        if ((m_pageSize & (m_pageSize - 1)) != 0)
+            throw std::runtime_error("expected the page size to be a power of 2");
+
+        m_pageTables.emplace_back(new PageTable(16));
+        m_pageTable.store(m_pageTables.back().get());
+    }
+
+    /**
+     * Destructor: Checks if there are any segments or unmanaged areas that are still in use and
+     * calls the leak callback for every location. Releases all memory.
+     */
+    ~ConcurrentSensitivePageAllocator()
+    {
+        bool firstCbCall = true;
+
+        for (PageInfo* page = m_pages.load(); page; page = page->next)
+        {
+            char* addr = page->addr.load();
+            if (!addr)
+                continue;
+
+            for (std::size_t c = 0; c < m_chunksPerPage && m_leakCallback; ++c)
+            {
+                // report every contiguous range of used segments
+                uint64_t used = ~page->chunks[c].load();
+                while (used != 0)
+                {
+                    const std::size_t start = bits::countTrailingZeros(used);
+                    const std::size_t len = bits::countTrailingZeros(~(used >> start));
+                    used &= ~(SensitivePageAllocator::getBitmask(len) << start);
+
+                    m_leakCallback(this,
+                                   AllocationInfo{ addr + c * chunk_size + start * segment_size,
+                                                   len * segment_size },
+                                   firstCbCall);
+                    firstCbCall = false;
+                }
+            }
+            deallocatePage(addr, m_pageSize);
+        }
+
+        for (auto& area : m_unmanagedAreas)
+        {
+            if (m_leakCallback)
+            {
+                m_leakCallback(this, area, firstCbCall);
+                firstCbCall = false;
+            }
+            deallocatePage(area.addr, area.size);
+        }
+
+        // release the management info
+        PageInfo* page = m_pages.load();
+        while (page)
+        {
+            PageInfo* next = page->next;
+            delete page;
+            page = next;
+        }
+    }
+
+    // disable copy & move
+    ConcurrentSensitivePageAllocator(const ConcurrentSensitivePageAllocator&) = delete;
+    ConcurrentSensitivePageAllocator(ConcurrentSensitivePageAllocator&&) = delete;
+    ConcurrentSensitivePageAllocator& operator=(const ConcurrentSensitivePageAllocator&) = delete;
+    ConcurrentSensitivePageAllocator& operator=(ConcurrentSensitivePageAllocator&&) = delete;
+
+    /**
+     * Returns the "default instance", a.k.a. a static instance of the allocator.
+     * @return a reference to the instance
+     */
+    static ConcurrentSensitivePageAllocator& getDefaultInstance()
+    {
+        // "phoenix singleton"
+        static ConcurrentSensitivePageAllocator _instance;
+        return _instance;
+    }
+
+    /**
+     * Sets the leak callback function (see SensitivePageAllocator).
+     * Note: This method is intentionally *not* thread-safe.
+     * @param[in] fun       the function to call
+     */
+    void setLeakCallback(LeakCallbackFunction fun) { m_leakCallback = std::move(fun); }
+
+    /**
+     * Default leak callback: logs to std::cerr
+     * @param[in] instance      the allocator instance
+     * @param[in] leak          information about the area that hasn't been deallocated
+     * @param[in] first         set to @c true for the first call of this function
+     */
+    static void logLeaks(const ConcurrentSensitivePageAllocator* instance,
+                         const AllocationInfo& leak, bool first)
+    {
+        if (first)
+            std::cerr << "!!! Leaks detected in ConcurrentPageAllocator("
+                      << reinterpret_cast<const void*>(instance) << "):\n";
+        std::cerr << "!!!   " << leak.size << " bytes @ address " << leak.addr << '\n';
+    }
+
+    std::size_t max_size() const noexcept { return static_cast<std::size_t>(-1); }
+
+    inline std::size_t getPageSize() const { return m_pageSize; }
+    inline std::size_t getChunksPerPage() const { return m_chunksPerPage; }
+
+    // Some informal stuff...
+
+    std::size_t getNumberOfManagedAllocatedPages() const noexcept
+    {
+        return m_numManagedPages.load(std::memory_order_relaxed);
+    }
+
+    std::size_t getNumberOfUnmanagedAreas()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_unmanagedAreas.size();
+    }
+
+
+    /**
+     * Allocates a range of memory.
+     * @param[in] size      the minimum size of the allocation
+     * @return memory address
+     * @throws std::bad_alloc if allocation failed
+     * @throws std::system_error if locking fails
+     */
+    pointer allocate(std::size_t size)
+    {
+        std::size_t n = SensitivePageAllocator::calcSegmentCount(size);
+        if (n <= segmentsPerChunk)
+        {
+            pointer addr = tryAllocateSegment(n);
+            return addr ? addr : allocateSegmentFromNewPage(n);
+        }
+        else
+        {
+            return allocateUnmanaged(size);
+        }
+    }
+
+    /**
+     * Deallocates a range of memory.
+     * @param[in] addr      the memory address that was returned from allocate()
+     * @param[in] size      the parameter previously passed to allocate()
+     * @throws std::system_error if unlocking fails
+     */
+    void deallocate(pointer addr, std::size_t size)
+    {
+        std::size_t n = SensitivePageAllocator::calcSegmentCount(size);
+        if (n <= segmentsPerChunk)
+        {
+            deallocateSegment(addr, n);
+        }
+        else
+        {
+            deallocateUnmanaged(addr, size);
+        }
+    }
+
+    /**
+     * Allocates a range of memory with a given alignment (see SensitivePageAllocator). Since
+     * this allocator doesn't search for aligned segments, allocations with alignments larger than
+     * the segment size use a whole chunk or an unmanaged area.
+     * @param[in] size          the minimum size of the allocation
+     * @param[in] alignment     the required alignment (a power of 2, at most getMaxAlignment())
+     * @return memory address
+     * @throws std::invalid_argument if the alignment isn't a power of 2
+     * @throws std::bad_alloc if allocation failed or the alignment is too large
+     * @throws std::system_error if locking fails
+     */
+    pointer allocate(std::size_t size, std::size_t alignment)
+    {
+        return allocate(calcAlignedSize(size, alignment));
+    }
+
+    /**
+     * Deallocates a range of memory that was allocated with an alignment.
+     * @param[in] addr          the memory address that was returned from allocate()
+     * @param[in] size          the size previously passed to allocate()
+     * @param[in] alignment     the alignment previously passed to allocate()
+     * @throws std::system_error if unlocking fails
+     */
+    void deallocate(pointer addr, std::size_t size, std::size_t alignment)
+    {
+        deallocate(addr, calcAlignedSize(size, alignment));
+    }
+
+    /// @return the largest alignment supported by allocate(std::size_t, std::size_t)
+    std::size_t getMaxAlignment() const noexcept
+    {
+        return std::min(os::getPageSize(), m_pageSize & (~m_pageSize + 1));
+    }
+
+    /**
+     * Allocates multiple ranges of memory (see SensitivePageAllocator::allocate_bulk()). There is
+     * no lock to share, so this simply allocates one after the other. Either all allocations
+     * succeed or none.
+     * @param[in] sizes     the minimum sizes of the allocations
+     * @param[out] out      receives the memory addresses
+     * @param[in] count     the number of allocations
+     * @throws std::bad_alloc if allocation failed
+     * @throws std::system_error if locking fails
+     */
+    void allocate_bulk(const std::size_t* sizes, pointer* out, std::size_t count)
+    {
+        std::size_t i = 0;
+        try
+        {
+            for (; i < count; ++i)
+                out[i] = allocate(sizes[i]);
+        }
+        catch (...)
+        {
+            while (i-- > 0)
+                deallocate(out[i], sizes[i]);
+            throw;
+        }
+    }
+
+    /**
+     * Deallocates multiple ranges of memory (see SensitivePageAllocator::deallocate_bulk()).
+     * @param[in] addrs     the memory addresses that were returned from allocate()
+     * @param[in] sizes     the parameters previously passed to allocate()
+     * @param[in] count     the number of allocations
+     * @throws std::system_error if unlocking fails
+     */
+    void deallocate_bulk(const pointer* addrs, const std::size_t* sizes, std::size_t count)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+            deallocate(addrs[i], sizes[i]);
+    }
+
+    /**
+     * Tries to grow an allocation in place by claiming the free segments that directly follow it
+     * in the same chunk (without locking). If this succeeds, the allocation must be deallocated
+     * using the new size.
+     * @param[in] addr      the memory address that was returned from allocate()
+     * @param[in] oldSize   the parameter previously passed to allocate()
+     * @param[in] newSize   the required size
+     * @return @c true if the allocation has (at least) the new size now
+     */
+    bool try_expand(pointer addr, std::size_t oldSize, std::size_t newSize)
+    {
+        const std::size_t oldCount = SensitivePageAllocator::calcSegmentCount(oldSize);
+        const std::size_t newCount = SensitivePageAllocator::calcSegmentCount(newSize);
+        if (oldCount > segmentsPerChunk || newCount > segmentsPerChunk || newCount < oldCount)
+            return false;
+        if (newCount == oldCount)
+            return true;
+
+        PageInfo* page = findPage(addr);
+        if (!page)
+            return false;
+
+        const std::size_t offset = static_cast<std::size_t>(
+          static_cast<char*>(addr) - page->addr.load(std::memory_order_relaxed));
+        const std::size_t index = (offset % chunk_size) / segment_size;
+        if (index + newCount > segmentsPerChunk)
+            return false;
+
+        std::atomic<uint64_t>& chunk = page->chunks[offset / chunk_size];
+        const uint64_t mask = SensitivePageAllocator::getBitmask(newCount - oldCount)
+                              << (index + oldCount);
+        uint64_t segments = chunk.load(std::memory_order_relaxed);
+        while ((segments & mask) == mask)
+        {
+            if (chunk.compare_exchange_weak(segments, segments & ~mask, std::memory_order_acquire,
+                                            std::memory_order_relaxed))
+                return true;
+        }
+        return false;
+    }
+
+private:
+    /**
+     * Calculates the size to allocate for an aligned allocation: Up to the segment size, all
+     * allocations are aligned. A whole chunk starts at the beginning of a chunk, and unmanaged
+     * areas at the beginning of a page.
+     * @param[in] size          the requested size
+     * @param[in] alignment     the requested alignment
+     * @return the size to allocate
+     * @throws std::invalid_argument if the alignment isn't a power of 2
+     * @throws std::bad_alloc if the alignment is too large
+     */
+    std::size_t calcAlignedSize(std::size_t size, std::size_t alignment) const
+    {
+        if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+            throw std::invalid_argument("the alignment must be a power of 2");
+        if (alignment <= segment_size)
+            return size;
+        if (alignment > getMaxAlignment())
+            throw std::bad_alloc();
+        // (note: a copy avoids odr-using the static member in C++11)
+        const std::size_t chunk = chunk_size;
+        return std::max(size, alignment <= chunk ? chunk : chunk + 1);
+    }
+
+    /// Management info of a page (never released while the allocator exists)
+    struct PageInfo
+    {
+        explicit PageInfo(std::size_t chunksPerPage)
+          : addr(nullptr), next(nullptr), chunks(new std::atomic<uint64_t>[chunksPerPage])
+        {
+            // no pages -> nothing is free
+            for (std::size_t i = 0; i < chunksPerPage; ++i)
+                chunks[i].store(0, std::memory_order_relaxed);
+        }
+
+        /// address of the page (nullptr if not in use)
+        std::atomic<char*> addr;
+        /// the next page in the list (immutable once published)
+        PageInfo* next;
+        /// status of all segments in each chunk (1 = free, 0 = reserved)
+        std::unique_ptr<std::atomic<uint64_t>[]> chunks;
+    };
+
+    /// Hash table entry: maps the address of a page to its management info
+    struct PageTableEntry
+    {
+        std::atomic<char*> key;
+        std::atomic<PageInfo*> page;
+    };
+
+    /// Open addressing hash table (with linear probing) that can be read without locking
+    struct PageTable
+    {
+        explicit PageTable(std::size_t cap) : capacity(cap), entries(new PageTableEntry[cap])
+        {
+            for (std::size_t i = 0; i < capacity; ++i)
+            {
+                entries[i].key.store(nullptr, std::memory_order_relaxed);
+                entries[i].page.store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        /// number of entries (a power of 2)
+        std::size_t capacity;
+        std::unique_ptr<PageTableEntry[]> entries;
+    };
+
+    /// marks deleted entries in the hash table
+    static char* tombstone() noexcept
+    {
+        static char marker;
+        return &marker;
+    }
+
+    /// @return the hash table index to start searching for a page
+    std::size_t hashIndex(const char* addr, std::size_t capacity) const noexcept
+    {
+        const uint64_t pageNumber = reinterpret_cast<std::uintptr_t>(addr) / m_pageSize;
+        // Fibonacci hashing
+        return static_cast<std::size_t>((pageNumber * 0x9e3779b97f4a7c15) >> 32) & (capacity - 1);
+    }
+
+    /// @return the management info of the page that contains @c addr (or nullptr)
+    PageInfo* findPage(pointer addr) const noexcept
+    {
+        char* key = reinterpret_cast<char*>(reinterpret_cast<std::uintptr_t>(addr) &
+                                            ~static_cast<std::uintptr_t>(m_pageSize - 1));
+        const PageTable* table = m_pageTable.load(std::memory_order_acquire);
+        const std::size_t mask = table->capacity - 1;
+        for (std::size_t i = hashIndex(key, table->capacity), probes = 0;
+             probes < table->capacity; i = (i + 1) & mask, ++probes)
+        {
+            const char* entryKey = table->entries[i].key.load(std::memory_order_acquire);
+            if (entryKey == key)
+                return table->entries[i].page.load(std::memory_order_relaxed);
+            if (entryKey == nullptr)
+                break;
+        }
+        return nullptr;
+    }
+
+    /// Adds a page to the hash table - requires that the mutex is locked
+    void insertPage(char* key, PageInfo* page)
+    {
+        PageTable* table = m_pageTable.load(std::memory_order_relaxed);
+        if (2 * (m_numPageTableEntries + 1) > table->capacity)
+        {
+            // Grow and get rid of the tombstones - but keep the old table around, readers might
+            // still use it (which is fine because it contains all their pages). Since the size
+            // is doubled every time, this wastes less memory than the current table.
+            std::unique_ptr<PageTable> newTable(new PageTable(2 * table->capacity));
+            m_pageTables.reserve(m_pageTables.size() + 1);
+
+            std::size_t count = 0;
+            for (std::size_t i = 0; i < table->capacity; ++i)
+            {
+                char* k = table->entries[i].key.load(std::memory_order_relaxed);
+                if (k != nullptr && k != tombstone())
+                {
+                    insertEntry(*newTable, k, table->entries[i].page.load());
+                    ++count;
+                }
+            }
+            table = newTable.get();
+            m_pageTables.push_back(std::move(newTable));
+            m_pageTable.store(table, std::memory_order_release);
+            m_numPageTableEntries = count;
+        }
+
+        if (insertEntry(*table, key, page))
+            ++m_numPageTableEntries;
+    }
+
+    /**
+     * Inserts a hash table entry, reusing tombstones.
+     * @return @c true if a previously empty entry was used
+     */
+    bool insertEntry(PageTable& table, char* key, PageInfo* page) noexcept
+    {
+        const std::size_t mask = table.capacity - 1;
+        for (std::size_t i = hashIndex(key, table.capacity);; i = (i + 1) & mask)
+        {
+            char* entryKey = table.entries[i].key.load(std::memory_order_relaxed);
+            if (entryKey == nullptr || entryKey == tombstone())
+            {
+                table.entries[i].page.store(page, std::memory_order_relaxed);
+                table.entries[i].key.store(key, std::memory_order_release);
+                return entryKey == nullptr;
+            }
+        }
+    }
+
+    /// Removes a page from the hash table - requires that the mutex is locked
+    void removePage(char* key) noexcept
+    {
+        PageTable* table = m_pageTable.load(std::memory_order_relaxed);
+        const std::size_t mask = table->capacity - 1;
+        for (std::size_t i = hashIndex(key, table->capacity);; i = (i + 1) & mask)
+        {
+            char* entryKey = table->entries[i].key.load(std::memory_order_relaxed);
+            if (entryKey == nullptr)
+                return;
+            if (entryKey != key)
+                continue;
+
+            table->entries[i].key.store(tombstone(), std::memory_order_release);
+
+            // Tombstones at the end of a cluster aren't needed by any search. Clearing them
+            // keeps the number of tombstones low when pages are allocated and released.
+            while (table->entries[i].key.load(std::memory_order_relaxed) == tombstone() &&
+                   table->entries[(i + 1) & mask].key.load(std::memory_order_relaxed) == nullptr)
+            {
+                table->entries[i].key.store(nullptr, std::memory_order_release);
+                --m_numPageTableEntries;
+                i = (i - 1) & mask;
+            }
+            return;
+        }
+    }
+
+    /**
+     * Tries to reserve n segments in one of the existing pages, without locking.
+     * @param[in] n     the number of segments to reserve
+     * @return the allocated memory or @c nullptr if there is no free range
+     */
+    pointer tryAllocateSegment(std::size_t n) noexcept
+    {
+        const uint64_t bitmask = SensitivePageAllocator::getBitmask(n);
+        for (PageInfo* page = m_pages.load(std::memory_order_acquire); page; page = page->next)
+        {
+            for (std::size_t c = 0; c < m_chunksPerPage; ++c)
+            {
+                std::atomic<uint64_t>& chunk = page->chunks[c];
+                uint64_t segments = chunk.load(std::memory_order_relaxed);
+                std::size_t index;
+                while ((index = SensitivePageAllocator::findFreeRange(segments, n)) <
+                       segmentsPerChunk)
+                {
+                    if (chunk.compare_exchange_weak(segments, segments & ~(bitmask << index),
+                                                    std::memory_order_acquire,
+                                                    std::memory_order_relaxed))
+                    {
+                        // note: the page's address must be read *after* reserving the segments
+                        // (the page might have been replaced in the meantime)
+                        char* addr = page->addr.load(std::memory_order_relaxed);
+                        return addr + c * chunk_size + index * segment_size;
+                    }
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * Allocates a new page and reserves n segments in it.
+     * @param[in] n     the number of segments to reserve
+     * @return the allocated memory
+     * @throws std::bad_alloc if allocation failed
+     * @throws std::system_error if locking fails
+     */
+    pointer allocateSegmentFromNewPage(std::size_t n)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        // another thread might have added a page while we were waiting
+        pointer addr = tryAllocateSegment(n);
+        if (addr)
+            return addr;
+
+        // reuse the management info of a released page (if any) - but reserve all memory for the
+        // management info upfront, so that we don't have to clean up
+        PageInfo* page = nullptr;
+        std::unique_ptr<PageInfo> newPage;
+        if (m_freePages.empty())
+        {
+            newPage.reset(new PageInfo(m_chunksPerPage));
+            m_freePages.reserve(m_numPages + 1);
+            page = newPage.get();
+        }
+        else
+        {
+            page = m_freePages.back();
+        }
+
+        char* pageAddr = static_cast<char*>(allocatePage(m_pageSize, m_pageSize));
+        try
+        {
+            insertPage(pageAddr, page);
+        }
+        catch (...)
+        {
+            deallocatePage(pageAddr, m_pageSize);
+            throw;
+        }
+
+        if (newPage)
+        {
+            // publish the page
+            page->next = m_pages.load(std::memory_order_relaxed);
+            m_pages.store(newPage.release(), std::memory_order_release);
+            ++m_numPages;
+        }
+        else
+        {
+            m_freePages.pop_back();
+        }
+
+        // make the page available: the first segments are ours
+        page->addr.store(pageAddr, std::memory_order_relaxed);
+        for (std::size_t c = m_chunksPerPage; c-- > 1;)
+            page->chunks[c].store(all64, std::memory_order_release);
+        page->chunks[0].store(~SensitivePageAllocator::getBitmask(n), std::memory_order_release);
+        m_numManagedPages.fetch_add(1, std::memory_order_relaxed);
+
+        return pageAddr;
+    }
+
+    /**
+     * Releases n segments without locking. If this frees a complete page, it is released.
+     * @param[in] addr      the address previously returned by allocateSegment()
+     * @param[in] n         the number of segments to release
+     * @throws std::system_error if locking fails
+     */
+    void deallocateSegment(pointer addr, std::size_t n)
+    {
+        PageInfo* page = findPage(addr);
+        if (!page)
+            return;
+
+        const std::size_t offset = static_cast<std::size_t>(
+          static_cast<char*>(addr) - page->addr.load(std::memory_order_relaxed));
+        const std::size_t index = (offset % chunk_size) / segment_size;
+        std::atomic<uint64_t>& chunk = page->chunks[offset / chunk_size];
+        const uint64_t mask = SensitivePageAllocator::getBitmask(n) << index;
+        if ((chunk.fetch_or(mask, std::memory_order_release) | mask) == all64)
+            tryReleasePage(page);
+    }
+
+    /**
+     * Releases a page if all segments are free.
+     * @param[in] page      the page to release
+     * @throws std::system_error if locking fails
+     */
+    void tryReleasePage(PageInfo* page)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        char* pageAddr = page->addr.load(std::memory_order_relaxed);
+        if (!pageAddr)
+            return;
+
+        // reserve all segments: this fails if any segment is in use (or was just reserved)
+        for (std::size_t c = 0; c < m_chunksPerPage; ++c)
+        {
+            uint64_t expected = all64;
+            if (!page->chunks[c].compare_exchange_strong(expected, 0, std::memory_order_acquire,
+                                                         std::memory_order_relaxed))
+            {
+                // undo: nobody can use these chunks in the meantime
+                while (c-- > 0)
+                    page->chunks[c].store(all64, std::memory_order_release);
+                return;
+            }
+        }
+
+        // the page is ours now
+        removePage(pageAddr);
+        page->addr.store(nullptr, std::memory_order_relaxed);
+        // (note: the capacity is reserved upfront)
+        m_freePages.push_back(page);
+        m_numManagedPages.fetch_sub(1, std::memory_order_relaxed);
+        deallocatePage(pageAddr, m_pageSize);
+    }
+
+    /**
+     * Allocates a range of memory that isn't managed in segments, but provided to the caller
+     * completely.
+     * @param[in] size      the required size
+     * @return the allocate memory
+     * @throws std::bad_alloc if allocation failed
+     * @throws std::system_error if locking fails
+     */
+    pointer allocateUnmanaged(std::size_t size)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        size = roundToPageSize(size);
+
+        // reserve memory for the management info upfront - if it throws, we don't have to clean up
+        m_unmanagedAreas.reserve(m_unmanagedAreas.size() + 1);
+
+        pointer addr = allocatePage(m_pageSize, size);
+        m_unmanagedAreas.emplace_back(addr, size);
+        return addr;
+    }
+
+    /**
+     * Deallocates memory.
+     * @param[in] addr      the address previously returned by allocateUnmanaged()
+     * @param[in] size      the size of the allocation
+     * @throws std::system_error if unlocking fails
+     */
+    void deallocateUnmanaged(pointer addr, std::size_t size)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        size = roundToPageSize(size);
+        // forget the area first: the address must not be used after releasing it
+        m_unmanagedAreas.erase(
+          std::remove_if(m_unmanagedAreas.begin(), m_unmanagedAreas.end(),
+                         [=](const AllocationInfo& a) { return a.addr == addr; }),
+          m_unmanagedAreas.end());
+        deallocatePage(addr, size);
+    }
+
+    inline std::size_t roundToPageSize(std::size_t n) const
+    {
+        return (((n - 1) / m_pageSize) + 1) * m_pageSize;
+    }
+
+    static pointer allocatePage(std::size_t pageSize, std::size_t size)
+    {
+        pointer addr = os::allocatePageAligned(pageSize, size);
+        if (!addr)
+            throw std::bad_alloc();
+        detail::protectPages(addr, size);
+        return addr;
+    }
+
+    static void deallocatePage(pointer addr, std::size_t size) noexcept
+    {
+        detail::unprotectPages(addr, size);
+        os::deallocatePageAligned(addr);
+    }
+
+private:
+    /// mutex to serialize page allocation and release
+    std::mutex m_mutex;
+
+    /// the system's page size - usually 4K
+    std::size_t m_pageSize;
+    /// number of chunks per page (usually 1)
+    std::size_t m_chunksPerPage;
+
+    /// list of all page management info (newest first)
+    std::atomic<PageInfo*> m_pages;
+    /// the current page hash table
+    std::atomic<PageTable*> m_pageTable;
+    /// all hash tables ever created (the old ones may still be in use by readers)
+    std::vector<std::unique_ptr<PageTable>> m_pageTables;
+    /// page management info that is currently unused
+    std::vector<PageInfo*> m_freePages;
+    /// number of page management infos
+    std::size_t m_numPages;
+    /// number of used entries in the current hash table (including tombstones)
+    std::size_t m_numPageTableEntries;
+    /// number of pages in use
+    std::atomic<std::size_t> m_numManagedPages;
+
+    /// allocated memory that isn't managed in segments, because they are larger than a chunk
+    std::vector<AllocationInfo> m_unmanagedAreas;
+
+    /// This function is called by the destructor for every memory location that hasn't been
+    /// deallocated yet. The default implementation prints using std::cerr.
+    LeakCallbackFunction m_leakCallback;
+};
+} // namespace spsl
+
+
+#endif /* SPSL_PAGEALLOC_CONCURRENT_HPP_ */
@@ -0,0 +1,421 @@
+/**
+ * @file    Special Purpose Strings Library: pagealloc_sharded.hpp
+ * @author  Daniel Evers
+ * @brief   Page allocator front end that distributes allocations over multiple instances
+ * @license MIT
+ */
+
+#ifndef SPSL_PAGEALLOC_SHARDED_HPP_
+#define SPSL_PAGEALLOC_SHARDED_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "spsl/pagealloc.hpp"
+
+
+namespace spsl
+{
+
+/**
+ * Front end for multiple SensitivePageAllocator instances ("shards"). Allocations are served by
+ * the shard of the CPU or NUMA node the calling thread is running on, so that threads running on
+ * different CPUs don't contend for the same mutex.
+ * Pages are locked, and thereby touched first, by the allocating thread. With the usual
+ * "first touch" policy of the OS, a shard per NUMA node thus keeps its pages on that node.
+ *
+ * Deallocations are routed back to the shard that owns the memory, which is looked up without
+ * any locking: The shards report the memory they obtain from the OS (see
+ * SensitivePageAllocator::setMemoryMapCallback()) to a radix tree that maps every 4K of the
+ * address space to its shard. Memory that is released on the CPU (or node) it was allocated on
+ * is the cheapest case. Memory of other shards is handed back using
+ * SensitivePageAllocator::deallocateRemote(), so that the actual release is done by the owning
+ * shard's next allocation: Releasing memory of another shard never takes that shard's mutex.
+ *
+ * Each shard can be configured individually (spare pages, thread caches, ...) using getShard().
+ * Like the other page allocators, it can be used with SensitiveSegmentAllocator.
+ */
+class ShardedSensitivePageAllocator
+{
+public:
+    using Shard = SensitivePageAllocator;
+
+    static constexpr std::size_t segment_size = Shard::segment_size;
+    static constexpr std::size_t chunk_size = Shard::chunk_size;
+    static constexpr std::size_t segmentsPerChunk = Shard::segmentsPerChunk;
+
+    using pointer = void*;
+    using AllocationInfo = Shard::AllocationInfo;
+
+    /// Callback function type (see SensitivePageAllocator - called with the shard)
+    using LeakCallbackFunction = Shard::LeakCallbackFunction;
+
+    /// How a shard is selected for allocations
+    enum class ShardSelection
+    {
+        /// by the CPU the calling thread is running on
+        cpu,
+        /// by the NUMA node the calling thread is running on
+        numaNode
+    };
+
+    /**
+     * Constructor: Creates the shards, but doesn't yet allocate anything.
+     * @param[in] numShards     the number of shards (the CPU or node index is taken modulo
+     *                          this number)
+     * @param[in] selection     how to select the shard for an allocation
+     * @param[in] pageSize      the OS's page size (or a multiple thereof)
+     * @throws std::runtime_error  if there are no shards or the page size is invalid
+     */
+    explicit ShardedSensitivePageAllocator(std::size_t numShards = getDefaultNumberOfShards(),
+                                           ShardSelection selection = ShardSelection::cpu,
+                                           std::size_t pageSize = os::getPageSize())
+      : m_selection(selection), m_owners(), m_shards()
+    {
+        if (numShards == 0)
+            throw std::runtime_error("expected at least one shard");
+
+        m_shards.reserve(numShards);
+        for (std::size_t i = 0; i < numShards; ++i)
+        {
+            m_shards.emplace_back(new Shard(pageSize));
+            const uint32_t owner = static_cast<uint32_t>(i + 1);
+            m_shards.back()->setMemoryMapCallback(
+              [this, owner](const Shard*, const AllocationInfo& area, bool mapped) {
+                  m_owners.set(area.addr, area.size, mapped ? owner : 0);
+              });
+        }
+    }
+
+    // disable copy & move
+    ShardedSensitivePageAllocator(const ShardedSensitivePageAllocator&) = delete;
+    ShardedSensitivePageAllocator(ShardedSensitivePageAllocator&&) = delete;
+    ShardedSensitivePageAllocator& operator=(const ShardedSensitivePageAllocator&) = delete;
+    ShardedSensitivePageAllocator& operator=(ShardedSensitivePageAllocator&&) = delete;
+
+    /**
+     * Returns the default instance of this class, with one shard per CPU.
+     * @return a reference to the instance
+     */
+    static ShardedSensitivePageAllocator& getDefaultInstance()
+    {
+        // "phoenix singleton"
+        static ShardedSensitivePageAllocator _instance;
+        return _instance;
+    }
+
+    /// @return the number of CPUs (or 1 if unknown)
+    static std::size_t getDefaultNumberOfShards()
+    {
+        const std::size_t cpus = std::thread::hardware_concurrency();
+        return cpus ? cpus : 1;
+    }
+
+    /**
+     * Sets the leak callback function of all shards (see SensitivePageAllocator).
+     *
+     * Note: This method is intentionally *not* thread-safe.
+     *
+     * @param[in] fun       the function to call
+     */
+    void setLeakCallback(const LeakCallbackFunction& fun)
+    {
+        for (auto& shard : m_shards)
+            shard->setLeakCallback(fun);
+    }
+
+    std::size_t max_size() const noexcept { return static_cast<std::size_t>(-1); }
+
+    std::size_t getPageSize() const { return m_shards.front()->getPageSize(); }
+    std::size_t getNumberOfShards() const noexcept { return m_shards.size(); }
+    ShardSelection getShardSelection() const noexcept { return m_selection; }
+
+    /// @return the shard with the given index (0 ... getNumberOfShards() - 1)
+    Shard& getShard(std::size_t index) { return *m_shards.at(index); }
+
+    /// @return the index of the shard used for allocations by the calling thread (right now)
+    std::size_t getCurrentShardIndex() const
+    {
+        const std::size_t id = (m_selection == ShardSelection::cpu) ? os::getCurrentCpu()
+                                                                     : os::getCurrentNumaNode();
+        return id % m_shards.size();
+    }
+
+    // Some informal stuff (summed up over all shards)...
+
+    std::size_t getNumberOfManagedAllocatedPages() const noexcept
+    {
+        std::size_t count = 0;
+        for (auto& shard : m_shards)
+            count += shard->getNumberOfManagedAllocatedPages();
+        return count;
+    }
+
+    std::size_t getNumberOfUnmanagedAreas() const noexcept
+    {
+        std::size_t count = 0;
+        for (auto& shard : m_shards)
+            count += shard->getNumberOfUnmanagedAreas();
+        return count;
+    }
+
+    std::size_t getNumberOfSparePages() const noexcept
+    {
+        std::size_t count = 0;
+        for (auto& shard : m_shards)
+            count += shard->getNumberOfSparePages();
+        return count;
+    }
+
+
+    /**
+     * Allocates a range of memory from the current shard.
+     * @param[in] size      the minimum size of the allocation
+     * @return memory address
+     * @throws std::bad_alloc if allocation failed
+     * @throws std::system_error if locking fails
+     */
+    pointer allocate(std::size_t size) { return m_shards[getCurrentShardIndex()]->allocate(size); }
+
+    /**
+     * Deallocates a range of memory using the shard that owns it.
+     * @param[in] addr      the memory address that was returned from allocate()
+     * @param[in] size      the parameter previously passed to allocate()
+     * @throws std::system_error if unlocking fails
+     */
+    void deallocate(pointer addr, std::size_t size)
+    {
+        const std::size_t current = getCurrentShardIndex();
+        const std::size_t owner = findOwner(addr);
+        if (owner == current)
+            m_shards[owner]->deallocate(addr, size);
+        else if (owner < m_shards.size())
+            m_shards[owner]->deallocateRemote(addr, size);
+    }
+
+    /**
+     * Allocates a range of memory with a given alignment from the current shard (see
+     * SensitivePageAllocator::allocate(std::size_t, std::size_t)).
+     * @param[in] size          the minimum size of the allocation
+     * @param[in] alignment     the required alignment (a power of 2, at most getMaxAlignment())
+     * @return memory address
+     * @throws std::invalid_argument if the alignment isn't a power of 2
+     * @throws std::bad_alloc if allocation failed or the alignment is too large
+     * @throws std::system_error if locking fails
+     */
+    pointer allocate(std::size_t size, std::size_t alignment)
+    {
+        return m_shards[getCurrentShardIndex()]->allocate(size, alignment);
+    }
+
+    /**
+     * Deallocates a range of memory that was allocated with an alignment using the shard that
+     * owns it (deferred like deallocate(), see SensitivePageAllocator::deallocateRemote()).
+     * @param[in] addr          the memory address that was returned from allocate()
+     * @param[in] size          the size previously passed to allocate()
+     * @param[in] alignment     the alignment previously passed to allocate()
+     * @throws std::system_error if unlocking fails
+     */
+    void deallocate(pointer addr, std::size_t size, std::size_t alignment)
+    {
+        const std::size_t current = getCurrentShardIndex();
+        const std::size_t owner = findOwner(addr);
+        if (owner == current)
+            m_shards[owner]->deallocate(addr, size, alignment);
+        else if (owner < m_shards.size())
+            m_shards[owner]->deallocateRemote(addr, size, alignment);
+    }
+
+    /// @return the largest alignment supported by allocate(std::size_t, std::size_t)
+    std::size_t getMaxAlignment() const noexcept { return m_shards.front()->getMaxAlignment(); }
+
+    /**
+     * Allocates multiple ranges of memory from the current shard with a single lock (see
+     * SensitivePageAllocator::allocate_bulk()).
+     * @param[in] sizes     the minimum sizes of the allocations
+     * @param[out] out      receives the memory addresses
+     * @param[in] count     the number of allocations
+     * @throws std::bad_alloc if allocation failed
+     * @throws std::system_error if locking fails
+     */
+    void allocate_bulk(const std::size_t* sizes, pointer* out, std::size_t count)
+    {
+        m_shards[getCurrentShardIndex()]->allocate_bulk(sizes, out, count);
+    }
+
+    /**
+     * Deallocates multiple ranges of memory, each one using the shard that owns it.
+     * @param[in] addrs     the memory addresses that were returned from allocate()
+     * @param[in] sizes     the parameters previously passed to allocate()
+     * @param[in] count     the number of allocations
+     * @throws std::system_error if unlocking fails
+     */
+    void deallocate_bulk(const pointer* addrs, const std::size_t* sizes, std::size_t count)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+            deallocate(addrs[i], sizes[i]);
+    }
+
+    /**
+     * Performs the pending deallocations of all shards (see
+     * SensitivePageAllocator::flushRemoteFrees()).
+     * @throws std::system_error if locking fails
+     */
+    void flushRemoteFrees()
+    {
+        for (auto& shard : m_shards)
+            shard->flushRemoteFrees();
+    }
+
+    /**
+     * Tries to grow an allocation in place (see SensitivePageAllocator::try_expand()).
+     * @param[in] addr      the memory address that was returned from allocate()
+     * @param[in] oldSize   the parameter previously passed to allocate()
+     * @param[in] newSize   the required size
+     * @return @c true if the allocation has (at least) the new size now
+     * @throws std::system_error if locking fails
+     */
+    bool try_expand(pointer addr, std::size_t oldSize, std::size_t newSize)
+    {
+        const std::size_t owner = findOwner(addr);
+        return owner < m_shards.size() && m_shards[owner]->try_expand(addr, oldSize, newSize);
+    }
+
+private:
+    /**
+     * Lock-free map of addresses to shards: A radix tree with four levels that stores the owner
+     * (shard index + 1, 0 = none) of every 4K of the address space (every OS page size is a
+     * multiple of this). Entries are written by the shards' memory map callbacks and read without
+     * locking. The entry of an allocation can't change while it is in use, because its memory
+     * can't be returned to the OS before. Nodes are only released by the destructor.
+     */
+    class OwnerMap
+    {
+    public:
+        OwnerMap() : m_root(new Node<Node<Node<Leaf>>>()) {}
+        OwnerMap(const OwnerMap&) = delete;
+        OwnerMap& operator=(const OwnerMap&) = delete;
+        ~OwnerMap()
+        {
+            for (auto& l1 : m_root->children)
+            {
+                std::unique_ptr<Node<Node<Leaf>>> node1(l1.load(std::memory_order_relaxed));
+                if (!node1)
+                    continue;
+                for (auto& l2 : node1->children)
+                {
+                    std::unique_ptr<Node<Leaf>> node2(l2.load(std::memory_order_relaxed));
+                    if (!node2)
+                        continue;
+                    for (auto& leaf : node2->children)
+                        delete leaf.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        /**
+         * Sets the owner of an address range.
+         * @param[in] addr      the start of the range (aligned to 4K)
+         * @param[in] size      the size of the range
+         * @param[in] owner     the owner (0 to remove the entries)
+         * @throws std::bad_alloc if a node can't be allocated (only if @c owner isn't 0)
+         */
+        void set(const void* addr, std::size_t size, uint32_t owner)
+        {
+            const uint64_t first = key(addr);
+            const uint64_t last = key(static_cast<const char*>(addr) + size - 1);
+            for (uint64_t k = first; k <= last; ++k)
+            {
+                Node<Node<Leaf>>* node1 = child(*m_root, index(k, 3), owner != 0);
+                Node<Leaf>* node2 = node1 ? child(*node1, index(k, 2), owner != 0) : nullptr;
+                Leaf* leaf = node2 ? child(*node2, index(k, 1), owner != 0) : nullptr;
+                if (leaf)
+                    leaf->owners[index(k, 0)].store(owner, std::memory_order_release);
+            }
+        }
+
+        /// @return the owner of an address (0 if unknown)
+        uint32_t get(const void* addr) const noexcept
+        {
+            const uint64_t k = key(addr);
+            const Node<Node<Leaf>>* node1 =
+              m_root->children[index(k, 3)].load(std::memory_order_acquire);
+            const Node<Leaf>* node2 =
+              node1 ? node1->children[index(k, 2)].load(std::memory_order_acquire) : nullptr;
+            const Leaf* leaf =
+              node2 ? node2->children[index(k, 1)].load(std::memory_order_acquire) : nullptr;
+            return leaf ? leaf->owners[index(k, 0)].load(std::memory_order_acquire) : 0;
+        }
+
+    private:
+        /// 4K granularity, 13 bits per level: covers 64 bit addresses
+        static constexpr unsigned granularityBits = 12;
+        static constexpr unsigned levelBits = 13;
+        static constexpr std::size_t fanout = std::size_t(1) << levelBits;
+
+        /// the owners of 2^13 * 4K = 32 MB of address space
+        struct Leaf
+        {
+            std::atomic<uint32_t> owners[fanout];
+        };
+
+        /// an inner node: the children are created on demand (value-initialized to nullptr)
+        template <typename Child>
+        struct Node
+        {
+            std::atomic<Child*> children[fanout];
+        };
+
+        static uint64_t key(const void* addr) noexcept
+        {
+            return static_cast<uint64_t>(reinterpret_cast<std::uintptr_t>(addr)) >>
+                   granularityBits;
+        }
+
+        static std::size_t index(uint64_t k, unsigned level) noexcept
+        {
+            return static_cast<std::size_t>(k >> (level * levelBits)) & (fanout - 1);
+        }
+
+        /// @return the child at the given index, which is created if @c create is @c true
+        template <typename Child>
+        static Child* child(Node<Child>& node, std::size_t i, bool create)
+        {
+            Child* result = node.children[i].load(std::memory_order_acquire);
+            if (result || !create)
+                return result;
+
+            std::unique_ptr<Child> newChild(new Child());
+            if (node.children[i].compare_exchange_strong(result, newChild.get(),
+                                                         std::memory_order_acq_rel,
+                                                         std::memory_order_acquire))
+                return newChild.release();
+            // created by another shard in the meantime
+            return result;
+        }
+
+        std::unique_ptr<Node<Node<Node<Leaf>>>> m_root;
+    };
+
+    /// @return the index of the shard that owns memory or getNumberOfShards() if there is none
+    std::size_t findOwner(pointer addr) const noexcept
+    {
+        const uint32_t owner = m_owners.get(addr);
+        return owner ? owner - 1 : m_shards.size();
+    }
+
+    /// how to select the shard for allocations
+    ShardSelection m_selection;
+    /// maps addresses to shards (must outlive the shards, which update it until destroyed)
+    OwnerMap m_owners;
+    /// the shards
+    std::vector<std::unique_ptr<Shard>> m_shards;
+};
+
+} // namespace spsl
+
+#endif /* SPSL_PAGEALLOC_SHARDED_HPP_ */
@@ -117,6 +117,61 @@ struct Throw
     }
 };
 } // namespace overflow
+
+/**
+ * Policies in this namespace decide how much memory is allocated when a string needs to grow.
+ * They are used by @c StoragePassword, which always allocates a multiple of its block size.
+ *
+ * All classes must implement the following (static) template function:
+ *   size_type capacity<size_type>(size_type required, size_type cap, size_type blockSize,
+ *                                 size_type max)
+ *
+ * It is called with the required number of characters (including the terminating NUL), the
+ * current capacity, the block size and the maximum size. It has to return the new capacity,
+ * which must be a multiple of the block size and at least @c required.
+ */
+namespace growth
+{
+
+/// @return @c n rounded up to a multiple of @c blockSize
+template <typename size_type>
+constexpr size_type roundToBlockSize(size_type n, size_type blockSize) noexcept
+{
+    return (n / blockSize + (n % blockSize != 0 ? 1 : 0)) * blockSize;
+}
+
+/**
+ * Policy class that allocates just enough blocks for the required capacity. This is a good fit
+ * for passwords and other strings that are assigned once, but appending many small pieces
+ * reallocates (and copies and wipes) the buffer once per block.
+ */
+struct FixedBlocks
+{
+    template <typename size_type>
+    static constexpr size_type capacity(size_type required, size_type, size_type blockSize,
+                                        size_type) noexcept
+    {
+        return roundToBlockSize(required, blockSize);
+    }
+};
+
+/**
+ * Policy class that (at least) doubles the capacity whenever the string grows. Appending
+ * large secrets (e.g. PEM keys) piece by piece therefore only reallocates a logarithmic
+ * number of times, at the cost of up to twice the memory.
+ */
+struct Geometric
+{
+    template <typename size_type>
+    static constexpr size_type capacity(size_type required, size_type cap, size_type blockSize,
+                                        size_type max) noexcept
+    {
+        // note: cap + min(cap, max - cap) won't overflow (as long as cap <= max)
+        return roundToBlockSize(
+          std::max(required, cap < max ? cap + std::min(cap, max - cap) : cap), blockSize);
+    }
+};
+} // namespace growth
 } // namespace policy
 } // namespace spsl
 
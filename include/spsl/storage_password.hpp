@@ -8,11 +8,20 @@
 #ifndef SPSL_STORAGE_PASSWORD_HPP_
 #define SPSL_STORAGE_PASSWORD_HPP_
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
 #include <limits>
+#include <memory>
 #include <stdexcept>
 #include <string> // for traits
+#include <type_traits>
+#include <vector>
 
 #include "spsl/pagealloc.hpp"
+#include "spsl/policies.hpp"
 #include "spsl/type_traits.hpp"
 
 namespace spsl
@@ -23,23 +32,97 @@ namespace spsl
  * @param[in] ptr       pointer to the memory area to clear
  * @param[in] size      number of bytes to clear
  * @return @c ptr
+ *
+ * This runs at memset() speed: We use the platform's own secure wiping function where available
+ * (SecureZeroMemory() on Windows and explicit_bzero() on glibc). Otherwise, memset() is followed by
+ * a compiler barrier that "uses" the memory, so that the stores can't be removed as dead stores.
+ * Without inline assembly, we fall back to a word-wide store loop through a volatile pointer.
  */
 inline void* secure_memzero(void* ptr, size_t size) noexcept
 {
-    // Note: We are *not* using SecureZeroMemory() here because this requires us to include the
-    // Windows headers and then all hell breaks loose...
-    // Also, the implementation is pretty much the same :)
-
     // For more info, start here:
     // http://stackoverflow.com/questions/9973260/what-is-the-correct-way-to-clear-sensitive-data-from-memory-in-ios
 
-    volatile char* p = reinterpret_cast<char*>(ptr);
+#if defined(_WIN32)
+    // (windows.h is included by compat.hpp anyway)
+    SecureZeroMemory(ptr, size);
+#elif defined(SPSL_HAS_EXPLICIT_BZERO)
+    explicit_bzero(ptr, size);
+#elif defined(__GNUC__) || defined(__clang__)
+    std::memset(ptr, 0, size);
+    // the compiler has to assume that the asm statement reads the memory
+    __asm__ __volatile__("" : : "r"(ptr) : "memory");
+#else
+    // clear single bytes until we are aligned, then whole words
+    volatile unsigned char* p = static_cast<unsigned char*>(ptr);
+    while (size != 0 && reinterpret_cast<std::uintptr_t>(p) % sizeof(std::uintptr_t) != 0)
+    {
+        *p++ = 0;
+        --size;
+    }
+    volatile std::uintptr_t* w = reinterpret_cast<volatile std::uintptr_t*>(p);
+    for (; size >= sizeof(std::uintptr_t); size -= sizeof(std::uintptr_t))
+        *w++ = 0;
+    p = reinterpret_cast<volatile unsigned char*>(w);
     while (size--)
         *p++ = 0;
+#endif
     return ptr;
 }
 
 
+/**
+ * The part of StoragePassword's buffer that is stored inside the object: Strings of up to
+ * @c InlineSize characters are stored here without allocating any memory.
+ */
+template <typename CharType, std::size_t InlineSize>
+struct StoragePasswordInlineBuffer
+{
+    StoragePasswordInlineBuffer() noexcept : _l(), _b() {}
+
+    /// size of the inline buffer in characters (including the terminating NUL)
+    static constexpr std::size_t _inlineCapacity() { return InlineSize + 1; }
+
+    struct SizeInfo
+    {
+        /// number of bytes (*not* characters) in the buffer, not including the terminating NUL
+        std::size_t m_length;
+        /// number of bytes (*not* characters) allocated (or the size of the inline buffer)
+        std::size_t m_capacity;
+        /// number of characters that may have been written since the last wipe (high-water mark)
+        std::size_t m_used;
+    };
+    SizeInfo _l;
+    CharType _b[InlineSize + 1];
+};
+
+/**
+ * Without an inline buffer, the buffer inside the object only represents the empty string. We
+ * store length + capacity information in a union that we also use as empty string representation
+ * (assumption: m_buffer == _b => m_length == m_capacity == 0, i.e. there's nothing to wipe).
+ */
+template <typename CharType>
+struct StoragePasswordInlineBuffer<CharType, 0>
+{
+    static constexpr std::size_t _inlineCapacity() { return 0; }
+
+    struct SizeInfo
+    {
+        /// number of bytes (*not* characters) in the buffer, not including the terminating NUL
+        std::size_t m_length;
+        /// number of bytes (*not* characters) allocated
+        std::size_t m_capacity;
+        /// number of characters that may have been written since the last wipe (high-water mark)
+        std::size_t m_used;
+    };
+    union {
+        SizeInfo _l;
+        // actually _b[1] is sufficient, but triggers overflow warnings in GCC
+        CharType _b[sizeof(SizeInfo)];
+    };
+};
+
+
 /**
  * Storage implementation that wipes all memory before free'ing it. It's therefore usable for
  * passwords and other sensitive data that shouldn't be "left behind" when releasing memory
@@ -49,19 +132,39 @@ inline void* secure_memzero(void* ptr, size_t size) noexcept
  * that passwords and other sensitive data is relatively static. We rely on an allocator type,
  * which defaults to std::allocator, so that we can swap out the allocator in the unit tests.
  * Only the allocate(), deallocate() and max_size() member functions of the allocator type are used.
+ * If the allocator also provides try_expand() (like SensitiveSegmentAllocator), the buffer is grown
+ * in place whenever possible, which avoids copying and wiping the old buffer. Likewise,
+ * createBulk() uses the allocator's allocate_bulk() if available.
+ *
+ * How many blocks are allocated when the string grows is decided by the @c GrowthPolicy (see
+ * spsl::policy::growth): The default allocates just enough blocks, which keeps the memory footprint
+ * of static secrets small, while policy::growth::Geometric makes appending piece by piece cheap.
+ * Each reallocation wipes the old buffer either way.
+ *
+ * Only the part of the buffer that was actually used since the last wipe is wiped (we keep track
+ * of a high-water mark), so clearing or destroying a large but mostly empty buffer is cheap.
+ *
+ * Optionally, strings of up to @c InlineSize characters (e.g. PINs and one-time passwords) are
+ * stored inside the object, without using the allocator at all. The inline buffer is wiped just
+ * like allocated memory: when the string is cleared, moved to another buffer or destroyed.
  */
 template <typename CharType, std::size_t BlockSize = 128,
-          typename Allocator = SensitiveSegmentAllocator<CharType>>
-class StoragePassword : private Allocator
+          typename Allocator = SensitiveSegmentAllocator<CharType>, std::size_t InlineSize = 0,
+          typename GrowthPolicy = policy::growth::FixedBlocks>
+class StoragePassword : private Allocator,
+                        protected StoragePasswordInlineBuffer<CharType, InlineSize>
 {
+    using buffer_base = StoragePasswordInlineBuffer<CharType, InlineSize>;
+
 public:
     using size_type = std::size_t;
     using difference_type = ssize_t;
     using char_type = CharType;
     /// simple alias for the typing impaired :)
-    using this_type = StoragePassword<char_type, BlockSize, Allocator>;
+    using this_type = StoragePassword<char_type, BlockSize, Allocator, InlineSize, GrowthPolicy>;
     using traits_type = typename std::char_traits<char_type>;
     using allocator = Allocator;
+    using growth_policy = GrowthPolicy;
 
     static constexpr char_type nul() { return char_type(); }
 
@@ -72,6 +175,7 @@ public:
         return a.max_size();
     }
     constexpr static size_type block_size() { return BlockSize; }
+    constexpr static size_type inline_size() { return InlineSize; }
     size_type capacity() const { return _l.m_capacity; }
     size_type length() const { return _l.m_length; }
     size_type size() const { return _l.m_length; }
@@ -92,41 +196,32 @@ public:
 
     void reserve(size_type new_cap = 0)
     {
-        if (new_cap > max_size())
-            throw std::length_error("requested capacity exceeds maximum");
-        if (new_cap >= capacity())
-        {
-            // need to realloc: We explicitly allocate a new block, copy all data and wipe the old
-            new_cap = _roundRequiredCapacityToBlockSize(new_cap + 1);
-
-            // allocate a new buffer (the allocator will throw in case of error)
-            allocator& a = *this;
-            char_type* newbuf = a.allocate(new_cap);
-
-            // copy existing data (note: all data must fit because we're only growing)
-            if (size())
-                traits_type::copy(newbuf, m_buffer, size() + 1);
-            else
-                newbuf[0] = nul();
-
-            // wipe all existing data
-            if (m_buffer != _b)
-            {
-                _wipe();
-                a.deallocate(m_buffer, capacity());
-            }
+        if (_reserveInPlace(new_cap))
+            return;
+
+        // need to realloc: We explicitly allocate a new block, copy all data and wipe the old
+        // one - starting with a new buffer (the allocator will throw in case of error)
+        new_cap = _growCapacity(new_cap);
+        allocator& a = *this;
+        char_type* newbuf = a.allocate(new_cap);
+
+        // copy existing data (note: all data must fit because we're only growing)
+        if (size())
+            traits_type::copy(newbuf, m_buffer, size() + 1);
+        else
+            newbuf[0] = nul();
 
-            // now replace our data
-            m_buffer = newbuf;
-            _l.m_capacity = new_cap;
-        }
+        // wipe & release the old buffer, then replace our data
+        _replaceBuffer(newbuf, new_cap);
+        _l.m_used = size() + 1;
     }
 
     // get rid of unnecessarily allocated data
     void shrink_to_fit()
     {
         // quick & dirty implementation: create a copy of this string and swap...
-        if ((empty() && capacity()) || (capacity() - (size() + 1) >= BlockSize))
+        // (note: the copy uses the inline buffer if possible)
+        if (m_buffer != _b && (_fitsInline(size()) || capacity() - (size() + 1) >= BlockSize))
         {
             this_type copy(*this);
             swap(copy);
@@ -137,12 +232,17 @@ public:
     {
         _l.m_length = n;
         traits_type::assign(m_buffer[n], nul());
+        // Note: All writes are limited to the content and the terminating NUL (this includes
+        // writes through data() and operator[]), so this keeps the high-water mark up to date.
+        _markUsed(n + 1);
     }
 
     // default constructor
-    StoragePassword(const allocator& alloc = allocator()) noexcept : allocator(alloc), m_buffer(_b)
+    StoragePassword(const allocator& alloc = allocator()) noexcept
+      : allocator(alloc), buffer_base(), m_buffer(_b)
     {
-        _l.m_capacity = 0;
+        _l.m_capacity = _inlineCapacity();
+        _l.m_used = 0;
         _set_length(0);
     }
 
@@ -170,12 +270,65 @@ public:
         return *this;
     }
 
+    /**
+     * Creates storage instances for many strings at once, e.g. when loading a credential store.
+     * If the allocator provides allocate_bulk() (like SensitiveSegmentAllocator), all buffers
+     * are allocated with a single call.
+     * @param[in] values    the strings to copy (anything with data() and size())
+     * @param[in] alloc     the allocator to use
+     * @return the storage instances (in the same order)
+     * @throws std::length_error if a string is too long
+     */
+    template <typename Container>
+    static std::vector<this_type> createBulk(const Container& values,
+                                             const allocator& alloc = allocator())
+    {
+        std::vector<this_type> result;
+        std::vector<size_type> capacities;
+        std::vector<char_type*> buffers;
+        result.reserve(values.size());
+        capacities.reserve(values.size());
+        for (const auto& value : values)
+        {
+            result.emplace_back(alloc);
+            if (value.size() > result.back().max_size())
+                throw std::length_error("requested capacity exceeds maximum");
+            // note: empty strings and those that fit into the inline buffer don't allocate anything
+            if (!_fitsInline(value.size()))
+                capacities.push_back(_roundRequiredCapacityToBlockSize(value.size() + 1));
+        }
+        buffers.resize(capacities.size());
+
+        // allocate all buffers at once (nothing below throws, so they can't leak)
+        allocator a(alloc);
+        _allocateBulk(a, capacities.data(), buffers.data(), buffers.size(),
+                      typename has_allocate_bulk<allocator, char_type>::type());
+
+        std::size_t index = 0;
+        auto it = result.begin();
+        for (const auto& value : values)
+        {
+            this_type& s = *it++;
+            if (value.size() == 0)
+                continue;
+            if (!_fitsInline(value.size()))
+            {
+                s.m_buffer = buffers[index];
+                s._l.m_capacity = capacities[index];
+                ++index;
+            }
+            traits_type::copy(s.m_buffer, value.data(), value.size());
+            s._set_length(value.size());
+        }
+        return result;
+    }
+
     // default destructor: wipe & release
     ~StoragePassword()
     {
+        clear();
         if (m_buffer != _b)
         {
-            clear();
             allocator& a = *this;
             a.deallocate(m_buffer, capacity());
         }
@@ -214,17 +367,16 @@ public:
 
     void clear()
     {
-        if (m_buffer != _b)
-        {
-            _wipe();
-        }
+        // note: only the part that was actually used is wiped, so clearing a large reserved buffer
+        // is cheap (and there's nothing to wipe if the string is empty without an inline buffer)
+        _wipe();
         _l.m_length = 0;
     }
     void push_back(char_type c)
     {
         reserve(size() + 1);
-        traits_type::assign(m_buffer[_l.m_length++], c);
-        traits_type::assign(m_buffer[_l.m_length], nul());
+        traits_type::assign(m_buffer[size()], c);
+        _set_length(size() + 1);
     }
     void pop_back()
     {
@@ -237,42 +389,22 @@ public:
     {
         if (index > size())
             throw std::out_of_range("index out of range");
-
-        reserve(size() + count);
-
-        // move the existing data (including the terminating NUL)
-        char_type* ptr = m_buffer + index;
-        const size_type len = size() + 1 - index;
-        traits_type::move(ptr + count, ptr, len);
-
-        for (size_type i = 0; i < count; ++i)
-            traits_type::assign(ptr[i], ch);
-
-        _l.m_length += count;
+        replace(index, 0, count, ch);
     }
 
     void insert(size_type index, const char_type* s, size_type n)
     {
         if (index > size())
             throw std::out_of_range("index out of range");
-
-        reserve(size() + n);
-
-        // move the existing data (including the terminating NUL)
-        char_type* ptr = m_buffer + index;
-        const size_type len = size() + 1 - index;
-        traits_type::move(ptr + n, ptr, len);
-        traits_type::copy(ptr, s, n);
-
-        _l.m_length += n;
+        replace(index, 0, s, n);
     }
 
     template <typename InputIt, typename = checkInputIter<InputIt>>
     void insert(size_type index, InputIt first, InputIt last)
     {
-        this_type tmp;
-        tmp.assign(first, last);
-        insert(index, tmp.data(), tmp.size());
+        if (index > size())
+            throw std::out_of_range("index out of range");
+        replace(index, 0, first, last);
     }
 
 
@@ -283,8 +415,8 @@ public:
         traits_type::move(data() + index, data() + index + count, n);
 
         _l.m_length -= count;
-        // wipe the rest
-        _wipe(_l.m_length, n);
+        // wipe the rest (i.e. the vacated tail, which also terminates the string)
+        _wipe(_l.m_length, count);
     }
 
 
@@ -312,78 +444,37 @@ public:
         }
     }
 
+    // Note: All replace() variants work in place if the capacity allows it, i.e. the tail is moved
+    // and only the vacated part is wiped. Otherwise, the result is built in a new buffer (a single
+    // reallocation) and the old buffer is wiped.
+
     void replace(size_type pos, size_type count, const char_type* cstr, size_type count2)
     {
-        // lazy implementation:
-        //   - different length: build a new string and swap...
-        //   - same length: overwrite the part to replace
-        // This is *not* the most efficient implementation, but it's easy and exception safe :)
-        // TODO: avoid reallocations, fix this
-
-        if (count == count2)
+        // the replacement may be a part of this string: if we can work in place, it needs special
+        // care (the realloc case copies it before wiping the old buffer, so that's fine)
+        if (_isInBuffer(cstr) && _reserveInPlace(size() - count + count2))
         {
-            traits_type::copy(data() + pos, cstr, count2);
+            _replaceAliased(pos, count, cstr, count2);
         }
         else
         {
-            this_type tmp;
-            tmp.reserve(size() - count + count2);
-
-            // (1) copy the part before 'pos'
-            if (pos != 0)
-                tmp.assign(data(), pos);
-
-            // (2) append the replacement string
-            tmp.append(cstr, count2);
-
-            // (3) append the rest after 'pos + count'
-            size_type rest = pos + count;
-            if (rest < size())
-                tmp.append(data() + rest, size() - rest);
-
-            // (4) swap/move
-            *this = std::move(tmp);
+            _replace(pos, count, count2,
+                     [cstr, count2](char_type* p) { traits_type::copy(p, cstr, count2); });
         }
     }
 
     void replace(size_type pos, size_type count, size_type count2, char_type ch)
     {
-        // => same implementation as above
-        // TODO: avoid reallocations, fix this
-
-        if (count == count2)
-        {
-            traits_type::assign(data() + pos, count2, ch);
-        }
-        else
-        {
-            this_type tmp;
-            tmp.reserve(size() - count + count2);
-
-            // (1) copy the part before 'pos'
-            if (pos != 0)
-                tmp.assign(data(), pos);
-
-            // (2) append the replacement string
-            tmp.append(count2, ch);
-
-            // (3) append the rest after 'pos + count'
-            size_type rest = pos + count;
-            if (rest < size())
-                tmp.append(data() + rest, size() - rest);
-
-            // (4) swap/move
-            *this = std::move(tmp);
-        }
+        _replace(pos, count, count2,
+                 [count2, ch](char_type* p) { traits_type::assign(p, count2, ch); });
     }
 
     template <class InputIt>
     void replace(size_type pos, size_type count, InputIt first, InputIt last)
     {
-        // => same implementation as above
-        this_type tmp;
-        tmp.assign(first, last);
-        replace(pos, count, tmp.data(), tmp.size());
+        // (plain pointers may point into this string)
+        _replaceRange(pos, count, first, last,
+                      typename std::is_convertible<InputIt, const char_type*>::type());
     }
 
     void resize(size_type count, char_type ch)
@@ -396,7 +487,7 @@ public:
         else if (count > size())
         {
             reserve(count);
-            traits_type::assign(m_buffer + size(), count, ch);
+            traits_type::assign(m_buffer + size(), count - size(), ch);
         }
         _set_length(count);
     }
@@ -405,6 +496,10 @@ public:
     {
         std::swap(_l.m_length, other._l.m_length);
         std::swap(_l.m_capacity, other._l.m_capacity);
+        std::swap(_l.m_used, other._l.m_used);
+        // the inline buffers are swapped character by character (no temporary copy that would
+        // have to be wiped), unused inline buffers are always wiped
+        std::swap_ranges(_b, _b + _inlineCapacity(), other._b);
         // avoid swapping internal pointers...
         std::swap(m_buffer, other.m_buffer);
         if (other.m_buffer == _b)
@@ -415,28 +510,272 @@ public:
     }
 
 protected:
+    /// grows the allocated buffer in place to @c new_cap characters
+    bool _tryExpand(size_type new_cap, std::true_type)
+    {
+        allocator& a = *this;
+        return a.try_expand(m_buffer, capacity(), new_cap);
+    }
+    /// the allocator doesn't support growing in place
+    bool _tryExpand(size_type, std::false_type) noexcept { return false; }
+
+    /// allocates multiple buffers with a single call
+    static void _allocateBulk(allocator& a, const size_type* capacities, char_type** buffers,
+                              std::size_t count, std::true_type)
+    {
+        if (count != 0)
+            a.allocate_bulk(capacities, buffers, count);
+    }
+    /// the allocator doesn't support bulk allocations: allocate one by one
+    static void _allocateBulk(allocator& a, const size_type* capacities, char_type** buffers,
+                              std::size_t count, std::false_type)
+    {
+        std::size_t i = 0;
+        try
+        {
+            for (; i < count; ++i)
+                buffers[i] = a.allocate(capacities[i]);
+        }
+        catch (...)
+        {
+            while (i != 0)
+            {
+                --i;
+                a.deallocate(buffers[i], capacities[i]);
+            }
+            throw;
+        }
+    }
+
+    /// @return the capacity to allocate for a string of @c n characters
+    size_type _growCapacity(size_type n) const
+    {
+        return growth_policy::capacity(n + 1, capacity(), BlockSize, max_size());
+    }
+
+    /**
+     * Makes sure that the current buffer can hold @c n characters, growing it in place if the
+     * allocator supports it.
+     * @return @c false if a new buffer is required
+     * @throws std::length_error if @c n exceeds the maximum size
+     */
+    bool _reserveInPlace(size_type n)
+    {
+        if (n > max_size())
+            throw std::length_error("requested capacity exceeds maximum");
+        if (n < capacity())
+            return true;
+        if (m_buffer == _b)
+            return false;
+
+        const size_type new_cap = _growCapacity(n);
+        if (!_tryExpand(new_cap, typename has_try_expand<allocator, char_type>::type()))
+            return false;
+        _l.m_capacity = new_cap;
+        return true;
+    }
+
+    /**
+     * Wipes & releases the current buffer and replaces it with @c newbuf. The caller is
+     * responsible to update the length (and the high-water mark).
+     */
+    void _replaceBuffer(char_type* newbuf, size_type new_cap) noexcept
+    {
+        _wipe();
+        if (m_buffer != _b)
+        {
+            allocator& a = *this;
+            a.deallocate(m_buffer, capacity());
+        }
+        m_buffer = newbuf;
+        _l.m_capacity = new_cap;
+    }
+
+    /// @return @c true if @c s points into the current content
+    bool _isInBuffer(const char_type* s) const noexcept
+    {
+        const std::less<const char_type*> less;
+        return !less(s, m_buffer) && less(s, m_buffer + size());
+    }
+
+    /**
+     * Replaces @c count characters at @c pos with @c count2 characters that are written by
+     * @c fill (called with a pointer to the first one).
+     */
+    template <typename Fill>
+    void _replace(size_type pos, size_type count, size_type count2, Fill fill)
+    {
+        const size_type oldSize = size();
+        const size_type tail = oldSize - pos - count;
+        const size_type newSize = oldSize - count + count2;
+
+        if (_reserveInPlace(newSize))
+        {
+            // (before writing anything - fill() may throw)
+            _markUsed(newSize + 1);
+            char_type* p = m_buffer + pos;
+            traits_type::move(p + count2, p + count, tail);
+            fill(p);
+            // wipe what's left of the old content
+            if (newSize < oldSize)
+                _wipe(newSize, oldSize - newSize);
+        }
+        else
+        {
+            const size_type new_cap = _growCapacity(newSize);
+            allocator& a = *this;
+            char_type* newbuf = a.allocate(new_cap);
+            traits_type::copy(newbuf, m_buffer, pos);
+            try
+            {
+                fill(newbuf + pos);
+            }
+            catch (...)
+            {
+                secure_memzero(newbuf, new_cap * sizeof(char_type));
+                a.deallocate(newbuf, new_cap);
+                throw;
+            }
+            traits_type::copy(newbuf + pos + count2, m_buffer + pos + count, tail);
+            _replaceBuffer(newbuf, new_cap);
+        }
+        _set_length(newSize);
+    }
+
+    /// in-place replacement with a part of this string (the buffer is already large enough)
+    void _replaceAliased(size_type pos, size_type count, const char_type* s, size_type count2)
+    {
+        const size_type oldSize = size();
+        const size_type tail = oldSize - pos - count;
+        char_type* p = m_buffer + pos;
+        if (count2 <= count)
+        {
+            // the tail isn't modified by copying the replacement
+            traits_type::move(p, s, count2);
+            traits_type::move(p + count2, p + count, tail);
+            _wipe(oldSize - count + count2, count - count2);
+        }
+        else
+        {
+            // move the tail first, then find the replacement (it may have been moved, too)
+            traits_type::move(p + count2, p + count, tail);
+            if (s + count2 <= p + count)
+            {
+                traits_type::move(p, s, count2);
+            }
+            else if (s >= p + count)
+            {
+                traits_type::move(p, s + (count2 - count), count2);
+            }
+            else
+            {
+                const size_type left = static_cast<size_type>(p + count - s);
+                traits_type::move(p, s, left);
+                traits_type::move(p + left, p + count2, count2 - left);
+            }
+        }
+        _set_length(oldSize - count + count2);
+    }
+
+    /// replacement with pointers: see replace()
+    template <class InputIt>
+    void _replaceRange(size_type pos, size_type count, InputIt first, InputIt last, std::true_type)
+    {
+        const char_type* s = first;
+        replace(pos, count, s, static_cast<size_type>(last - first));
+    }
+    template <class InputIt>
+    void _replaceRange(size_type pos, size_type count, InputIt first, InputIt last,
+                       std::false_type)
+    {
+        _replaceRange(pos, count, first, last,
+                      typename std::iterator_traits<InputIt>::iterator_category());
+    }
+    /**
+     * Replacement with forward iterators: The number of characters is known in advance, so the
+     * characters are copied straight into the gap. If the iterators refer to this string (e.g.
+     * reverse iterators), this would read characters that have already been moved, so we copy
+     * them into a (wiped) temporary first.
+     */
+    template <class ForwardIt>
+    void _replaceRange(size_type pos, size_type count, ForwardIt first, ForwardIt last,
+                       std::forward_iterator_tag)
+    {
+        using reference = typename std::iterator_traits<ForwardIt>::reference;
+        using refers_to_chars =
+          std::integral_constant<bool, std::is_lvalue_reference<reference>::value &&
+                                         std::is_same<typename std::decay<reference>::type,
+                                                      char_type>::value>;
+        if (_isRangeInBuffer(first, last, refers_to_chars()))
+        {
+            _replaceWithCopy(pos, count, first, last);
+            return;
+        }
+        const auto n = static_cast<size_type>(std::distance(first, last));
+        _replace(pos, count, n, [first, last](char_type* p) { std::copy(first, last, p); });
+    }
+    /**
+     * Replacement with input iterators: We can only read them once, so the characters are
+     * collected in a (wiped) temporary first. This also keeps the strong exception guarantee.
+     */
+    template <class InputIt>
+    void _replaceRange(size_type pos, size_type count, InputIt first, InputIt last,
+                       std::input_iterator_tag)
+    {
+        _replaceWithCopy(pos, count, first, last);
+    }
+    template <class InputIt>
+    void _replaceWithCopy(size_type pos, size_type count, InputIt first, InputIt last)
+    {
+        this_type tmp(getAllocator());
+        tmp.append(first, last);
+        replace(pos, count, tmp.data(), tmp.size());
+    }
+
+    /// @return @c true if any character in [first, last) is a part of this string
+    template <class ForwardIt>
+    bool _isRangeInBuffer(ForwardIt first, ForwardIt last, std::true_type) const noexcept
+    {
+        for (; first != last; ++first)
+        {
+            if (_isInBuffer(std::addressof(*first)))
+                return true;
+        }
+        return false;
+    }
+    /// the iterators don't refer to characters, i.e. not to this string either
+    template <class ForwardIt>
+    bool _isRangeInBuffer(ForwardIt, ForwardIt, std::false_type) const noexcept
+    {
+        return false;
+    }
+
     void _wipe(size_type index, size_type count) noexcept
     {
         secure_memzero(m_buffer + index, count * sizeof(char_type));
     }
-    void _wipe() noexcept { _wipe(0, capacity()); }
+    /// raises the high-water mark to @c n characters
+    void _markUsed(size_type n) noexcept
+    {
+        if (n > _l.m_used)
+            _l.m_used = n;
+    }
+    /// wipes everything that was written since the last wipe (up to the high-water mark)
+    void _wipe() noexcept
+    {
+        _wipe(0, std::min(_l.m_used, capacity()));
+        _l.m_used = 0;
+    }
+
+    /// @return @c true if a string of @c n characters doesn't require an allocated buffer
+    static constexpr bool _fitsInline(size_type n) { return n == 0 || n < _inlineCapacity(); }
 
 
 protected:
-    // we store length + capacity information in a union that we also use as empty string
-    // representation (assumption: m_buffer == _b => m_length == m_capacity == 0)
-    struct SizeInfo
-    {
-        /// number of bytes (*not* characters) in the buffer, not including the terminating NUL
-        size_type m_length;
-        /// number of bytes (*not* characters) allocated
-        size_type m_capacity;
-    };
-    union {
-        SizeInfo _l;
-        // actually _b[1] is sufficient, but triggers overflow warnings in GCC
-        char_type _b[sizeof(SizeInfo)];
-    };
+    // the size information and the inline buffer (see StoragePasswordInlineBuffer)
+    using buffer_base::_inlineCapacity;
+    using buffer_base::_l;
+    using buffer_base::_b;
 
     /// the underlying buffer
     char_type* m_buffer;
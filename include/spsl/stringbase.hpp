@@ -105,6 +105,7 @@ public:
 
     /// construct from another storage instance
     explicit StringBase(const storage_type& storage) : base_type(storage) {}
+    explicit StringBase(storage_type&& storage) : base_type(std::move(storage)) {}
 
     /// construct from another string-like container (may even be a vector...)
     template <typename StringClass, typename std::enable_if<is_compatible_string<
@@ -84,6 +84,7 @@ public:
 
     /// construct from another storage instance
     explicit StringCore(const storage_type& storage) : m_storage(storage) {}
+    explicit StringCore(storage_type&& storage) : m_storage(std::move(storage)) {}
 
     /// construct from another string-like container (may even be a vector...)
     template <typename StringClass, typename std::enable_if<is_compatible_string<
@@ -8,6 +8,7 @@
 #ifndef SPSL_TYPE_TRAITS_HPP_
 #define SPSL_TYPE_TRAITS_HPP_
 
+#include <cstddef>
 #include <type_traits>
 
 namespace spsl
@@ -93,6 +94,62 @@ struct is_compatible_string2
 {
 };
 
+/**
+ * Checks whether an allocator supports growing allocations in place, i.e. has a method
+ * @c try_expand(CharType* ptr, size_t oldSize, size_t newSize) that returns a boolean.
+ */
+template <typename Allocator, typename CharType>
+struct has_try_expand
+{
+private:
+    template <typename T>
+    static constexpr auto check(T*) -> typename std::is_convertible<
+      decltype(std::declval<T&>().try_expand(std::declval<CharType*>(), std::size_t(),
+                                             std::size_t())),
+      bool>::type
+    {
+        return {};
+    }
+
+    template <typename>
+    static constexpr std::false_type check(...)
+    {
+        return {};
+    }
+
+public:
+    using type = decltype(check<Allocator>(nullptr));
+    static constexpr bool value = type::value;
+};
+
+/**
+ * Checks whether an allocator supports bulk allocations, i.e. has a method
+ * @c allocate_bulk(const size_t* sizes, CharType** out, size_t count).
+ */
+template <typename Allocator, typename CharType>
+struct has_allocate_bulk
+{
+private:
+    template <typename T>
+    static constexpr auto check(T*) -> decltype(
+      std::declval<T&>().allocate_bulk(std::declval<const std::size_t*>(),
+                                       std::declval<CharType**>(), std::size_t()),
+      std::true_type())
+    {
+        return {};
+    }
+
+    template <typename>
+    static constexpr std::false_type check(...)
+    {
+        return {};
+    }
+
+public:
+    using type = decltype(check<Allocator>(nullptr));
+    static constexpr bool value = type::value;
+};
+
 /**
  * Checks whether a given type satisfies the InputIterator requirements.
  */
@@ -0,0 +1,158 @@
+/**
+ * @file    Special Purpose Strings Library: benchmark.hpp
+ * @author  Daniel Evers
+ * @brief   Minimal benchmark framework
+ * @license MIT
+ */
+
+#ifndef SPSL_TEST_BENCHMARK_HPP_
+#define SPSL_TEST_BENCHMARK_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace bench
+{
+
+/// a registered benchmark
+struct Benchmark
+{
+    std::string name;
+    std::function<void()> func;
+};
+
+/// @return the list of all registered benchmarks
+inline std::vector<Benchmark>& registry()
+{
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+/// helper to register benchmarks at static initialization time
+struct Registrar
+{
+    Registrar(const char* name, std::function<void()> func)
+    {
+        registry().push_back(Benchmark{ name, std::move(func) });
+    }
+};
+
+using Clock = std::chrono::steady_clock;
+
+/// @return the number of seconds since @c start
+inline double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * Prints a single result line.
+ * @param[in] name      name of the measurement
+ * @param[in] ops       number of operations performed
+ * @param[in] seconds   total time
+ */
+inline void report(const std::string& name, std::size_t ops, double seconds)
+{
+    const double nsPerOp = seconds * 1e9 / static_cast<double>(ops == 0 ? 1 : ops);
+    const double opsPerSec = static_cast<double>(ops) / (seconds > 0 ? seconds : 1e-9);
+    std::printf("  %-48s %10.1f ns/op %14.0f ops/s\n", name.c_str(), nsPerOp, opsPerSec);
+}
+
+/**
+ * Prints a result line with a value that isn't a time measurement.
+ * @param[in] name      name of the measurement
+ * @param[in] value     the measured value
+ * @param[in] unit      the value's unit
+ */
+inline void reportValue(const std::string& name, double value, const char* unit)
+{
+    std::printf("  %-48s %10.0f %s\n", name.c_str(), value, unit);
+}
+
+/**
+ * Prints the percentiles of a set of latencies.
+ * @param[in] name      name of the measurement
+ * @param[in] ns        the latencies in nanoseconds (sorted by this function)
+ */
+inline void reportLatencies(const std::string& name, std::vector<double>& ns)
+{
+    if (ns.empty())
+        return;
+    std::sort(ns.begin(), ns.end());
+    auto percentile = [&ns](double p) {
+        return ns[static_cast<std::size_t>(p * static_cast<double>(ns.size() - 1))];
+    };
+    std::printf("  %-48s p50 %6.0f  p90 %6.0f  p99 %6.0f  p99.9 %7.0f  max %8.0f ns\n",
+                name.c_str(), percentile(0.5), percentile(0.9), percentile(0.99),
+                percentile(0.999), ns.back());
+}
+
+/**
+ * Runs a function in @c numThreads threads that start at the same time.
+ * @param[in] numThreads    number of threads
+ * @param[in] func          the function to run, called with the thread's index
+ * @return wall clock time in seconds until all threads are done
+ */
+inline double runThreads(std::size_t numThreads, const std::function<void(std::size_t)>& func)
+{
+    std::atomic<std::size_t> ready{ 0 };
+    std::atomic<bool> go{ false };
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < numThreads; ++i)
+    {
+        threads.emplace_back([&, i]() {
+            ++ready;
+            while (!go.load())
+                std::this_thread::yield();
+            func(i);
+        });
+    }
+    while (ready.load() != numThreads)
+        std::this_thread::yield();
+
+    auto start = Clock::now();
+    go = true;
+    for (auto& thread : threads)
+        thread.join();
+    return secondsSince(start);
+}
+
+/// @return the thread counts to benchmark (1, 2, 4, ... up to twice the hardware concurrency)
+inline std::vector<std::size_t> threadCounts()
+{
+    std::size_t hw = std::thread::hardware_concurrency();
+    if (hw == 0)
+        hw = 1;
+    std::vector<std::size_t> counts;
+    for (std::size_t n = 1; n <= 2 * hw || n <= 4; n *= 2)
+        counts.push_back(n);
+    return counts;
+}
+
+/// prevents the compiler from optimizing away a value
+template <typename T>
+inline void doNotOptimize(const T& value)
+{
+    static volatile const void* sink;
+    sink = &value;
+    (void)sink;
+}
+} // namespace bench
+
+#define SPSL_BENCH_CONCAT2(a, b) a##b
+#define SPSL_BENCH_CONCAT(a, b) SPSL_BENCH_CONCAT2(a, b)
+
+/// defines and registers a benchmark function
+#define BENCHMARK(name)                                                                            \
+    static void SPSL_BENCH_CONCAT(benchmarkFunc, __LINE__)();                                      \
+    static bench::Registrar SPSL_BENCH_CONCAT(benchmarkReg, __LINE__)(                             \
+      name, &SPSL_BENCH_CONCAT(benchmarkFunc, __LINE__));                                          \
+    static void SPSL_BENCH_CONCAT(benchmarkFunc, __LINE__)()
+
+#endif /* SPSL_TEST_BENCHMARK_HPP_ */
@@ -0,0 +1,38 @@
+/**
+ * @file    Special Purpose Strings Library: benchmark_main.cpp
+ * @author  Daniel Evers
+ * @brief   Benchmark runner: runs all benchmarks or those matching the given filters
+ * @license MIT
+ */
+
+#include <cstdio>
+#include <string>
+
+#include "benchmark.hpp"
+
+int main(int argc, const char** argv)
+{
+    std::size_t numRun = 0;
+    for (auto& benchmark : bench::registry())
+    {
+        bool selected = (argc < 2);
+        for (int i = 1; i < argc; ++i)
+        {
+            if (benchmark.name.find(argv[i]) != std::string::npos)
+                selected = true;
+        }
+        if (!selected)
+            continue;
+
+        std::printf("%s\n", benchmark.name.c_str());
+        benchmark.func();
+        ++numRun;
+    }
+
+    if (numRun == 0)
+    {
+        std::printf("no matching benchmarks\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,360 @@
+/**
+ * @file    Special Purpose Strings Library: benchmark_pagealloc.cpp
+ * @author  Daniel Evers
+ * @brief   Benchmarks for the page allocators
+ * @license MIT
+ */
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "benchmark.hpp"
+
+#include "spsl/pagealloc.hpp"
+#include "spsl/pagealloc_concurrent.hpp"
+#include "spsl/pagealloc_sharded.hpp"
+
+namespace
+{
+
+constexpr std::size_t opsPerThread = 200000;
+constexpr std::size_t liveAllocations = 64;
+
+/**
+ * Each thread keeps a window of live allocations with varying sizes and replaces the oldest one
+ * in every iteration.
+ */
+template <typename Allocator>
+void allocFreeWorker(Allocator& alloc, std::size_t threadIndex, std::size_t ops = opsPerThread)
+{
+    std::array<std::pair<void*, std::size_t>, liveAllocations> live{};
+    std::size_t size = 1 + threadIndex * 7;
+    for (std::size_t i = 0; i < ops; ++i)
+    {
+        auto& slot = live[i % liveAllocations];
+        if (slot.first != nullptr)
+            alloc.deallocate(slot.first, slot.second);
+        // cycle through sizes of 1..8 segments
+        size = (size * 37 + 11) % (8 * 64) + 1;
+        slot.first = alloc.allocate(size);
+        slot.second = size;
+        static_cast<char*>(slot.first)[0] = 1;
+    }
+    for (auto& slot : live)
+    {
+        if (slot.first != nullptr)
+            alloc.deallocate(slot.first, slot.second);
+    }
+}
+
+/// Allocates and releases whole pages, which requires system calls unless regions are used
+void pageChurn(std::size_t regionSize)
+{
+    constexpr std::size_t rounds = 200;
+    constexpr std::size_t pages = 32;
+
+    spsl::SensitivePageAllocator alloc;
+    alloc.setRegionSize(regionSize);
+    // a full chunk, i.e. one page per allocation with 4K pages
+    const std::size_t size = alloc.chunk_size;
+    std::array<void*, pages> allocations{};
+
+    auto start = bench::Clock::now();
+    for (std::size_t round = 0; round < rounds; ++round)
+    {
+        for (auto& mem : allocations)
+            mem = alloc.allocate(size);
+        for (auto& mem : allocations)
+            alloc.deallocate(mem, size);
+    }
+    const double seconds = bench::secondsSince(start);
+    bench::report("region size " + std::to_string(regionSize), rounds * pages, seconds);
+}
+
+/**
+ * A mixed workload: long-lived small secrets (1-2 segments) are created while short-lived
+ * allocations of all sizes come and go. Reports the pages that are locked at the peak and those
+ * that are still locked (pinned by the secrets) once all short-lived allocations are gone.
+ */
+void mixedWorkload(bool sizeClasses, std::size_t sparePages)
+{
+    constexpr std::size_t steps = 100000;
+    constexpr std::size_t maxSecrets = 2000;
+    constexpr std::size_t transientSlots = 500;
+
+    spsl::SensitivePageAllocator alloc;
+    alloc.setSizeClasses(sizeClasses);
+    alloc.setSparePageLimits(sparePages / 2, sparePages);
+    const std::size_t segmentSize = alloc.segment_size;
+
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<std::size_t> percent(0, 99);
+    std::uniform_int_distribution<std::size_t> smallSize(1, 4 * segmentSize);
+    std::uniform_int_distribution<std::size_t> mediumSize(8 * segmentSize, 60 * segmentSize);
+    std::uniform_int_distribution<std::size_t> slotDist(0, transientSlots - 1);
+
+    std::vector<std::pair<void*, std::size_t>> secrets;
+    std::vector<std::pair<void*, std::size_t>> transients(transientSlots,
+                                                          std::make_pair(nullptr, 0));
+    std::size_t peakPages = 0;
+
+    auto start = bench::Clock::now();
+    for (std::size_t i = 0; i < steps; ++i)
+    {
+        const std::size_t p = percent(rng);
+        if (p < 2 && secrets.size() < maxSecrets)
+        {
+            const std::size_t size = 1 + percent(rng) % (2 * segmentSize);
+            secrets.emplace_back(alloc.allocate(size), size);
+        }
+        else
+        {
+            auto& slot = transients[slotDist(rng)];
+            if (slot.first)
+                alloc.deallocate(slot.first, slot.second);
+            slot.second = (p < 70) ? smallSize(rng) : mediumSize(rng);
+            slot.first = alloc.allocate(slot.second);
+        }
+        peakPages = std::max(peakPages, alloc.getNumberOfManagedAllocatedPages() +
+                                          alloc.getNumberOfSparePages());
+    }
+    const double seconds = bench::secondsSince(start);
+
+    for (auto& slot : transients)
+    {
+        if (slot.first)
+            alloc.deallocate(slot.first, slot.second);
+    }
+    const std::size_t pinnedPages =
+      alloc.getNumberOfManagedAllocatedPages() + alloc.getNumberOfSparePages();
+    for (auto& secret : secrets)
+        alloc.deallocate(secret.first, secret.second);
+
+    std::string name = sizeClasses ? "size classes" : "first fit";
+    if (sparePages)
+        name += " + " + std::to_string(sparePages) + " spares";
+    bench::report(name, steps, seconds);
+    bench::reportValue(name + ": peak locked pages", static_cast<double>(peakPages), "pages");
+    bench::reportValue(name + ": locked pages after", static_cast<double>(pinnedPages),
+                       "pages");
+}
+
+template <typename Allocator>
+void runContention(const char* name)
+{
+    for (auto numThreads : bench::threadCounts())
+    {
+        Allocator alloc;
+        double seconds = bench::runThreads(
+          numThreads, [&alloc](std::size_t index) { allocFreeWorker(alloc, index); });
+        bench::report(std::string(name) + ", " + std::to_string(numThreads) + " thread(s)",
+                      numThreads * opsPerThread, seconds);
+    }
+}
+
+/// Runs the allocate/deallocate workload with 1 to 64 threads (independent of the number of CPUs)
+template <typename Allocator>
+void runScaling(const char* name, Allocator& alloc)
+{
+    constexpr std::size_t ops = 50000;
+    for (std::size_t numThreads = 1; numThreads <= 64; numThreads *= 2)
+    {
+        double seconds = bench::runThreads(numThreads, [&alloc](std::size_t index) {
+            allocFreeWorker(alloc, index, ops);
+        });
+        bench::report(std::string(name) + ", " + std::to_string(numThreads) + " thread(s)",
+                      numThreads * ops, seconds);
+    }
+}
+
+/// All threads wait until every thread has arrived (spinning)
+class SpinBarrier
+{
+public:
+    explicit SpinBarrier(std::size_t count) : m_count(count), m_waiting(0), m_generation(0) {}
+
+    void wait()
+    {
+        const std::size_t generation = m_generation.load();
+        if (++m_waiting == m_count)
+        {
+            m_waiting = 0;
+            ++m_generation;
+        }
+        else
+        {
+            while (m_generation.load() == generation)
+                std::this_thread::yield();
+        }
+    }
+
+private:
+    const std::size_t m_count;
+    std::atomic<std::size_t> m_waiting;
+    std::atomic<std::size_t> m_generation;
+};
+
+/**
+ * Like runScaling(), but every thread releases the allocations of its neighbour (like a pipeline
+ * of worker threads), so all frees are cross-thread (and usually cross-shard). Each round, the
+ * threads allocate a batch, wait for each other and release the neighbour's batch.
+ */
+template <typename Allocator>
+void runCrossThreadScaling(const char* name, Allocator& alloc)
+{
+    constexpr std::size_t rounds = 200;
+    constexpr std::size_t batchSize = liveAllocations;
+    using Batch = std::vector<std::pair<void*, std::size_t>>;
+    for (std::size_t numThreads = 2; numThreads <= 64; numThreads *= 2)
+    {
+        // two batches per thread: one is filled while the neighbour releases the other one
+        std::vector<std::array<Batch, 2>> batches(numThreads);
+        SpinBarrier barrier(numThreads);
+        double seconds = bench::runThreads(numThreads, [&](std::size_t index) {
+            std::size_t size = 1 + index * 7;
+            for (std::size_t round = 0; round < rounds; ++round)
+            {
+                Batch& batch = batches[index][round % 2];
+                batch.clear();
+                for (std::size_t i = 0; i < batchSize; ++i)
+                {
+                    size = (size * 37 + 11) % (8 * 64) + 1;
+                    batch.emplace_back(alloc.allocate(size), size);
+                }
+                barrier.wait();
+                for (auto& entry : batches[(index + 1) % numThreads][round % 2])
+                    alloc.deallocate(entry.first, entry.second);
+            }
+        });
+        // deferred frees are part of the work
+        auto start = bench::Clock::now();
+        alloc.flushRemoteFrees();
+        seconds += bench::secondsSince(start);
+        bench::report(std::string(name) + ", " + std::to_string(numThreads) + " thread(s)",
+                      numThreads * rounds * batchSize, seconds);
+    }
+}
+
+/**
+ * Allocates and releases many small areas (like loading a credential store), one by one or at
+ * once. Other threads do the same, so the mutex is contended.
+ */
+void bulkAllocation(bool bulk)
+{
+    constexpr std::size_t numThreads = 4;
+    constexpr std::size_t rounds = 50;
+    constexpr std::size_t count = 5000;
+
+    // keep the pages around, so that we measure the allocator and not the OS
+    spsl::SensitivePageAllocator alloc;
+    alloc.setSparePageLimits(2048, 2048);
+
+    double seconds = bench::runThreads(numThreads, [&alloc, bulk](std::size_t index) {
+        std::vector<std::size_t> sizes(count);
+        for (std::size_t i = 0; i < count; ++i)
+            sizes[i] = 1 + (i * 37 + index) % 128;
+        std::vector<void*> addrs(count);
+        for (std::size_t round = 0; round < rounds; ++round)
+        {
+            if (bulk)
+            {
+                alloc.allocate_bulk(sizes.data(), addrs.data(), count);
+                alloc.deallocate_bulk(addrs.data(), sizes.data(), count);
+            }
+            else
+            {
+                for (std::size_t i = 0; i < count; ++i)
+                    addrs[i] = alloc.allocate(sizes[i]);
+                for (std::size_t i = 0; i < count; ++i)
+                    alloc.deallocate(addrs[i], sizes[i]);
+            }
+        }
+    });
+    bench::report(std::string(bulk ? "allocate_bulk" : "one by one") + ", " +
+                    std::to_string(numThreads) + " threads",
+                  numThreads * rounds * count, seconds);
+}
+
+/**
+ * Destroys an allocator that still holds many pages (like a process exiting with a credential
+ * cache), half of them in use and half of them spare pages.
+ */
+void teardown(std::size_t regionSize)
+{
+    constexpr std::size_t rounds = 10;
+    constexpr std::size_t pages = 4096;
+
+    double seconds = 0.0;
+    for (std::size_t round = 0; round < rounds; ++round)
+    {
+        std::unique_ptr<spsl::SensitivePageAllocator> alloc(new spsl::SensitivePageAllocator());
+        alloc->setLeakCallback(nullptr);
+        alloc->setRegionSize(regionSize);
+        alloc->setSparePageLimits(pages, pages);
+        const std::size_t size = alloc->chunk_size * alloc->getChunksPerPage();
+        std::vector<void*> allocations(pages);
+        for (auto& mem : allocations)
+            mem = alloc->allocate(size);
+        for (std::size_t i = 0; i < pages; i += 2)
+            alloc->deallocate(allocations[i], size);
+
+        auto start = bench::Clock::now();
+        alloc.reset();
+        seconds += bench::secondsSince(start);
+    }
+    bench::report("region size " + std::to_string(regionSize) + ", per page", rounds * pages,
+                  seconds);
+}
+} // namespace
+
+BENCHMARK("pagealloc: allocate/deallocate contention")
+{
+    runContention<spsl::SensitivePageAllocator>("SensitivePageAllocator");
+    runContention<spsl::ConcurrentSensitivePageAllocator>("ConcurrentSensitivePageAllocator");
+}
+
+BENCHMARK("pagealloc: page churn")
+{
+    pageChurn(1);
+    pageChurn(64);
+}
+
+BENCHMARK("pagealloc: mixed workload")
+{
+    // note: chunks become completely free more often with size classes, so spare pages help
+    mixedWorkload(false, 0);
+    mixedWorkload(true, 0);
+    mixedWorkload(true, 16);
+}
+
+BENCHMARK("pagealloc: sharded scaling")
+{
+    spsl::SensitivePageAllocator single;
+    runScaling("single instance", single);
+
+    spsl::ShardedSensitivePageAllocator sharded;
+    const std::string name = std::to_string(sharded.getNumberOfShards()) + " shards by CPU";
+    runScaling(name.c_str(), sharded);
+
+    // releasing memory of other threads (and shards)
+    runCrossThreadScaling("single instance, cross-thread frees", single);
+    runCrossThreadScaling((name + ", cross-thread frees").c_str(), sharded);
+}
+
+BENCHMARK("pagealloc: bulk allocation")
+{
+    bulkAllocation(false);
+    bulkAllocation(true);
+}
+
+BENCHMARK("pagealloc: teardown")
+{
+    teardown(1);
+    teardown(64);
+}
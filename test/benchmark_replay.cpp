@@ -0,0 +1,483 @@
+/**
+ * @file    Special Purpose Strings Library: benchmark_replay.cpp
+ * @author  Daniel Evers
+ * @brief   Replays allocation traces against the page allocators and std::allocator
+ * @license MIT
+ *
+ * Usage: replay [trace file ...]
+ *
+ * The trace files are written by SensitivePageAllocator::dumpTrace(). Without arguments,
+ * synthetic traces of a password store and of a session workload are replayed.
+ *
+ * Each trace is replayed (single-threaded, in the recorded order) twice per allocator: Once to
+ * measure the throughput and once to measure the latency of each operation and to sample the
+ * number of locked pages. Note that the latencies include the overhead of reading the clock.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "benchmark.hpp"
+
+#include "spsl/alloctrace.hpp"
+#include "spsl/pagealloc.hpp"
+#include "spsl/pagealloc_concurrent.hpp"
+#include "spsl/pagealloc_sharded.hpp"
+
+namespace
+{
+
+using spsl::AllocationTraceRecord;
+using spsl::TraceOperation;
+
+/// a trace operation, with the handle replaced by an index into the table of live allocations
+struct Operation
+{
+    TraceOperation op;
+    std::size_t slot;
+    std::size_t size;
+    std::size_t alignment;
+};
+
+/// a trace prepared for replaying
+struct Replay
+{
+    std::vector<Operation> ops;
+    std::size_t numSlots;
+};
+
+/**
+ * Maps the handles to slots, so that no lookups are required while replaying. Deallocations and
+ * expansions of unknown handles (e.g. if records were dropped) are skipped.
+ */
+Replay prepare(const std::vector<AllocationTraceRecord>& records)
+{
+    Replay replay{ {}, 0 };
+    replay.ops.reserve(records.size());
+    std::unordered_map<uint64_t, std::size_t> live;
+    for (const auto& r : records)
+    {
+        const std::size_t size = static_cast<std::size_t>(r.size);
+        if (r.op == TraceOperation::allocate)
+        {
+            live[r.handle] = replay.numSlots;
+            replay.ops.push_back(Operation{ r.op, replay.numSlots++, size, r.alignment });
+            continue;
+        }
+
+        auto it = live.find(r.handle);
+        if (it == live.end())
+            continue;
+        replay.ops.push_back(Operation{ r.op, it->second, size, r.alignment });
+        if (r.op == TraceOperation::deallocate)
+            live.erase(it);
+    }
+    return replay;
+}
+
+
+/// Builds synthetic traces
+class TraceBuilder
+{
+public:
+    uint64_t allocate(std::size_t size, std::size_t alignment = 0)
+    {
+        add(TraceOperation::allocate, ++m_handle, size, alignment);
+        return m_handle;
+    }
+    void deallocate(uint64_t handle, std::size_t size, std::size_t alignment = 0)
+    {
+        add(TraceOperation::deallocate, handle, size, alignment);
+    }
+    void expand(uint64_t handle, std::size_t newSize)
+    {
+        add(TraceOperation::expand, handle, newSize, 0);
+    }
+
+    std::vector<AllocationTraceRecord>& records() { return m_records; }
+
+private:
+    void add(TraceOperation op, uint64_t handle, std::size_t size, std::size_t alignment)
+    {
+        AllocationTraceRecord r{};
+        r.timestamp = m_records.size();
+        r.handle = handle;
+        r.size = size;
+        r.thread = 1;
+        r.alignment = static_cast<uint32_t>(alignment);
+        r.op = op;
+        m_records.push_back(r);
+    }
+
+    uint64_t m_handle = 0;
+    std::vector<AllocationTraceRecord> m_records;
+};
+
+/**
+ * A password store: Entries (name, user name, password and sometimes notes) are loaded, looked
+ * up (which copies the password temporarily), updated, added and removed. Finally, the store is
+ * closed.
+ */
+std::vector<AllocationTraceRecord> passwordStoreTrace()
+{
+    constexpr std::size_t initialEntries = 2000;
+    constexpr std::size_t steps = 50000;
+
+    struct Field
+    {
+        uint64_t handle;
+        std::size_t size;
+    };
+    using Entry = std::vector<Field>;
+
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<std::size_t> percent(0, 99);
+    std::uniform_int_distribution<std::size_t> nameSize(8, 32);
+    std::uniform_int_distribution<std::size_t> passwordSize(12, 40);
+    std::uniform_int_distribution<std::size_t> notesSize(100, 600);
+    std::uniform_int_distribution<std::size_t> bufferSize(64, 256);
+
+    TraceBuilder trace;
+    auto field = [&trace](std::size_t size) { return Field{ trace.allocate(size), size }; };
+    auto addEntry = [&]() {
+        Entry entry{ field(nameSize(rng)), field(nameSize(rng)), field(passwordSize(rng)) };
+        if (percent(rng) < 10)
+            entry.push_back(field(notesSize(rng)));
+        return entry;
+    };
+    auto removeEntry = [&trace](Entry& entry) {
+        for (auto& f : entry)
+            trace.deallocate(f.handle, f.size);
+    };
+
+    std::vector<Entry> entries;
+    for (std::size_t i = 0; i < initialEntries; ++i)
+        entries.push_back(addEntry());
+
+    for (std::size_t i = 0; i < steps; ++i)
+    {
+        const std::size_t p = percent(rng);
+        const std::size_t index = std::uniform_int_distribution<std::size_t>(
+          0, entries.size() - 1)(rng);
+        Entry& entry = entries[index];
+        if (p < 70)
+        {
+            // lookup: decrypt into a buffer, copy the password
+            const std::size_t size = bufferSize(rng);
+            const uint64_t buffer = trace.allocate(size);
+            const Field copy = field(entry[2].size);
+            trace.deallocate(buffer, size);
+            trace.deallocate(copy.handle, copy.size);
+        }
+        else if (p < 90)
+        {
+            // update the password
+            trace.deallocate(entry[2].handle, entry[2].size);
+            entry[2] = field(passwordSize(rng));
+        }
+        else if (p < 95)
+        {
+            entries.push_back(addEntry());
+        }
+        else if (entries.size() > 1)
+        {
+            removeEntry(entry);
+            if (&entry != &entries.back())
+                entry = std::move(entries.back());
+            entries.pop_back();
+        }
+    }
+
+    for (auto& entry : entries)
+        removeEntry(entry);
+    return std::move(trace.records());
+}
+
+/**
+ * A server with sessions: Each session has a token, an aligned key and a receive buffer that
+ * grows with the messages. Requests allocate short-lived message buffers.
+ */
+std::vector<AllocationTraceRecord> sessionTrace()
+{
+    constexpr std::size_t maxSessions = 1000;
+    constexpr std::size_t steps = 100000;
+    constexpr std::size_t maxBufferSize = 4096;
+
+    struct Session
+    {
+        uint64_t token;
+        uint64_t key;
+        uint64_t buffer;
+        std::size_t bufferSize;
+    };
+
+    std::mt19937 rng(4711);
+    std::uniform_int_distribution<std::size_t> percent(0, 99);
+    std::uniform_int_distribution<std::size_t> messageSize(64, 2048);
+
+    TraceBuilder trace;
+    std::vector<Session> sessions;
+    auto close = [&trace](const Session& s) {
+        trace.deallocate(s.token, 48);
+        trace.deallocate(s.key, 32, 32);
+        trace.deallocate(s.buffer, s.bufferSize);
+    };
+
+    for (std::size_t i = 0; i < steps; ++i)
+    {
+        const std::size_t p = percent(rng);
+        if (sessions.empty() || (p < 10 && sessions.size() < maxSessions))
+        {
+            sessions.push_back(Session{ trace.allocate(48), trace.allocate(32, 32),
+                                        trace.allocate(256), 256 });
+            continue;
+        }
+
+        const std::size_t index = std::uniform_int_distribution<std::size_t>(
+          0, sessions.size() - 1)(rng);
+        Session& session = sessions[index];
+        if (p < 18)
+        {
+            close(session);
+            session = sessions.back();
+            sessions.pop_back();
+        }
+        else
+        {
+            // a request: grow the session's buffer if required, process a message
+            const std::size_t size = messageSize(rng);
+            if (size > session.bufferSize && session.bufferSize < maxBufferSize)
+            {
+                session.bufferSize = std::min(2 * session.bufferSize, maxBufferSize);
+                trace.expand(session.buffer, session.bufferSize);
+            }
+            const uint64_t message = trace.allocate(size);
+            trace.deallocate(message, size);
+        }
+    }
+
+    for (auto& session : sessions)
+        close(session);
+    return std::move(trace.records());
+}
+
+
+/// std::allocator with the interface of the page allocators (alignments are ignored)
+struct StdAllocator
+{
+    void* allocate(std::size_t size, std::size_t /*alignment*/)
+    {
+        return std::allocator<char>().allocate(size);
+    }
+    void deallocate(void* addr, std::size_t size, std::size_t /*alignment*/)
+    {
+        std::allocator<char>().deallocate(static_cast<char*>(addr), size);
+    }
+    bool try_expand(void* /*addr*/, std::size_t /*oldSize*/, std::size_t /*newSize*/)
+    {
+        return false;
+    }
+};
+
+// The number of locked pages and system calls, if known (-1 otherwise)
+
+template <typename Allocator>
+int64_t lockedPages(Allocator& /*alloc*/)
+{
+    return -1;
+}
+template <typename Allocator>
+int64_t systemCalls(Allocator& /*alloc*/)
+{
+    return -1;
+}
+
+int64_t lockedPages(spsl::SensitivePageAllocator& alloc)
+{
+    return static_cast<int64_t>(alloc.getStatistics().lockedBytes / alloc.getPageSize());
+}
+int64_t systemCalls(spsl::SensitivePageAllocator& alloc)
+{
+    return static_cast<int64_t>(alloc.getStatistics().systemCalls);
+}
+// note: unmanaged areas aren't counted
+int64_t lockedPages(spsl::ConcurrentSensitivePageAllocator& alloc)
+{
+    return static_cast<int64_t>(alloc.getNumberOfManagedAllocatedPages());
+}
+int64_t lockedPages(spsl::ShardedSensitivePageAllocator& alloc)
+{
+    int64_t pages = 0;
+    for (std::size_t i = 0; i < alloc.getNumberOfShards(); ++i)
+        pages += lockedPages(alloc.getShard(i));
+    return pages;
+}
+int64_t systemCalls(spsl::ShardedSensitivePageAllocator& alloc)
+{
+    int64_t calls = 0;
+    for (std::size_t i = 0; i < alloc.getNumberOfShards(); ++i)
+        calls += systemCalls(alloc.getShard(i));
+    return calls;
+}
+
+
+/// a live allocation while replaying
+struct Slot
+{
+    void* addr;
+    std::size_t size;
+    std::size_t alignment;
+};
+
+/// Replays a single operation
+template <typename Allocator>
+inline void replayOperation(Allocator& alloc, const Operation& op, Slot& slot)
+{
+    switch (op.op)
+    {
+    case TraceOperation::allocate:
+        slot.addr = alloc.allocate(op.size, op.alignment ? op.alignment : 1);
+        slot.size = op.size;
+        slot.alignment = op.alignment ? op.alignment : 1;
+        static_cast<char*>(slot.addr)[0] = 1;
+        break;
+    case TraceOperation::deallocate:
+        alloc.deallocate(slot.addr, slot.size, slot.alignment);
+        slot.addr = nullptr;
+        break;
+    case TraceOperation::expand:
+        if (!alloc.try_expand(slot.addr, slot.size, op.size))
+        {
+            // what a string or a vector does
+            void* addr = alloc.allocate(op.size, slot.alignment);
+            std::memcpy(addr, slot.addr, std::min(slot.size, op.size));
+            alloc.deallocate(slot.addr, slot.size, slot.alignment);
+            slot.addr = addr;
+        }
+        slot.size = op.size;
+        break;
+    }
+}
+
+/// Releases the allocations that were still live at the end of the trace
+template <typename Allocator>
+void releaseSlots(Allocator& alloc, std::vector<Slot>& slots)
+{
+    for (auto& slot : slots)
+    {
+        if (slot.addr)
+            alloc.deallocate(slot.addr, slot.size, slot.alignment);
+        slot.addr = nullptr;
+    }
+}
+
+/// Replays a trace using a new instance of @c Allocator and prints the results
+template <typename Allocator>
+void replay(const std::string& name, const Replay& trace,
+            const std::function<void(Allocator&)>& configure = nullptr)
+{
+    std::vector<Slot> slots(trace.numSlots, Slot{ nullptr, 0, 0 });
+
+    // 1. throughput
+    {
+        std::unique_ptr<Allocator> alloc(new Allocator());
+        if (configure)
+            configure(*alloc);
+        auto start = bench::Clock::now();
+        for (const auto& op : trace.ops)
+            replayOperation(*alloc, op, slots[op.slot]);
+        const double seconds = bench::secondsSince(start);
+        const int64_t calls = systemCalls(*alloc);
+        releaseSlots(*alloc, slots);
+
+        bench::report(name, trace.ops.size(), seconds);
+        if (calls >= 0)
+            bench::reportValue(name + ": system calls", static_cast<double>(calls), "calls");
+    }
+
+    // 2. latencies and locked pages
+    std::vector<double> latencies[3];
+    for (auto& l : latencies)
+        l.reserve(trace.ops.size());
+    int64_t peakPages = -1;
+    {
+        std::unique_ptr<Allocator> alloc(new Allocator());
+        if (configure)
+            configure(*alloc);
+        for (const auto& op : trace.ops)
+        {
+            auto start = bench::Clock::now();
+            replayOperation(*alloc, op, slots[op.slot]);
+            auto end = bench::Clock::now();
+            latencies[static_cast<std::size_t>(op.op)].push_back(
+              std::chrono::duration<double, std::nano>(end - start).count());
+            peakPages = std::max(peakPages, lockedPages(*alloc));
+        }
+        releaseSlots(*alloc, slots);
+    }
+    static const char* const opNames[] = { ": allocate", ": deallocate", ": expand" };
+    for (std::size_t i = 0; i < 3; ++i)
+        bench::reportLatencies(name + opNames[i], latencies[i]);
+    if (peakPages >= 0)
+        bench::reportValue(name + ": peak locked pages", static_cast<double>(peakPages), "pages");
+}
+
+/// Replays a trace against all allocators
+void replayAll(const std::string& traceName, const std::vector<AllocationTraceRecord>& records)
+{
+    const Replay trace = prepare(records);
+    std::printf("%s: %zu operations, %zu allocations\n", traceName.c_str(), trace.ops.size(),
+                trace.numSlots);
+
+    replay<spsl::SensitivePageAllocator>("SensitivePageAllocator", trace);
+    replay<spsl::SensitivePageAllocator>(
+      "SensitivePageAllocator (tuned)", trace, [](spsl::SensitivePageAllocator& alloc) {
+          alloc.setSizeClasses(true);
+          alloc.setSparePageLimits(8, 16);
+          alloc.setRegionSize(64);
+          alloc.setThreadCacheSize(16);
+      });
+    replay<spsl::ConcurrentSensitivePageAllocator>("ConcurrentSensitivePageAllocator", trace);
+    replay<spsl::ShardedSensitivePageAllocator>("ShardedSensitivePageAllocator", trace);
+    replay<StdAllocator>("std::allocator", trace);
+}
+} // namespace
+
+int main(int argc, const char** argv)
+{
+    if (argc < 2)
+    {
+        replayAll("synthetic password store", passwordStoreTrace());
+        replayAll("synthetic sessions", sessionTrace());
+        return 0;
+    }
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::ifstream file(argv[i]);
+        if (!file)
+        {
+            std::fprintf(stderr, "cannot open %s\n", argv[i]);
+            return 1;
+        }
+        try
+        {
+            replayAll(argv[i], spsl::readTrace(file));
+        }
+        catch (const std::exception& e)
+        {
+            std::fprintf(stderr, "%s: %s\n", argv[i], e.what());
+            return 1;
+        }
+    }
+    return 0;
+}
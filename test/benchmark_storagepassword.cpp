@@ -0,0 +1,120 @@
+/**
+ * @file    Special Purpose Strings Library: benchmark_storagepassword.cpp
+ * @author  Daniel Evers
+ * @brief   Benchmarks for the password storage
+ * @license MIT
+ */
+
+#include <string>
+#include <vector>
+
+#include "benchmark.hpp"
+
+#include "spsl/storage_password.hpp"
+
+namespace
+{
+
+/**
+ * Builds secrets of @c size characters by appending pieces of 64 characters (e.g. reading a PEM
+ * key line by line) and reports the time per appended piece and the throughput.
+ */
+template <typename GrowthPolicy>
+void appendSecret(const char* name, std::size_t size)
+{
+    using StorageType =
+      spsl::StoragePassword<char, 128, spsl::SensitiveSegmentAllocator<char>, 0, GrowthPolicy>;
+    constexpr std::size_t pieceSize = 64;
+    // about 4 MB per measurement, but at least one secret
+    const std::size_t rounds = std::max<std::size_t>(1, (4u << 20) / size);
+
+    const std::vector<char> piece(pieceSize, 'x');
+    std::size_t pieces = 0;
+    auto start = bench::Clock::now();
+    for (std::size_t round = 0; round < rounds; ++round)
+    {
+        StorageType s;
+        while (s.size() < size)
+        {
+            s.append(piece.data(), pieceSize);
+            ++pieces;
+        }
+        bench::doNotOptimize(s.data()[0]);
+    }
+    const double seconds = bench::secondsSince(start);
+
+    const std::string label = std::string(name) + ", " + std::to_string(size >> 10) + " KB";
+    bench::report(label, pieces, seconds);
+    bench::reportValue(label + ": throughput",
+                       static_cast<double>(pieces * pieceSize) / (seconds * (1 << 20)), "MB/s");
+}
+
+/// the previous secure_memzero() implementation, for comparison
+void wipeBytewise(void* ptr, std::size_t size)
+{
+    volatile char* p = static_cast<char*>(ptr);
+    while (size--)
+        *p++ = 0;
+}
+
+/// Wipes a buffer of @c size bytes over and over again and reports the throughput
+template <typename Wipe>
+void wipeBuffer(const char* name, std::size_t size, Wipe wipe)
+{
+    // about 1 GB per measurement
+    const std::size_t rounds = (1u << 30) / size;
+    std::vector<char> buffer(size, 'x');
+
+    auto start = bench::Clock::now();
+    for (std::size_t round = 0; round < rounds; ++round)
+        wipe(buffer.data(), size);
+    const double seconds = bench::secondsSince(start);
+
+    const std::string label = std::string(name) + ", " + std::to_string(size) + " bytes";
+    bench::report(label, rounds, seconds);
+    bench::reportValue(label + ": throughput",
+                       static_cast<double>(rounds * size) / (seconds * (1 << 20)), "MB/s");
+}
+
+/// Reserves a buffer of @c capacity characters, but only uses a short string before clearing it
+void clearReserved(std::size_t capacity)
+{
+    constexpr std::size_t rounds = 100000;
+    const std::string secret = "a short secret";
+
+    spsl::StoragePassword<char> s;
+    s.reserve(capacity);
+    auto start = bench::Clock::now();
+    for (std::size_t round = 0; round < rounds; ++round)
+    {
+        s.assign(secret.data(), secret.size());
+        s.clear();
+    }
+    const double seconds = bench::secondsSince(start);
+    bench::report("capacity " + std::to_string(capacity) + ", assign + clear", rounds, seconds);
+}
+} // namespace
+
+BENCHMARK("storage_password: wipe throughput")
+{
+    for (std::size_t size = 64; size <= 64u << 10; size <<= 2)
+    {
+        wipeBuffer("byte by byte", size, wipeBytewise);
+        wipeBuffer("secure_memzero", size, spsl::secure_memzero);
+    }
+}
+
+BENCHMARK("storage_password: append throughput")
+{
+    for (std::size_t size = 1u << 10; size <= 1u << 20; size <<= 2)
+    {
+        appendSecret<spsl::policy::growth::FixedBlocks>("fixed blocks", size);
+        appendSecret<spsl::policy::growth::Geometric>("geometric", size);
+    }
+}
+
+BENCHMARK("storage_password: clear reserved buffer")
+{
+    for (std::size_t capacity = 128; capacity <= 64u << 10; capacity <<= 3)
+        clearReserved(capacity);
+}
@@ -0,0 +1,114 @@
+/**
+ * @file    Special Purpose Strings Library: test_memory_resource.cpp
+ * @author  Daniel Evers
+ * @brief   Unit tests for the memory resource (C++17)
+ * @license MIT
+ */
+
+#include "catch.hpp"
+
+#include "spsl/memory_resource.hpp"
+#include "spsl/pagealloc_sharded.hpp"
+
+#ifdef SPSL_HAS_MEMORY_RESOURCE
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace
+{
+bool isAligned(const void* p, std::size_t alignment)
+{
+    return reinterpret_cast<std::uintptr_t>(p) % alignment == 0;
+}
+} // namespace
+
+// use the resource with standard containers
+TEST_CASE("MemoryResourceContainerTest", "[memory_resource]")
+{
+    spsl::SensitivePageAllocator alloc;
+    spsl::sensitive_memory_resource resource(alloc);
+    REQUIRE(resource.pageAllocator() == &alloc);
+    {
+        std::pmr::vector<std::byte> key(32, std::byte{ 0x42 }, &resource);
+        std::pmr::string secret("a secret that is too long for the small string buffer",
+                                &resource);
+        REQUIRE(alloc.owns(key.data()));
+        REQUIRE(alloc.owns(secret.data()));
+        REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 1u);
+
+        // a large one
+        key.resize(3 * alloc.getPageSize());
+        REQUIRE(alloc.owns(key.data()));
+        REQUIRE(alloc.getNumberOfUnmanagedAreas() == 1u);
+    }
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+    REQUIRE(alloc.getNumberOfUnmanagedAreas() == 0u);
+
+    // other page allocators
+    spsl::ShardedSensitivePageAllocator sharded(2);
+    spsl::basic_sensitive_memory_resource<spsl::ShardedSensitivePageAllocator> shardedResource(
+      sharded);
+    {
+        std::pmr::vector<int> values(100, 1, &shardedResource);
+        REQUIRE(sharded.getNumberOfManagedAllocatedPages() == 1u);
+    }
+    sharded.flushRemoteFrees();
+    REQUIRE(sharded.getNumberOfManagedAllocatedPages() == 0u);
+}
+
+// alignment requests
+TEST_CASE("MemoryResourceAlignmentTest", "[memory_resource]")
+{
+    spsl::SensitivePageAllocator alloc;
+    spsl::sensitive_memory_resource resource(alloc);
+    const std::size_t maxAlignment = resource.max_alignment();
+    REQUIRE(maxAlignment >= 4096u);
+
+    std::vector<std::pair<void*, std::size_t>> allocations;
+    for (std::size_t alignment = 1; alignment <= maxAlignment; alignment *= 2)
+    {
+        // allocate a small area first, so that the next one doesn't start a page "by chance"
+        void* small = resource.allocate(8, 1);
+        void* p = resource.allocate(100, alignment);
+        REQUIRE(isAligned(p, alignment));
+        REQUIRE(alloc.owns(p));
+        allocations.emplace_back(p, alignment);
+        resource.deallocate(small, 8, 1);
+    }
+    REQUIRE_THROWS_AS(resource.allocate(100, 2 * maxAlignment), std::bad_alloc);
+
+    for (auto& entry : allocations)
+        resource.deallocate(entry.first, 100, entry.second);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+    REQUIRE(alloc.getNumberOfUnmanagedAreas() == 0u);
+
+    // empty allocations work, too
+    void* p = resource.allocate(0, 8);
+    REQUIRE(p != nullptr);
+    resource.deallocate(p, 0, 8);
+}
+
+// resources are equal if they use the same page allocator
+TEST_CASE("MemoryResourceEqualityTest", "[memory_resource]")
+{
+    spsl::SensitivePageAllocator alloc;
+    spsl::sensitive_memory_resource r1(alloc);
+    spsl::sensitive_memory_resource r2(alloc);
+    spsl::sensitive_memory_resource r3;
+
+    REQUIRE(r1 == r2);
+    REQUIRE(r1 != r3);
+    REQUIRE(r1 != *std::pmr::new_delete_resource());
+    REQUIRE(r3 == *spsl::sensitive_memory_resource::getDefaultInstance());
+    REQUIRE(spsl::sensitive_memory_resource::getDefaultInstance()->pageAllocator() ==
+            &spsl::SensitivePageAllocator::getDefaultInstance());
+
+    // memory of one instance can be released by the other one
+    void* p = r1.allocate(64);
+    r2.deallocate(p, 64);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+}
+
+#endif /* SPSL_HAS_MEMORY_RESOURCE */
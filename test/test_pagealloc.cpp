@@ -6,6 +6,15 @@
  */
 
 #include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "catch.hpp"
 
@@ -54,6 +63,45 @@ TEST_CASE("BitMask tests", "[allocator]")
     REQUIRE(spsl::SensitivePageAllocator::getBitmask(64) == all64);
 }
 
+// test the bit scan helpers
+TEST_CASE("BitScan tests", "[allocator]")
+{
+    auto all64 = spsl::SensitivePageAllocator::all64;
+    REQUIRE(spsl::bits::countTrailingZeros(0) == 64u);
+    REQUIRE(spsl::bits::countTrailingZeros(1) == 0u);
+    REQUIRE(spsl::bits::countTrailingZeros(0x80) == 7u);
+    REQUIRE(spsl::bits::countTrailingZeros(all64 << 63) == 63u);
+
+    using Alloc = spsl::SensitivePageAllocator;
+    REQUIRE(Alloc::findFreeRange(all64, 1) == 0u);
+    REQUIRE(Alloc::findFreeRange(all64, 64) == 0u);
+    REQUIRE(Alloc::findFreeRange(0, 1) == 64u);
+    REQUIRE(Alloc::findFreeRange(all64 << 1, 64) == 64u);
+    REQUIRE(Alloc::findFreeRange(all64 << 1, 63) == 1u);
+    REQUIRE(Alloc::findFreeRange(0xf0f0, 4) == 4u);
+    REQUIRE(Alloc::findFreeRange(0xf0f0, 5) == 64u);
+    REQUIRE(Alloc::findFreeRange(0xff00f0, 5) == 16u);
+    REQUIRE(Alloc::findFreeRange(0x8000000000000000, 1) == 63u);
+
+    REQUIRE(Alloc::findFreeAlignedRange(all64, 1, 1) == 0u);
+    REQUIRE(Alloc::findFreeAlignedRange(all64, 64, 64) == 0u);
+    REQUIRE(Alloc::findFreeAlignedRange(all64 << 1, 1, 2) == 2u);
+    REQUIRE(Alloc::findFreeAlignedRange(all64 << 1, 63, 2) == 64u);
+    REQUIRE(Alloc::findFreeAlignedRange(all64 << 1, 62, 2) == 2u);
+    REQUIRE(Alloc::findFreeAlignedRange(0xf0f0, 4, 4) == 4u);
+    REQUIRE(Alloc::findFreeAlignedRange(0xf0f0, 4, 8) == 64u);
+    REQUIRE(Alloc::findFreeAlignedRange(0xfff0f0, 4, 8) == 16u);
+    REQUIRE(Alloc::findFreeAlignedRange(0x8000000000000000, 1, 64) == 64u);
+
+    REQUIRE(Alloc::largestFreeRange(0) == 0u);
+    REQUIRE(Alloc::largestFreeRange(all64) == 64u);
+    REQUIRE(Alloc::largestFreeRange(all64 << 1) == 63u);
+    REQUIRE(Alloc::largestFreeRange(all64 >> 1) == 63u);
+    REQUIRE(Alloc::largestFreeRange(0xf0f0) == 4u);
+    REQUIRE(Alloc::largestFreeRange(0xff00f0) == 8u);
+    REQUIRE(Alloc::largestFreeRange(0x8000000000000001) == 1u);
+}
+
 // allocate a segment
 TEST_CASE("ManagedAllocationTest1", "[allocator]")
 {
@@ -301,4 +349,1262 @@ TEST_CASE("LeakCheckTest2", "[allocator]")
     REQUIRE(cbLeaks[5].size == 64u);
 }
 
+// full and fragmented chunks are skipped
+TEST_CASE("FragmentedAllocationTest", "[allocator]")
+{
+    spsl::SensitivePageAllocator alloc;
+    const std::size_t segmentSize = alloc.segment_size;
+
+    // fill 3 pages with single segments
+    AllocationList allocations;
+    for (std::size_t i = 0; i < 3 * alloc.segmentsPerChunk; ++i)
+        allocations.emplace_back(alloc.allocate(segmentSize), segmentSize);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 3u);
+
+    // free every other segment of the 1st page and 4 contiguous ones in the 2nd
+    for (std::size_t i = 0; i < alloc.segmentsPerChunk; i += 2)
+        alloc.deallocate(allocations[i].addr, segmentSize);
+    for (std::size_t i = 64 + 10; i < 64 + 14; ++i)
+        alloc.deallocate(allocations[i].addr, segmentSize);
+
+    // a 4-segment allocation must use the gap in the 2nd page
+    void* mem = alloc.allocate(4 * segmentSize);
+    REQUIRE(mem == allocations[64 + 10].addr);
+    // a 2-segment allocation doesn't fit anywhere
+    void* mem2 = alloc.allocate(2 * segmentSize);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 4u);
+    // single segments fill the gaps of the 1st page
+    void* mem3 = alloc.allocate(segmentSize);
+    REQUIRE(mem3 == allocations[0].addr);
+
+    alloc.deallocate(mem, 4 * segmentSize);
+    alloc.deallocate(mem2, 2 * segmentSize);
+    alloc.deallocate(mem3, segmentSize);
+    for (std::size_t i = 1; i < alloc.segmentsPerChunk; i += 2)
+        alloc.deallocate(allocations[i].addr, segmentSize);
+    for (std::size_t i = 64; i < allocations.size(); ++i)
+    {
+        if (i < 64 + 10 || i >= 64 + 14)
+            alloc.deallocate(allocations[i].addr, segmentSize);
+    }
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+}
+
+// use pages that consist of multiple chunks
+TEST_CASE("MultiChunkPageTest", "[allocator]")
+{
+    spsl::SensitivePageAllocator alloc(4 * spsl::SensitivePageAllocator::chunk_size);
+    REQUIRE(alloc.getChunksPerPage() == 4u);
+    const std::size_t chunkSize = alloc.chunk_size;
+    const std::size_t segmentSize = alloc.segment_size;
+
+    // fill 3 pages with 1-segment and 64-segment allocations
+    AllocationList allocations;
+    for (std::size_t i = 0; i < 3 * 4; ++i)
+    {
+        allocations.emplace_back(alloc.allocate(chunkSize), chunkSize);
+        REQUIRE(alloc.getNumberOfManagedAllocatedPages() == i / 4 + 1);
+    }
+    for (std::size_t i = 0; i < 3 * alloc.segmentsPerChunk; ++i)
+        allocations.emplace_back(alloc.allocate(segmentSize), segmentSize);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 4u);
+
+    // release them in a "random" order - the pages are released when they become empty
+    std::reverse(allocations.begin(), allocations.end());
+    std::rotate(allocations.begin(), allocations.begin() + 77, allocations.end());
+    for (std::size_t i = 0; i < allocations.size(); i += 2)
+        alloc.deallocate(allocations[i].addr, allocations[i].size);
+    for (std::size_t i = 1; i < allocations.size(); i += 2)
+        alloc.deallocate(allocations[i].addr, allocations[i].size);
+
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+}
+
+// retain free pages as spare pages
+TEST_CASE("SparePageTest", "[allocator]")
+{
+    spsl::SensitivePageAllocator alloc;
+    const std::size_t chunkSize = alloc.chunk_size;
+    REQUIRE(alloc.getNumberOfSparePages() == 0u);
+    alloc.setSparePageLimits(1, 3);
+
+    // a free page is kept and reused
+    void* mem = alloc.allocate(64);
+    alloc.deallocate(mem, 64);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+    REQUIRE(alloc.getNumberOfSparePages() == 1u);
+    REQUIRE(alloc.allocate(64) == mem);
+    REQUIRE(alloc.getNumberOfSparePages() == 0u);
+    alloc.deallocate(mem, 64);
+
+    // up to 3 pages are kept, then we go down to 1
+    AllocationList allocations;
+    for (std::size_t i = 0; i < 4; ++i)
+        allocations.emplace_back(alloc.allocate(chunkSize), chunkSize);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 4u);
+    REQUIRE(alloc.getNumberOfSparePages() == 0u);
+    for (std::size_t i = 0; i < 3; ++i)
+    {
+        alloc.deallocate(allocations[i].addr, allocations[i].size);
+        REQUIRE(alloc.getNumberOfSparePages() == i + 1);
+    }
+    alloc.deallocate(allocations[3].addr, allocations[3].size);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+    REQUIRE(alloc.getNumberOfSparePages() == 1u);
+
+    // release them explicitly
+    REQUIRE(alloc.releaseUnused() == 1u);
+    REQUIRE(alloc.getNumberOfSparePages() == 0u);
+    REQUIRE(alloc.releaseUnused() == 0u);
+
+    // lowering the limits releases spare pages immediately
+    allocations.clear();
+    for (std::size_t i = 0; i < 3; ++i)
+        allocations.emplace_back(alloc.allocate(chunkSize), chunkSize);
+    for (auto& entry : allocations)
+        alloc.deallocate(entry.addr, entry.size);
+    REQUIRE(alloc.getNumberOfSparePages() == 3u);
+    alloc.setSparePageLimits(0, 2);
+    REQUIRE(alloc.getNumberOfSparePages() == 0u);
+
+}
+
+// allocate and lock spare pages upfront
+TEST_CASE("PrewarmTest", "[allocator]")
+{
+    spsl::SensitivePageAllocator alloc;
+    const std::size_t pageSize = alloc.getPageSize();
+
+    // note: this may fail if RLIMIT_MEMLOCK is really low
+    REQUIRE(alloc.prewarm(3) == 3u);
+    REQUIRE(alloc.getNumberOfSparePages() == 3u);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+    REQUIRE(alloc.prewarm(2) == 3u);
+    REQUIRE(alloc.reserve(0) == 3 * pageSize);
+    REQUIRE(alloc.reserve(3 * pageSize + 1) == 4 * pageSize);
+
+    // allocations use the spare pages - which are kept afterwards
+    AllocationList allocations;
+    for (std::size_t i = 0; i < 4; ++i)
+    {
+        allocations.emplace_back(alloc.allocate(pageSize), pageSize);
+        REQUIRE(alloc.getNumberOfSparePages() == 3 - i);
+    }
+    for (auto& entry : allocations)
+        alloc.deallocate(entry.addr, entry.size);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+    REQUIRE(alloc.getNumberOfSparePages() == 4u);
+
+    REQUIRE(alloc.releaseUnused() == 4u);
+}
+
+// spare pages aren't reported as leaks
+TEST_CASE("SparePageLeakCheckTest", "[allocator]")
+{
+    bool leaks = false;
+    {
+        spsl::SensitivePageAllocator alloc;
+        alloc.setLeakCallback([&](const spsl::SensitivePageAllocator*,
+                                  const spsl::SensitivePageAllocator::AllocationInfo&,
+                                  bool) { leaks = true; });
+        alloc.setSparePageLimits(2, 2);
+
+        void* mem = alloc.allocate(64);
+        alloc.deallocate(mem, 64);
+        REQUIRE(alloc.getNumberOfSparePages() == 1u);
+    }
+    REQUIRE_FALSE(leaks);
+}
+
+// allocate and deallocate using the per-thread caches
+TEST_CASE("ThreadCacheTest", "[allocator]")
+{
+    spsl::SensitivePageAllocator alloc;
+    REQUIRE(alloc.getThreadCacheSize() == 0u);
+    alloc.setThreadCacheSize(8);
+    REQUIRE(alloc.getThreadCacheSize() == 8u);
+
+    // a cache miss reserves a batch of segments
+    void* mem1 = alloc.allocate(32);
+    REQUIRE(mem1 != nullptr);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 1u);
+    void* mem2 = alloc.allocate(64);
+    REQUIRE(mem2 != nullptr);
+    REQUIRE(mem2 != mem1);
+
+    // the freed segments are kept in the cache and reused
+    alloc.deallocate(mem2, 64);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 1u);
+    REQUIRE(alloc.allocate(64) == mem2);
+    alloc.deallocate(mem2, 64);
+    alloc.deallocate(mem1, 32);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 1u);
+
+    // larger allocations aren't cached
+    const std::size_t largeSize =
+      (spsl::SensitivePageAllocator::threadCacheMaxSegments + 1) * alloc.segment_size;
+    void* mem3 = alloc.allocate(largeSize);
+    REQUIRE(mem3 != nullptr);
+    alloc.deallocate(mem3, largeSize);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 1u);
+
+    // flushing returns everything
+    alloc.flushThreadCache();
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+
+    // overflowing the cache drains it
+    AllocationList allocations;
+    for (std::size_t i = 0; i < 32; ++i)
+        allocations.emplace_back(alloc.allocate(64), 64);
+    for (auto& entry : allocations)
+        alloc.deallocate(entry.addr, entry.size);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 1u);
+
+    // disabling the cache doesn't release the cached segments
+    alloc.setThreadCacheSize(0);
+    void* mem4 = alloc.allocate(64);
+    alloc.deallocate(mem4, 64);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 1u);
+    alloc.flushThreadCache();
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+}
+
+// the thread caches are returned when the threads exit
+TEST_CASE("ThreadCacheMultiThreadTest", "[allocator]")
+{
+    spsl::SensitivePageAllocator alloc;
+    alloc.setThreadCacheSize(16);
+
+    constexpr std::size_t numThreads = 8;
+    constexpr std::size_t numAllocations = 200;
+    // note: Catch isn't thread-safe, so we collect the results
+    std::atomic<bool> contentOk{ true };
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < numThreads; ++t)
+    {
+        threads.emplace_back([&alloc, &contentOk, t]() {
+            AllocationList allocations;
+            for (std::size_t round = 0; round < 10; ++round)
+            {
+                for (std::size_t i = 0; i < numAllocations; ++i)
+                {
+                    const std::size_t size = 1 + (i + t) % (16 * alloc.segment_size);
+                    void* mem = alloc.allocate(size);
+                    // touch the memory - must not overlap with other threads
+                    std::fill_n(static_cast<char*>(mem), size, static_cast<char>(t));
+                    allocations.emplace_back(mem, size);
+                }
+                for (auto& entry : allocations)
+                {
+                    const char* p = static_cast<const char*>(entry.addr);
+                    if (std::count(p, p + entry.size, static_cast<char>(t)) !=
+                        static_cast<std::ptrdiff_t>(entry.size))
+                        contentOk = false;
+                    alloc.deallocate(entry.addr, entry.size);
+                }
+                allocations.clear();
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    REQUIRE(contentOk);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+}
+
+// threads may exit while the allocator is being destroyed
+TEST_CASE("ThreadCacheDestructionRaceTest", "[allocator]")
+{
+    constexpr std::size_t numThreads = 4;
+    for (std::size_t round = 0; round < 20; ++round)
+    {
+        std::unique_ptr<spsl::SensitivePageAllocator> alloc(new spsl::SensitivePageAllocator);
+        alloc->setThreadCacheSize(4);
+
+        std::atomic<std::size_t> ready{ 0 };
+        std::atomic<bool> exit{ false };
+        std::vector<std::thread> threads;
+        for (std::size_t t = 0; t < numThreads; ++t)
+        {
+            threads.emplace_back([&]() {
+                // leaves the segment in the thread's cache
+                void* mem = alloc->allocate(64);
+                alloc->deallocate(mem, 64);
+                ++ready;
+                while (!exit)
+                    std::this_thread::yield();
+            });
+        }
+        while (ready != numThreads)
+            std::this_thread::yield();
+
+        // the threads detach their caches while the allocator takes them back
+        exit = true;
+        alloc.reset();
+        for (auto& thread : threads)
+            thread.join();
+    }
+}
+
+// cached segments aren't reported as leaks
+TEST_CASE("ThreadCacheLeakCheckTest", "[allocator]")
+{
+    AllocationList cbLeaks;
+    void* leak = nullptr;
+    {
+        spsl::SensitivePageAllocator alloc;
+        alloc.setLeakCallback([&](const spsl::SensitivePageAllocator*,
+                                  const spsl::SensitivePageAllocator::AllocationInfo& info,
+                                  bool) { cbLeaks.push_back(info); });
+        alloc.setThreadCacheSize(4);
+
+        void* mem = alloc.allocate(64);
+        leak = alloc.allocate(64);
+        alloc.deallocate(mem, 64);
+
+        // the thread cache keeps more allocations
+        REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 1u);
+    }
+
+    REQUIRE(cbLeaks.size() == 1u);
+    REQUIRE(cbLeaks[0].addr == leak);
+    REQUIRE(cbLeaks[0].size == 64u);
+}
+
+// check the statistics
+TEST_CASE("StatisticsTest", "[allocator]")
+{
+    spsl::SensitivePageAllocator alloc;
+    const std::size_t pageSize = alloc.getPageSize();
+    const std::size_t pageSegments = alloc.getChunksPerPage() * alloc.segmentsPerChunk;
+
+    auto stats = alloc.getStatistics();
+    REQUIRE(stats.allocations[1] == 0u);
+    REQUIRE(stats.bytesRequested == 0u);
+    REQUIRE(stats.lockedBytes == 0u);
+    REQUIRE(stats.pagesCreated == 0u);
+    REQUIRE(stats.fragmentation == 0.0);
+
+    void* mem1 = alloc.allocate(10);
+    void* mem2 = alloc.allocate(100);
+    void* mem3 = alloc.allocate(pageSize + 1);
+
+    stats = alloc.getStatistics();
+    REQUIRE(stats.allocations[0] == 1u);
+    REQUIRE(stats.allocations[1] == 1u);
+    REQUIRE(stats.allocations[2] == 1u);
+    REQUIRE(stats.deallocations[1] == 0u);
+    REQUIRE(stats.bytesRequested == 10 + 100 + pageSize + 1);
+    REQUIRE(stats.bytesReserved == 64 + 128 + 2 * pageSize);
+    REQUIRE(stats.lockedBytes == 3 * pageSize);
+    REQUIRE(stats.pagesCreated == 3u);
+    REQUIRE(stats.pagesReleased == 0u);
+    // allocate, lock and exclude from core dumps
+    REQUIRE(stats.systemCalls == 2 * 3u);
+    REQUIRE(stats.managedPages == 1u);
+    REQUIRE(stats.unmanagedAreas == 1u);
+    REQUIRE(stats.fragmentation ==
+            Approx(static_cast<double>(pageSegments - 3) / static_cast<double>(pageSegments)));
+
+    alloc.deallocate(mem1, 10);
+    alloc.deallocate(mem2, 100);
+    alloc.deallocate(mem3, pageSize + 1);
+
+    stats = alloc.getStatistics();
+    REQUIRE(stats.deallocations[0] == 1u);
+    REQUIRE(stats.deallocations[1] == 1u);
+    REQUIRE(stats.deallocations[2] == 1u);
+    REQUIRE(stats.bytesRequested == 0u);
+    REQUIRE(stats.bytesReserved == 0u);
+    REQUIRE(stats.lockedBytes == 0u);
+    REQUIRE(stats.pagesReleased == 3u);
+    REQUIRE(stats.systemCalls == 4 * 3u);
+    REQUIRE(stats.managedPages == 0u);
+    REQUIRE(stats.unmanagedAreas == 0u);
+    REQUIRE(stats.fragmentation == 0.0);
+
+    // spare pages are still locked
+    REQUIRE(alloc.prewarm(2) == 2u);
+    stats = alloc.getStatistics();
+    REQUIRE(stats.sparePages == 2u);
+    REQUIRE(stats.lockedBytes == 2 * pageSize);
+    alloc.releaseUnused();
+    REQUIRE(alloc.getStatistics().lockedBytes == 0u);
+}
+
+// the thread caches report their statistics when they take the lock
+TEST_CASE("ThreadCacheStatisticsTest", "[allocator]")
+{
+    spsl::SensitivePageAllocator alloc;
+    alloc.setThreadCacheSize(4);
+
+    AllocationList allocations;
+    for (std::size_t i = 0; i < 10; ++i)
+        allocations.emplace_back(alloc.allocate(100), 100);
+    for (auto& entry : allocations)
+        alloc.deallocate(entry.addr, entry.size);
+    alloc.flushThreadCache();
+
+    auto stats = alloc.getStatistics();
+    REQUIRE(stats.allocations[2] == 10u);
+    REQUIRE(stats.deallocations[2] == 10u);
+    REQUIRE(stats.bytesRequested == 0u);
+    REQUIRE(stats.bytesReserved == 0u);
+    REQUIRE(stats.managedPages == 0u);
+}
+
+// grow allocations in place
+TEST_CASE("TryExpandTest", "[allocator]")
+{
+    spsl::SensitivePageAllocator alloc;
+    const std::size_t chunkSize = alloc.chunk_size;
+    const std::size_t pageSize = alloc.getPageSize();
+
+    char* mem1 = static_cast<char*>(alloc.allocate(64));
+    char* mem2 = static_cast<char*>(alloc.allocate(64));
+    REQUIRE(mem2 == mem1 + 64);
+
+    // the same number of segments always works
+    REQUIRE(alloc.try_expand(mem2, 64, 60));
+    // the following segments are free
+    REQUIRE(alloc.try_expand(mem2, 60, 3 * 64));
+    REQUIRE(alloc.allocate(64) == mem1 + 4 * 64);
+    alloc.deallocate(mem1 + 4 * 64, 64);
+    // mem2 is in the way
+    REQUIRE_FALSE(alloc.try_expand(mem1, 64, 65));
+    // allocations don't shrink
+    REQUIRE_FALSE(alloc.try_expand(mem2, 3 * 64, 64));
+    // the end of the chunk is reached
+    REQUIRE_FALSE(alloc.try_expand(mem2, 3 * 64, chunkSize));
+    REQUIRE(alloc.try_expand(mem2, 3 * 64, chunkSize - 64));
+    // unmanaged areas can't grow
+    void* mem3 = alloc.allocate(pageSize + 1);
+    REQUIRE_FALSE(alloc.try_expand(mem3, pageSize + 1, pageSize + 2));
+    alloc.deallocate(mem3, pageSize + 1);
+    // unknown addresses
+    char buffer[64];
+    REQUIRE_FALSE(alloc.try_expand(buffer, 64, 128));
+
+    auto stats = alloc.getStatistics();
+    REQUIRE(stats.bytesReserved == chunkSize);
+    REQUIRE(stats.bytesRequested == 64 + chunkSize - 64);
+
+    alloc.deallocate(mem1, 64);
+    alloc.deallocate(mem2, chunkSize - 64);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+    stats = alloc.getStatistics();
+    REQUIRE(stats.bytesReserved == 0u);
+    REQUIRE(stats.bytesRequested == 0u);
+}
+
+// take pages from larger regions
+TEST_CASE("RegionTest", "[allocator]")
+{
+    spsl::SensitivePageAllocator alloc;
+    const std::size_t pageSize = alloc.getPageSize();
+    const std::size_t chunkSize = alloc.chunk_size;
+    REQUIRE(alloc.getRegionSize() == 1u);
+    alloc.setRegionSize(8);
+    REQUIRE(alloc.getRegionSize() == 8u);
+
+    // allocate 9 pages
+    AllocationList allocations;
+    for (std::size_t i = 0; i < 9 * alloc.getChunksPerPage(); ++i)
+        allocations.emplace_back(alloc.allocate(chunkSize), chunkSize);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 9u);
+
+    auto stats = alloc.getStatistics();
+    REQUIRE(stats.regions == 2u);
+    REQUIRE(stats.pagesCreated == 16u);
+    REQUIRE(stats.lockedBytes == 16 * pageSize);
+
+    // the pages of the first region are contiguous
+    for (std::size_t i = 1; i < 8; ++i)
+    {
+        char* prev = static_cast<char*>(allocations[(i - 1) * alloc.getChunksPerPage()].addr);
+        REQUIRE(allocations[i * alloc.getChunksPerPage()].addr == prev + pageSize);
+    }
+
+    // free everything: one region is kept
+    for (auto& entry : allocations)
+        alloc.deallocate(entry.addr, entry.size);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+    stats = alloc.getStatistics();
+    REQUIRE(stats.regions == 1u);
+    REQUIRE(stats.pagesReleased == 8u);
+    REQUIRE(stats.lockedBytes == 8 * pageSize);
+
+    // which is reused
+    void* mem = alloc.allocate(64);
+    REQUIRE(alloc.getStatistics().regions == 1u);
+    REQUIRE(alloc.getStatistics().pagesCreated == 16u);
+    alloc.deallocate(mem, 64);
+
+    alloc.releaseUnused();
+    stats = alloc.getStatistics();
+    REQUIRE(stats.regions == 0u);
+    REQUIRE(stats.lockedBytes == 0u);
+    REQUIRE(stats.pagesReleased == 16u);
+}
+
+// regions combined with spare pages and leaks
+TEST_CASE("RegionLeakCheckTest", "[allocator]")
+{
+    AllocationList cbLeaks;
+    void* leak = nullptr;
+    {
+        spsl::SensitivePageAllocator alloc;
+        alloc.setLeakCallback([&](const spsl::SensitivePageAllocator*,
+                                  const spsl::SensitivePageAllocator::AllocationInfo& info,
+                                  bool) { cbLeaks.push_back(info); });
+        alloc.setRegionSize(4);
+        REQUIRE(alloc.prewarm(2) == 2u);
+        REQUIRE(alloc.getStatistics().regions == 1u);
+
+        leak = alloc.allocate(128);
+        REQUIRE(alloc.getNumberOfSparePages() == 1u);
+    }
+
+    REQUIRE(cbLeaks.size() == 1u);
+    REQUIRE(cbLeaks[0].addr == leak);
+    REQUIRE(cbLeaks[0].size == 128u);
+}
+
+// memory obtained from and returned to the OS is reported
+TEST_CASE("MemoryMapCallbackTest", "[allocator]")
+{
+    using Alloc = spsl::SensitivePageAllocator;
+    std::map<void*, std::size_t> mapped;
+    bool ok = true;
+    {
+        Alloc alloc;
+        const std::size_t pageSize = alloc.getPageSize();
+        alloc.setLeakCallback(nullptr);
+        alloc.setMemoryMapCallback([&](const Alloc*, const Alloc::AllocationInfo& area, bool map) {
+            if (map)
+                ok = ok && mapped.emplace(area.addr, area.size).second;
+            else
+                ok = ok && mapped.erase(area.addr) == 1;
+        });
+        auto mappedBytes = [&]() {
+            std::size_t bytes = 0;
+            for (auto& area : mapped)
+                bytes += area.second;
+            return bytes;
+        };
+
+        // a page and an unmanaged area
+        void* mem1 = alloc.allocate(64);
+        void* mem2 = alloc.allocate(2 * pageSize);
+        REQUIRE(mapped.size() == 2u);
+        REQUIRE(mapped.count(mem2) == 1u);
+        REQUIRE(mapped[mem2] == 2 * pageSize);
+        REQUIRE(mappedBytes() == alloc.getStatistics().lockedBytes);
+        alloc.deallocate(mem2, 2 * pageSize);
+        REQUIRE(mapped.size() == 1u);
+
+        // a region
+        alloc.setRegionSize(4);
+        std::vector<void*> pages;
+        for (std::size_t i = 0; i < 2 * alloc.getChunksPerPage(); ++i)
+            pages.push_back(alloc.allocate(alloc.chunk_size));
+        REQUIRE(mapped.size() == 2u);
+        REQUIRE(mappedBytes() == alloc.getStatistics().lockedBytes);
+        for (void* page : pages)
+            alloc.deallocate(page, alloc.chunk_size);
+        alloc.releaseUnused();
+        REQUIRE(mapped.size() == 1u);
+
+        // the leaked page is released by the destructor
+        (void)mem1;
+    }
+    REQUIRE(ok);
+    REQUIRE(mapped.empty());
+}
+
+// leaks of full chunks and all kinds of pages at once
+TEST_CASE("LeakCheckTest3", "[allocator]")
+{
+    using Alloc = spsl::SensitivePageAllocator;
+    AllocationList cbLeaks;
+    AllocationList myLeaks;
+    {
+        Alloc alloc;
+        alloc.setLeakCallback([&](const Alloc*, const Alloc::AllocationInfo& info, bool) {
+            cbLeaks.push_back(info);
+        });
+        const std::size_t pageSize = alloc.getPageSize();
+        alloc.setSparePageLimits(2, 4);
+        alloc.setUnmanagedRetentionLimit(8);
+
+        // a full chunk, a segment in the middle and the last segment of a chunk
+        myLeaks.emplace_back(alloc.allocate(Alloc::chunk_size), Alloc::chunk_size);
+        void* mem = alloc.allocate((Alloc::segmentsPerChunk - 1) * Alloc::segment_size);
+        void* last = alloc.allocate(10);
+        alloc.deallocate(mem, (Alloc::segmentsPerChunk - 1) * Alloc::segment_size);
+        mem = alloc.allocate(100);
+        myLeaks.emplace_back(alloc.allocate(10), Alloc::segment_size);
+        myLeaks.emplace_back(last, Alloc::segment_size);
+        alloc.deallocate(mem, 100);
+
+        // spare pages, retained and used unmanaged areas
+        AllocationList pages;
+        for (std::size_t i = 0; i < 3; ++i)
+            pages.emplace_back(alloc.allocate(Alloc::chunk_size), Alloc::chunk_size);
+        for (auto& page : pages)
+            alloc.deallocate(page.addr, page.size);
+        mem = alloc.allocate(2 * pageSize);
+        alloc.deallocate(mem, 2 * pageSize);
+        myLeaks.emplace_back(alloc.allocate(3 * pageSize), 3 * pageSize);
+        REQUIRE(alloc.getNumberOfSparePages() != 0u);
+        REQUIRE(alloc.getStatistics().retainedUnmanagedPages == 2u);
+    }
+
+    REQUIRE(cbLeaks.size() == myLeaks.size());
+    for (std::size_t i = 0; i < cbLeaks.size(); ++i)
+    {
+        REQUIRE(cbLeaks[i].addr == myLeaks[i].addr);
+        REQUIRE(cbLeaks[i].size == myLeaks[i].size);
+    }
+}
+
+// size classes
+TEST_CASE("SizeClassTest", "[allocator]")
+{
+    using Alloc = spsl::SensitivePageAllocator;
+    REQUIRE(Alloc::getSizeClass(1) == 1u);
+    REQUIRE(Alloc::getSizeClass(2) == 2u);
+    REQUIRE(Alloc::getSizeClass(3) == 3u);
+    REQUIRE(Alloc::getSizeClass(4) == 3u);
+    REQUIRE(Alloc::getSizeClass(5) == 4u);
+    REQUIRE(Alloc::getSizeClass(8) == 4u);
+    REQUIRE(Alloc::getSizeClass(9) == 5u);
+    REQUIRE(Alloc::getSizeClass(16) == 5u);
+    REQUIRE(Alloc::getSizeClass(17) == 6u);
+    REQUIRE(Alloc::getSizeClass(64) == 6u);
+
+    // use pages with 4 chunks
+    const std::size_t chunkSize = Alloc::chunk_size;
+    Alloc alloc(4 * chunkSize);
+    REQUIRE(alloc.getSizeClasses() == false);
+    alloc.setSizeClasses(true);
+    REQUIRE(alloc.getSizeClasses() == true);
+
+    auto chunkOf = [&](void* p) {
+        return static_cast<std::size_t>(reinterpret_cast<std::uintptr_t>(p) / chunkSize);
+    };
+
+    // different classes use different chunks
+    void* small1 = alloc.allocate(64);
+    void* medium = alloc.allocate(20 * 64);
+    void* small2 = alloc.allocate(2 * 64);
+    void* small3 = alloc.allocate(64);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 1u);
+    REQUIRE(chunkOf(small1) != chunkOf(medium));
+    REQUIRE(chunkOf(small1) != chunkOf(small2));
+    REQUIRE(chunkOf(medium) != chunkOf(small2));
+    // same class, same chunk
+    REQUIRE(chunkOf(small1) == chunkOf(small3));
+
+    // a completely free chunk can be used by any class
+    alloc.deallocate(small1, 64);
+    alloc.deallocate(small3, 64);
+    void* small4 = alloc.allocate(4 * 64);
+    REQUIRE(small4 == small1);
+
+    alloc.deallocate(medium, 20 * 64);
+    alloc.deallocate(small4, 4 * 64);
+    alloc.deallocate(small2, 2 * 64);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+
+    // without size classes, everything is mixed
+    alloc.setSizeClasses(false);
+    small1 = alloc.allocate(64);
+    medium = alloc.allocate(20 * 64);
+    REQUIRE(chunkOf(small1) == chunkOf(medium));
+    alloc.deallocate(small1, 64);
+    alloc.deallocate(medium, 20 * 64);
+}
+
+// smaller segments
+TEST_CASE("SegmentGeometryTest", "[allocator]")
+{
+    using Alloc = spsl::BasicSensitivePageAllocator<16>;
+    const std::size_t segmentSize = Alloc::segment_size;
+    const std::size_t chunkSize = Alloc::chunk_size;
+    REQUIRE(segmentSize == 16u);
+    REQUIRE(chunkSize == 1024u);
+    REQUIRE(Alloc::calcSegmentCount(17) == 2u);
+
+    Alloc alloc;
+    REQUIRE(alloc.getChunksPerPage() == alloc.getPageSize() / 1024);
+
+    // a PIN only occupies a single 16 byte segment
+    char* pin1 = static_cast<char*>(alloc.allocate(6));
+    char* pin2 = static_cast<char*>(alloc.allocate(6));
+    REQUIRE(pin2 == pin1 + 16);
+    REQUIRE(alloc.getStatistics().bytesReserved == 32u);
+
+    // a full chunk and a chunk + 1 byte (which takes 2 chunks of the page)
+    void* mem1 = alloc.allocate(chunkSize);
+    void* mem2 = alloc.allocate(chunkSize + 1);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 1u);
+    REQUIRE(alloc.getNumberOfUnmanagedAreas() == 0u);
+
+    alloc.deallocate(pin1, 6);
+    alloc.deallocate(pin2, 6);
+    alloc.deallocate(mem1, chunkSize);
+    alloc.deallocate(mem2, chunkSize + 1);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+}
+
+// size classes combined with allocations larger than a chunk: chunks dedicated to a size class
+// aren't free anymore
+TEST_CASE("SizeClassMultiChunkTest", "[allocator]")
+{
+    {
+        using Alloc = spsl::SensitivePageAllocator;
+        const std::size_t chunkSize = Alloc::chunk_size;
+        Alloc alloc(4 * chunkSize);
+        alloc.setSizeClasses(true);
+
+        char* small = static_cast<char*>(alloc.allocate(64));
+        char* large = static_cast<char*>(alloc.allocate(chunkSize + 1));
+        REQUIRE((large >= small + chunkSize || large + 2 * chunkSize <= small));
+        void* small2 = alloc.allocate(3 * 64);
+        REQUIRE((small2 < large || small2 >= large + 2 * chunkSize));
+
+        alloc.deallocate(small, 64);
+        alloc.deallocate(small2, 3 * 64);
+        alloc.deallocate(large, chunkSize + 1);
+        REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+    }
+    {
+        // 1K chunks in 4K pages
+        using Alloc = spsl::BasicSensitivePageAllocator<16>;
+        Alloc alloc;
+        alloc.setSizeClasses(true);
+
+        char* small = static_cast<char*>(alloc.allocate(16));
+        char* large = static_cast<char*>(alloc.allocate(2048));
+        REQUIRE((large >= small + Alloc::chunk_size || large + 2048 <= small));
+
+        alloc.deallocate(small, 16);
+        alloc.deallocate(large, 2048);
+        REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+    }
+}
+
+// allocations larger than a chunk within larger pages
+TEST_CASE("MultiChunkAllocationTest", "[allocator]")
+{
+    using Alloc = spsl::SensitivePageAllocator;
+    const std::size_t chunkSize = Alloc::chunk_size;
+    AllocationList cbLeaks;
+    void* leak = nullptr;
+    {
+        // use pages with 16 chunks
+        Alloc alloc(16 * chunkSize);
+        alloc.setLeakCallback([&](const Alloc*, const Alloc::AllocationInfo& info, bool) {
+            cbLeaks.push_back(info);
+        });
+
+        char* small = static_cast<char*>(alloc.allocate(64));
+        char* mem1 = static_cast<char*>(alloc.allocate(3 * chunkSize));
+        char* mem2 = static_cast<char*>(alloc.allocate(2 * chunkSize + 1));
+        REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 1u);
+        REQUIRE(alloc.getNumberOfUnmanagedAreas() == 0u);
+        // the chunks follow the one used by the small allocation
+        REQUIRE(mem1 == small + chunkSize);
+        REQUIRE(mem2 == mem1 + 3 * chunkSize);
+        REQUIRE(alloc.getStatistics().allocations[0] == 2u);
+        REQUIRE(alloc.getStatistics().bytesReserved == 64 + 6 * chunkSize);
+
+        // segments are never taken from reserved chunks
+        std::vector<void*> segments;
+        for (std::size_t i = 0; i < 63; ++i)
+            segments.push_back(alloc.allocate(64));
+        void* next = alloc.allocate(64);
+        REQUIRE(next == mem2 + 3 * chunkSize);
+        alloc.deallocate(next, 64);
+        for (void* mem : segments)
+            alloc.deallocate(mem, 64);
+
+        // a released range is reused
+        alloc.deallocate(mem1, 3 * chunkSize);
+        REQUIRE(alloc.allocate(2 * chunkSize) == mem1);
+        alloc.deallocate(mem1, 2 * chunkSize);
+
+        // if the page doesn't have enough contiguous free chunks, a new one is used
+        void* mem3 = alloc.allocate(14 * chunkSize);
+        REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 2u);
+        alloc.deallocate(mem3, 14 * chunkSize);
+        REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 1u);
+
+        // a complete page is still managed, but a byte more isn't
+        void* mem4 = alloc.allocate(16 * chunkSize);
+        void* mem5 = alloc.allocate(16 * chunkSize + 1);
+        REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 2u);
+        REQUIRE(alloc.getNumberOfUnmanagedAreas() == 1u);
+        alloc.deallocate(mem4, 16 * chunkSize);
+        alloc.deallocate(mem5, 16 * chunkSize + 1);
+
+        alloc.deallocate(small, 64);
+        leak = mem2;
+    }
+
+    // leaks are reported as a whole
+    REQUIRE(cbLeaks.size() == 1u);
+    REQUIRE(cbLeaks[0].addr == leak);
+    REQUIRE(cbLeaks[0].size == 3 * chunkSize);
+}
+
+// retain and reuse unmanaged areas
+TEST_CASE("UnmanagedRetentionTest", "[allocator]")
+{
+    spsl::SensitivePageAllocator alloc;
+    const std::size_t pageSize = alloc.getPageSize();
+    REQUIRE(alloc.getUnmanagedRetentionLimit() == 0u);
+
+    // by default, areas are released immediately
+    void* mem = alloc.allocate(2 * pageSize);
+    alloc.deallocate(mem, 2 * pageSize);
+    REQUIRE(alloc.getStatistics().retainedUnmanagedPages == 0u);
+    REQUIRE(alloc.getStatistics().pagesReleased == 2u);
+
+    alloc.setUnmanagedRetentionLimit(5);
+    REQUIRE(alloc.getUnmanagedRetentionLimit() == 5u);
+
+    void* mem1 = alloc.allocate(2 * pageSize);
+    void* mem2 = alloc.allocate(3 * pageSize);
+    void* mem3 = alloc.allocate(pageSize + 1);
+    REQUIRE(alloc.getNumberOfUnmanagedAreas() == 3u);
+    REQUIRE(alloc.getStatistics().pagesCreated == 9u);
+
+    // the first two areas are retained, the third one exceeds the limit
+    alloc.deallocate(mem1, 2 * pageSize);
+    alloc.deallocate(mem2, 3 * pageSize);
+    alloc.deallocate(mem3, pageSize + 1);
+    REQUIRE(alloc.getNumberOfUnmanagedAreas() == 0u);
+    REQUIRE(alloc.getStatistics().retainedUnmanagedPages == 5u);
+    REQUIRE(alloc.getStatistics().pagesReleased == 4u);
+
+    // areas are reused for the same number of pages
+    void* mem4 = alloc.allocate(3 * pageSize - 10);
+    REQUIRE(mem4 == mem2);
+    void* mem5 = alloc.allocate(4 * pageSize);
+    REQUIRE(alloc.getStatistics().pagesCreated == 13u);
+    REQUIRE(alloc.getStatistics().retainedUnmanagedPages == 2u);
+    alloc.deallocate(mem4, 3 * pageSize - 10);
+    alloc.deallocate(mem5, 4 * pageSize);
+    REQUIRE(alloc.getStatistics().retainedUnmanagedPages == 5u);
+
+    // lowering the limit releases the largest areas first
+    alloc.setUnmanagedRetentionLimit(2);
+    REQUIRE(alloc.getStatistics().retainedUnmanagedPages == 2u);
+    REQUIRE(alloc.releaseUnused() == 2u);
+    REQUIRE(alloc.getStatistics().retainedUnmanagedPages == 0u);
+    REQUIRE(alloc.getStatistics().pagesReleased == alloc.getStatistics().pagesCreated);
+}
+
+// deallocations without taking the mutex
+TEST_CASE("RemoteFreeTest", "[allocator]")
+{
+    AllocationList cbLeaks;
+    {
+        spsl::SensitivePageAllocator alloc;
+        alloc.setLeakCallback([&](const spsl::SensitivePageAllocator*,
+                                  const spsl::SensitivePageAllocator::AllocationInfo& info,
+                                  bool) { cbLeaks.push_back(info); });
+        const std::size_t pageSize = alloc.getPageSize();
+
+        // keeps the page allocated
+        void* mem0 = alloc.allocate(64);
+        void* mem1 = alloc.allocate(64);
+        void* mem2 = alloc.allocate(3 * 64);
+        void* mem3 = alloc.allocate(2 * pageSize);
+
+        // nothing is released until the next allocation
+        alloc.deallocateRemote(mem1, 64);
+        alloc.deallocateRemote(mem2, 3 * 64);
+        alloc.deallocateRemote(mem3, 2 * pageSize);
+        auto stats = alloc.getStatistics();
+        REQUIRE(stats.remoteFrees == 3u);
+        REQUIRE(stats.deallocations[1] == 0u);
+        REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 1u);
+        REQUIRE(alloc.getNumberOfUnmanagedAreas() == 1u);
+
+        void* mem4 = alloc.allocate(64);
+        REQUIRE(mem4 == mem1);
+        stats = alloc.getStatistics();
+        REQUIRE(stats.deallocations[1] == 1u);
+        REQUIRE(stats.deallocations[3] == 1u);
+        REQUIRE(stats.deallocations[0] == 1u);
+        REQUIRE(alloc.getNumberOfUnmanagedAreas() == 0u);
+
+        alloc.deallocateRemote(mem4, 64);
+        alloc.deallocate(mem0, 64);
+        REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 1u);
+        alloc.flushRemoteFrees();
+        REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+
+        // pending deallocations aren't leaks
+        alloc.deallocateRemote(alloc.allocate(100), 100);
+    }
+    REQUIRE(cbLeaks.empty());
+}
+
+// deallocate() doesn't wait for the mutex
+TEST_CASE("DeferContendedFreesTest", "[allocator]")
+{
+    spsl::SensitivePageAllocator alloc;
+    REQUIRE_FALSE(alloc.getDeferContendedFrees());
+    alloc.setDeferContendedFrees(true);
+    REQUIRE(alloc.getDeferContendedFrees());
+
+    // one thread allocates, the other one releases
+    constexpr std::size_t numAllocations = 20000;
+    std::vector<std::atomic<void*>> slots(numAllocations);
+    for (auto& slot : slots)
+        slot.store(nullptr);
+
+    std::thread producer([&]() {
+        for (auto& slot : slots)
+            slot.store(alloc.allocate(100));
+    });
+    std::thread consumer([&]() {
+        for (auto& slot : slots)
+        {
+            void* mem;
+            while ((mem = slot.load()) == nullptr)
+                std::this_thread::yield();
+            alloc.deallocate(mem, 100);
+        }
+    });
+    producer.join();
+    consumer.join();
+
+    alloc.flushRemoteFrees();
+    auto stats = alloc.getStatistics();
+    REQUIRE(stats.deallocations[2] == numAllocations);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+}
+
+// allocate and deallocate multiple ranges at once
+TEST_CASE("BulkAllocationTest", "[allocator]")
+{
+    spsl::SensitivePageAllocator alloc;
+    const std::size_t pageSize = alloc.getPageSize();
+
+    // segments and an unmanaged area
+    const std::array<std::size_t, 3> sizes{ { 10, 100, 2 * pageSize + 1 } };
+    std::array<void*, 3> addrs{};
+    alloc.allocate_bulk(sizes.data(), addrs.data(), sizes.size());
+    for (std::size_t i = 0; i < addrs.size(); ++i)
+    {
+        REQUIRE(addrs[i] != nullptr);
+        REQUIRE(alloc.owns(addrs[i]));
+        std::memset(addrs[i], 0xff, sizes[i]);
+    }
+    REQUIRE(alloc.getNumberOfUnmanagedAreas() == 1u);
+
+    auto stats = alloc.getStatistics();
+    REQUIRE(stats.allocations[1] == 1u);
+    REQUIRE(stats.allocations[2] == 1u);
+    REQUIRE(stats.allocations[0] == 1u);
+    REQUIRE(stats.bytesRequested == 10 + 100 + 2 * pageSize + 1);
+
+    // if one allocation fails, all others are released again
+    const std::array<std::size_t, 3> badSizes{ { 10, std::size_t(1) << 60, 10 } };
+    std::array<void*, 3> badAddrs{};
+    REQUIRE_THROWS_AS(alloc.allocate_bulk(badSizes.data(), badAddrs.data(), badSizes.size()),
+                      std::bad_alloc);
+    REQUIRE(alloc.getStatistics().bytesRequested == stats.bytesRequested);
+
+    alloc.deallocate_bulk(addrs.data(), sizes.data(), sizes.size());
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+    REQUIRE(alloc.getNumberOfUnmanagedAreas() == 0u);
+    REQUIRE(alloc.getStatistics().bytesRequested == 0u);
+
+    // nothing to do
+    alloc.allocate_bulk(nullptr, nullptr, 0);
+    alloc.deallocate_bulk(nullptr, nullptr, 0);
+
+    // the same using the segment allocator
+    spsl::SensitiveSegmentAllocator<wchar_t> segAlloc(alloc);
+    const std::array<std::size_t, 3> counts{ { 1, 20, 300 } };
+    std::array<wchar_t*, 3> arrays{};
+    segAlloc.allocate_bulk(counts.data(), arrays.data(), counts.size());
+    REQUIRE(alloc.getStatistics().bytesRequested == 321 * sizeof(wchar_t));
+    segAlloc.deallocate_bulk(arrays.data(), counts.data(), counts.size());
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+}
+
+// allocations with an alignment larger than the segment size
+TEST_CASE("AlignedAllocationTest", "[allocator]")
+{
+    auto isAligned = [](const void* p, std::size_t alignment) {
+        return reinterpret_cast<std::uintptr_t>(p) % alignment == 0;
+    };
+
+    spsl::SensitivePageAllocator alloc;
+    const std::size_t pageSize = alloc.getPageSize();
+    const std::size_t segmentSize = alloc.segment_size;
+    const std::size_t maxAlignment = alloc.getMaxAlignment();
+    REQUIRE(maxAlignment >= 4096u);
+
+    // the aligned range is taken from the same chunk
+    void* mem1 = alloc.allocate(10);
+    void* mem2 = alloc.allocate(100, 8 * segmentSize);
+    REQUIRE(isAligned(mem2, 8 * segmentSize));
+    REQUIRE(mem2 == static_cast<char*>(mem1) + 8 * segmentSize);
+    void* mem3 = alloc.allocate(3 * segmentSize, 4 * segmentSize);
+    REQUIRE(mem3 == static_cast<char*>(mem1) + 4 * segmentSize);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 1u);
+    // the gaps are still usable
+    void* mem4 = alloc.allocate(2 * segmentSize);
+    REQUIRE(mem4 == static_cast<char*>(mem1) + segmentSize);
+
+    // page alignment takes a free chunk (or a new page)
+    void* mem5 = alloc.allocate(10, maxAlignment);
+    REQUIRE(isAligned(mem5, maxAlignment));
+    REQUIRE(alloc.owns(mem5));
+
+    // unmanaged areas are page-aligned anyway
+    void* mem6 = alloc.allocate(2 * pageSize, maxAlignment);
+    REQUIRE(isAligned(mem6, maxAlignment));
+    REQUIRE(alloc.getNumberOfUnmanagedAreas() == 1u);
+
+    // small alignments are ignored
+    void* mem7 = alloc.allocate(10, 8);
+    REQUIRE(isAligned(mem7, segmentSize));
+
+    REQUIRE_THROWS_AS(alloc.allocate(10, 48), std::invalid_argument);
+    REQUIRE_THROWS_AS(alloc.allocate(10, 0), std::invalid_argument);
+    REQUIRE_THROWS_AS(alloc.allocate(10, 2 * maxAlignment), std::bad_alloc);
+
+    alloc.deallocate(mem1, 10);
+    alloc.deallocate(mem2, 100, 8 * segmentSize);
+    alloc.deallocate(mem3, 3 * segmentSize, 4 * segmentSize);
+    alloc.deallocate(mem4, 2 * segmentSize);
+    alloc.deallocate(mem5, 10, maxAlignment);
+    alloc.deallocate(mem6, 2 * pageSize, maxAlignment);
+    alloc.deallocate(mem7, 10, 8);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+    REQUIRE(alloc.getNumberOfUnmanagedAreas() == 0u);
+    REQUIRE(alloc.getStatistics().bytesRequested == 0u);
+}
+
+// alignments larger than the chunk size use aligned chunks
+TEST_CASE("AlignedChunkAllocationTest", "[allocator]")
+{
+    using Alloc = spsl::BasicSensitivePageAllocator<16>;
+    const std::size_t chunkSize = Alloc::chunk_size;
+    Alloc alloc;
+    const std::size_t maxAlignment = alloc.getMaxAlignment();
+    if (maxAlignment < 4 * chunkSize)
+        return;
+
+    // the first chunk is in use -> the third one
+    void* mem1 = alloc.allocate(10);
+    void* mem2 = alloc.allocate(chunkSize + 1, 2 * chunkSize);
+    REQUIRE(mem2 == static_cast<char*>(mem1) + 2 * chunkSize);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 1u);
+    // aligned to 4 chunks: only the first chunk of a page matches
+    void* mem3 = alloc.allocate(10, 4 * chunkSize);
+    REQUIRE(reinterpret_cast<std::uintptr_t>(mem3) % (4 * chunkSize) == 0u);
+    REQUIRE(alloc.getStatistics().bytesReserved == 16 + 3 * chunkSize);
+
+    alloc.deallocate(mem2, chunkSize + 1, 2 * chunkSize);
+    alloc.deallocate(mem3, 10, 4 * chunkSize);
+    REQUIRE(alloc.getStatistics().bytesReserved == 16u);
+    alloc.deallocate(mem1, 10);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+}
+
+// over-aligned types with the segment allocator
+TEST_CASE("AlignedSegmentAllocatorTest", "[allocator]")
+{
+    struct alignas(128) KeySchedule
+    {
+        unsigned char data[240];
+    };
+
+    spsl::SensitivePageAllocator alloc;
+    spsl::SensitiveSegmentAllocator<KeySchedule> segAlloc(alloc);
+    std::vector<KeySchedule*> keys;
+    for (std::size_t i = 0; i < 10; ++i)
+    {
+        keys.push_back(segAlloc.allocate(1));
+        REQUIRE(reinterpret_cast<std::uintptr_t>(keys.back()) % 128 == 0u);
+    }
+    for (auto key : keys)
+        segAlloc.deallocate(key, 1);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+
+    // bulk allocations are aligned, too
+    const std::size_t counts[] = { 1, 2, 1, 3 };
+    KeySchedule* bulk[4] = {};
+    segAlloc.allocate_bulk(counts, bulk, 4);
+    for (auto key : bulk)
+        REQUIRE(reinterpret_cast<std::uintptr_t>(key) % 128 == 0u);
+    // either way of releasing them matches the allocation
+    segAlloc.deallocate(bulk[0], 1);
+    segAlloc.deallocate_bulk(bulk + 1, counts + 1, 3);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+}
+
+namespace
+{
+/// a page allocator without the aligned overloads of allocate() and deallocate()
+struct UnalignedPageAllocator
+{
+    static constexpr std::size_t segment_size = 64;
+
+    void* allocate(std::size_t size) { return m_alloc.allocate(size); }
+    void deallocate(void* addr, std::size_t size) { m_alloc.deallocate(addr, size); }
+    std::size_t max_size() const { return m_alloc.max_size(); }
+
+    spsl::SensitivePageAllocator m_alloc;
+};
+} // namespace
+
+// the aligned overloads are only required for over-aligned types
+TEST_CASE("UnalignedPageAllocatorTest", "[allocator]")
+{
+    UnalignedPageAllocator alloc;
+    spsl::SensitiveSegmentAllocator<char, UnalignedPageAllocator> segAlloc(alloc);
+    char* mem = segAlloc.allocate(100);
+    REQUIRE(mem != nullptr);
+    segAlloc.deallocate(mem, 100);
+    REQUIRE(alloc.m_alloc.getNumberOfManagedAllocatedPages() == 0u);
+}
+
+// allocation tracing
+TEST_CASE("TraceTest", "[allocator]")
+{
+    using spsl::TraceOperation;
+    const std::size_t segmentSize = spsl::SensitivePageAllocator::segment_size;
+    spsl::SensitivePageAllocator alloc;
+    std::vector<spsl::AllocationTraceRecord> records;
+
+    // disabled by default
+    void* mem = alloc.allocate(10);
+    alloc.deallocate(mem, 10);
+    REQUIRE(!alloc.isTracing());
+    REQUIRE(alloc.drainTrace(records) == 0u);
+    REQUIRE(records.empty());
+
+    alloc.enableTracing(16);
+    REQUIRE(alloc.isTracing());
+    void* mem1 = alloc.allocate(10);
+    void* mem2 = alloc.allocate(3 * segmentSize);
+    REQUIRE(alloc.try_expand(mem2, 3 * segmentSize, 4 * segmentSize));
+    alloc.deallocate(mem1, 10);
+    alloc.deallocate(mem2, 4 * segmentSize);
+    alloc.disableTracing();
+    mem = alloc.allocate(10);
+    alloc.deallocate(mem, 10);
+
+    REQUIRE(alloc.drainTrace(records) == 0u);
+    REQUIRE(records.size() == 5u);
+    REQUIRE(records[0].op == TraceOperation::allocate);
+    REQUIRE(records[0].size == 10u);
+    REQUIRE(records[0].segments == 1u);
+    REQUIRE(records[1].segments == 3u);
+    REQUIRE(records[1].segment == 1u);
+    REQUIRE(records[2].op == TraceOperation::expand);
+    REQUIRE(records[2].size == 4 * segmentSize);
+    REQUIRE(records[3].op == TraceOperation::deallocate);
+    REQUIRE(records[4].op == TraceOperation::deallocate);
+    // allocations and deallocations can be matched, but the addresses aren't recorded
+    REQUIRE(records[0].handle == records[3].handle);
+    REQUIRE(records[1].handle == records[2].handle);
+    REQUIRE(records[1].handle == records[4].handle);
+    REQUIRE(records[0].handle != records[1].handle);
+    REQUIRE(records[0].handle != reinterpret_cast<std::uintptr_t>(mem1));
+    // the handles are a keyed hash: check the reference vector of SipHash-2-4 for 8 bytes
+    REQUIRE(spsl::detail::sipHash24(0x0706050403020100, 0x0706050403020100,
+                                    0x0f0e0d0c0b0a0908) == 0x93f5f5799a932462u);
+    for (std::size_t i = 1; i < records.size(); ++i)
+    {
+        REQUIRE(records[i].timestamp >= records[i - 1].timestamp);
+        REQUIRE(records[i].thread == records[0].thread);
+    }
+
+    // the buffer keeps the latest records
+    alloc.enableTracing();
+    for (std::size_t i = 0; i < 10; ++i)
+    {
+        mem = alloc.allocate(i + 1);
+        alloc.deallocate(mem, i + 1);
+    }
+    records.clear();
+    REQUIRE(alloc.drainTrace(records) == 4u);
+    REQUIRE(records.size() == 16u);
+    REQUIRE(records.back().size == 10u);
+
+    // text format
+    mem = alloc.allocate(100, 256);
+    alloc.deallocate(mem, 100, 256);
+    std::ostringstream os;
+    alloc.dumpTrace(os);
+    const std::string text = os.str();
+    REQUIRE(text.find(spsl::traceHeader) == 0u);
+    std::ostringstream addr;
+    addr << std::hex << reinterpret_cast<std::uintptr_t>(mem);
+    REQUIRE(text.find(addr.str()) == std::string::npos);
+
+    std::istringstream is(text);
+    records = spsl::readTrace(is);
+    REQUIRE(records.size() == 2u);
+    REQUIRE(records[0].op == TraceOperation::allocate);
+    REQUIRE(records[0].alignment == 256u);
+    REQUIRE(records[0].segments == 2u);
+    REQUIRE(records[1].op == TraceOperation::deallocate);
+    REQUIRE(records[1].size == 100u);
+    REQUIRE(records[0].handle == records[1].handle);
+
+    std::istringstream bad("x 1 2 3\n");
+    REQUIRE_THROWS_AS(spsl::readTrace(bad), std::runtime_error);
+}
+
+// tracing from several threads
+TEST_CASE("ConcurrentTraceTest", "[allocator]")
+{
+    spsl::SensitivePageAllocator alloc;
+    alloc.setDeferContendedFrees(true);
+    alloc.enableTracing();
+
+    const std::size_t numThreads = 4;
+    const std::size_t numIterations = 1000;
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < numThreads; ++t)
+    {
+        threads.emplace_back([&alloc]() {
+            for (std::size_t i = 0; i < numIterations; ++i)
+            {
+                void* mem = alloc.allocate(i % 200 + 1);
+                alloc.deallocate(mem, i % 200 + 1);
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    std::vector<spsl::AllocationTraceRecord> records;
+    REQUIRE(alloc.drainTrace(records) == 0u);
+    REQUIRE(records.size() == 2 * numThreads * numIterations);
+    std::size_t allocations = 0;
+    for (const auto& r : records)
+    {
+        if (r.op == spsl::TraceOperation::allocate)
+            ++allocations;
+        REQUIRE(r.size >= 1u);
+        REQUIRE(r.size <= 200u);
+    }
+    REQUIRE(allocations == numThreads * numIterations);
+}
+
 // TODO: test other page sizes
@@ -0,0 +1,268 @@
+/**
+ * @file    Special Purpose Strings Library: test_pagealloc_concurrent.cpp
+ * @author  Daniel Evers
+ * @brief   Unit tests for the concurrent page allocator
+ * @license MIT
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "catch.hpp"
+
+#include "spsl/pagealloc_concurrent.hpp"
+#include "spsl/storage_password.hpp"
+
+using AllocationList = std::vector<spsl::ConcurrentSensitivePageAllocator::AllocationInfo>;
+
+
+// allocate a segment
+TEST_CASE("ConcurrentAllocationTest1", "[allocator]")
+{
+    spsl::ConcurrentSensitivePageAllocator alloc;
+    REQUIRE(alloc.getChunksPerPage() >= 1u);
+
+    // nothing allocated yet
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+    REQUIRE(alloc.getNumberOfUnmanagedAreas() == 0u);
+
+    void* mem = alloc.allocate(16);
+    REQUIRE(mem != nullptr);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 1u);
+    REQUIRE(alloc.getNumberOfUnmanagedAreas() == 0u);
+
+    alloc.deallocate(mem, 16);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+
+    // the page management info is recycled
+    mem = alloc.allocate(16);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 1u);
+    alloc.deallocate(mem, 16);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+}
+
+// allocate and deallocate multiple segments
+TEST_CASE("ConcurrentAllocationTest2", "[allocator]")
+{
+    spsl::ConcurrentSensitivePageAllocator alloc;
+    const std::size_t pageSegments = alloc.getChunksPerPage() * alloc.segmentsPerChunk;
+
+    // fill 20 pages (this also grows the page table)
+    AllocationList allocations;
+    for (std::size_t i = 0; i < 20 * pageSegments; ++i)
+    {
+        void* mem = alloc.allocate(64);
+        REQUIRE(mem != nullptr);
+        allocations.emplace_back(mem, 64);
+        REQUIRE(alloc.getNumberOfManagedAllocatedPages() == i / pageSegments + 1);
+    }
+
+    // all addresses are different
+    std::vector<void*> addresses;
+    for (auto& entry : allocations)
+        addresses.push_back(entry.addr);
+    std::sort(addresses.begin(), addresses.end());
+    REQUIRE(std::unique(addresses.begin(), addresses.end()) == addresses.end());
+
+    // free every other allocation: all pages are still in use
+    for (std::size_t i = 0; i < allocations.size(); i += 2)
+        alloc.deallocate(allocations[i].addr, allocations[i].size);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 20u);
+
+    // larger allocations don't fit
+    void* mem = alloc.allocate(128);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 21u);
+    alloc.deallocate(mem, 128);
+
+    for (std::size_t i = 1; i < allocations.size(); i += 2)
+        alloc.deallocate(allocations[i].addr, allocations[i].size);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+}
+
+// allocate areas large than a page
+TEST_CASE("ConcurrentUnmanagedAllocationTest", "[allocator]")
+{
+    spsl::ConcurrentSensitivePageAllocator alloc;
+    auto pageSize = alloc.getPageSize();
+
+    void* mem = alloc.allocate(pageSize + 1);
+    REQUIRE(mem != nullptr);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+    REQUIRE(alloc.getNumberOfUnmanagedAreas() == 1u);
+    alloc.deallocate(mem, pageSize + 1);
+    REQUIRE(alloc.getNumberOfUnmanagedAreas() == 0u);
+}
+
+// test the leak check in the destructor
+TEST_CASE("ConcurrentLeakCheckTest", "[allocator]")
+{
+    AllocationList cbLeaks;
+    void* leak1 = nullptr;
+    void* leak2 = nullptr;
+    {
+        using Allocator = spsl::ConcurrentSensitivePageAllocator;
+        Allocator alloc;
+        alloc.setLeakCallback([&](const Allocator*, const Allocator::AllocationInfo& info, bool) {
+            cbLeaks.push_back(info);
+        });
+
+        void* mem = alloc.allocate(64);
+        leak1 = alloc.allocate(3 * 64);
+        leak2 = alloc.allocate(alloc.getPageSize() + 1);
+        alloc.deallocate(mem, 64);
+    }
+
+    REQUIRE(cbLeaks.size() == 2u);
+    REQUIRE(cbLeaks[0].addr == leak1);
+    REQUIRE(cbLeaks[0].size == 3 * 64u);
+    REQUIRE(cbLeaks[1].addr == leak2);
+}
+
+// grow allocations in place
+TEST_CASE("ConcurrentTryExpandTest", "[allocator]")
+{
+    spsl::ConcurrentSensitivePageAllocator alloc;
+    const std::size_t chunkSize = alloc.chunk_size;
+
+    char* mem1 = static_cast<char*>(alloc.allocate(64));
+    char* mem2 = static_cast<char*>(alloc.allocate(64));
+    REQUIRE(mem2 == mem1 + 64);
+
+    REQUIRE(alloc.try_expand(mem2, 64, 60));
+    REQUIRE(alloc.try_expand(mem2, 60, 3 * 64));
+    REQUIRE_FALSE(alloc.try_expand(mem1, 64, 65));
+    REQUIRE_FALSE(alloc.try_expand(mem2, 3 * 64, 64));
+    REQUIRE_FALSE(alloc.try_expand(mem2, 3 * 64, chunkSize));
+    REQUIRE(alloc.allocate(64) == mem1 + 4 * 64);
+
+    alloc.deallocate(mem1 + 4 * 64, 64);
+    alloc.deallocate(mem1, 64);
+    alloc.deallocate(mem2, 3 * 64);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+}
+
+// allocations with an alignment use whole chunks or pages
+TEST_CASE("ConcurrentAlignedAllocationTest", "[allocator]")
+{
+    spsl::ConcurrentSensitivePageAllocator alloc;
+    const std::size_t maxAlignment = alloc.getMaxAlignment();
+    REQUIRE(maxAlignment >= 4096u);
+
+    void* mem1 = alloc.allocate(10, 32);
+    void* mem2 = alloc.allocate(10, 256);
+    void* mem3 = alloc.allocate(100, maxAlignment);
+    REQUIRE(reinterpret_cast<std::uintptr_t>(mem1) % 32 == 0u);
+    REQUIRE(reinterpret_cast<std::uintptr_t>(mem2) % 256 == 0u);
+    REQUIRE(reinterpret_cast<std::uintptr_t>(mem3) % maxAlignment == 0u);
+    REQUIRE_THROWS_AS(alloc.allocate(10, 2 * maxAlignment), std::bad_alloc);
+    REQUIRE_THROWS_AS(alloc.allocate(10, 3), std::invalid_argument);
+
+    alloc.deallocate(mem1, 10, 32);
+    alloc.deallocate(mem2, 10, 256);
+    alloc.deallocate(mem3, 100, maxAlignment);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+    REQUIRE(alloc.getNumberOfUnmanagedAreas() == 0u);
+}
+
+// many threads allocating and releasing memory at the same time
+TEST_CASE("ConcurrentStressTest", "[allocator]")
+{
+    spsl::ConcurrentSensitivePageAllocator alloc;
+
+    constexpr std::size_t numThreads = 8;
+    constexpr std::size_t numRounds = 200;
+    // note: Catch isn't thread-safe, so we collect the results
+    std::atomic<bool> contentOk{ true };
+
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < numThreads; ++t)
+    {
+        threads.emplace_back([&alloc, &contentOk, t]() {
+            std::mt19937 rng(static_cast<std::mt19937::result_type>(t));
+            std::uniform_int_distribution<std::size_t> sizeDist(1, 16 * 64);
+            AllocationList allocations;
+            const char pattern = static_cast<char>('a' + t);
+
+            for (std::size_t round = 0; round < numRounds; ++round)
+            {
+                // allocate a few, release some of them
+                for (std::size_t i = 0; i < 20; ++i)
+                {
+                    const std::size_t size = sizeDist(rng);
+                    void* mem = alloc.allocate(size);
+                    std::fill_n(static_cast<char*>(mem), size, pattern);
+                    allocations.emplace_back(mem, size);
+                }
+                std::shuffle(allocations.begin(), allocations.end(), rng);
+                while (allocations.size() > 10)
+                {
+                    auto& entry = allocations.back();
+                    const char* p = static_cast<const char*>(entry.addr);
+                    if (std::count(p, p + entry.size, pattern) !=
+                        static_cast<std::ptrdiff_t>(entry.size))
+                        contentOk = false;
+                    alloc.deallocate(entry.addr, entry.size);
+                    allocations.pop_back();
+                }
+            }
+            for (auto& entry : allocations)
+                alloc.deallocate(entry.addr, entry.size);
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    REQUIRE(contentOk);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+}
+
+// allocate in one thread, release in another one
+TEST_CASE("ConcurrentCrossThreadTest", "[allocator]")
+{
+    spsl::ConcurrentSensitivePageAllocator alloc;
+
+    constexpr std::size_t numAllocations = 5000;
+    std::vector<std::atomic<void*>> slots(numAllocations);
+    for (auto& slot : slots)
+        slot.store(nullptr);
+
+    std::thread producer([&]() {
+        for (auto& slot : slots)
+            slot.store(alloc.allocate(100));
+    });
+    std::thread consumer([&]() {
+        for (auto& slot : slots)
+        {
+            void* mem;
+            while ((mem = slot.load()) == nullptr)
+                std::this_thread::yield();
+            alloc.deallocate(mem, 100);
+        }
+    });
+    producer.join();
+    consumer.join();
+
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+}
+
+// use the allocator for password strings
+TEST_CASE("ConcurrentAllocatorWithStorage", "[allocator]")
+{
+    using Allocator = spsl::SensitiveSegmentAllocator<char, spsl::ConcurrentSensitivePageAllocator>;
+    using StorageType = spsl::StoragePassword<char, 128, Allocator>;
+
+    spsl::ConcurrentSensitivePageAllocator alloc;
+    {
+        StorageType s{ Allocator(alloc) };
+        s.assign("secret", 6);
+        REQUIRE(s.size() == 6u);
+        REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 1u);
+        s.assign(1000, 'x');
+        REQUIRE(s.size() == 1000u);
+    }
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+}
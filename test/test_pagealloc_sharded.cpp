@@ -0,0 +1,241 @@
+/**
+ * @file    Special Purpose Strings Library: test_pagealloc_sharded.cpp
+ * @author  Daniel Evers
+ * @brief   Unit tests for the sharded page allocator
+ * @license MIT
+ */
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "catch.hpp"
+
+#include "spsl/pagealloc_sharded.hpp"
+#include "spsl/storage_password.hpp"
+
+using AllocationList = std::vector<spsl::ShardedSensitivePageAllocator::AllocationInfo>;
+
+
+// allocate and deallocate using the current shard
+TEST_CASE("ShardedAllocationTest", "[allocator]")
+{
+    using Alloc = spsl::ShardedSensitivePageAllocator;
+    Alloc alloc(4);
+    REQUIRE(alloc.getNumberOfShards() == 4u);
+    REQUIRE(alloc.getShardSelection() == Alloc::ShardSelection::cpu);
+    REQUIRE(alloc.getCurrentShardIndex() < 4u);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+
+    void* mem1 = alloc.allocate(16);
+    void* mem2 = alloc.allocate(alloc.getPageSize() + 1);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 1u);
+    REQUIRE(alloc.getNumberOfUnmanagedAreas() == 1u);
+
+    // exactly one shard owns the memory
+    std::size_t owners = 0;
+    for (std::size_t i = 0; i < alloc.getNumberOfShards(); ++i)
+    {
+        if (alloc.getShard(i).owns(mem1))
+        {
+            REQUIRE(alloc.getShard(i).owns(mem2));
+            ++owners;
+        }
+    }
+    REQUIRE(owners == 1u);
+
+    alloc.deallocate(mem1, 16);
+    alloc.deallocate(mem2, alloc.getPageSize() + 1);
+    // note: the thread may have moved to another CPU in the meantime
+    alloc.flushRemoteFrees();
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+    REQUIRE(alloc.getNumberOfUnmanagedAreas() == 0u);
+
+    REQUIRE_THROWS_AS(Alloc(0), std::runtime_error);
+}
+
+// memory is released by the shard that owns it
+TEST_CASE("ShardedRoutingTest", "[allocator]")
+{
+    using Alloc = spsl::ShardedSensitivePageAllocator;
+    Alloc alloc(3, Alloc::ShardSelection::numaNode);
+
+    AllocationList allocations;
+    for (std::size_t i = 0; i < alloc.getNumberOfShards(); ++i)
+    {
+        allocations.emplace_back(alloc.getShard(i).allocate(100), 100);
+        REQUIRE(alloc.getShard(i).getNumberOfManagedAllocatedPages() == 1u);
+    }
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 3u);
+
+    // grow in place, then release everything through the front end
+    REQUIRE(alloc.try_expand(allocations[1].addr, 100, 200));
+    allocations[1].size = 200;
+    for (auto& entry : allocations)
+        alloc.deallocate(entry.addr, entry.size);
+
+    // the current shard released its memory immediately, the others deferred it (the current
+    // shard depends on where this thread runs, so only check that the two add up)
+    std::size_t deferred = 0;
+    for (std::size_t i = 0; i < alloc.getNumberOfShards(); ++i)
+    {
+        const std::size_t remoteFrees = alloc.getShard(i).getStatistics().remoteFrees;
+        REQUIRE(remoteFrees <= 1u);
+        REQUIRE(alloc.getShard(i).getNumberOfManagedAllocatedPages() == remoteFrees);
+        deferred += remoteFrees;
+    }
+    REQUIRE(deferred < alloc.getNumberOfShards());
+    alloc.flushRemoteFrees();
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+
+    // aligned memory of other shards is deferred the same way
+    std::vector<std::size_t> remoteFrees;
+    allocations.clear();
+    for (std::size_t i = 0; i < alloc.getNumberOfShards(); ++i)
+    {
+        remoteFrees.push_back(alloc.getShard(i).getStatistics().remoteFrees);
+        allocations.emplace_back(alloc.getShard(i).allocate(100, 256), 100);
+    }
+    for (auto& entry : allocations)
+        alloc.deallocate(entry.addr, entry.size, 256);
+    for (std::size_t i = 0; i < alloc.getNumberOfShards(); ++i)
+    {
+        REQUIRE(alloc.getShard(i).getNumberOfManagedAllocatedPages() ==
+                alloc.getShard(i).getStatistics().remoteFrees - remoteFrees[i]);
+    }
+    alloc.flushRemoteFrees();
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+
+    // unknown memory is ignored
+    int unknown = 0;
+    REQUIRE_FALSE(alloc.try_expand(&unknown, 4, 8));
+    alloc.deallocate(&unknown, sizeof(unknown));
+}
+
+// the owner of any address within a page, area or region is found (without locking)
+TEST_CASE("ShardedOwnerLookupTest", "[allocator]")
+{
+    using Alloc = spsl::ShardedSensitivePageAllocator;
+    Alloc alloc(3);
+    const std::size_t pageSize = alloc.getPageSize();
+    alloc.getShard(2).setRegionSize(4);
+
+    // the first segment of a page, a segment within it, an area and a page of a region
+    AllocationList allocations;
+    allocations.emplace_back(alloc.getShard(0).allocate(64), 64);
+    allocations.emplace_back(alloc.getShard(0).allocate(64), 64);
+    allocations.emplace_back(alloc.getShard(1).allocate(3 * pageSize), 3 * pageSize);
+    allocations.emplace_back(alloc.getShard(2).allocate(100), 100);
+    REQUIRE(alloc.try_expand(allocations[1].addr, 64, 128));
+    allocations[1].size = 128;
+
+    for (auto& entry : allocations)
+        alloc.deallocate(entry.addr, entry.size);
+    alloc.flushRemoteFrees();
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+    REQUIRE(alloc.getNumberOfUnmanagedAreas() == 0u);
+
+    // released memory isn't found anymore
+    alloc.getShard(0).releaseUnused();
+    alloc.getShard(1).releaseUnused();
+    alloc.getShard(2).releaseUnused();
+    REQUIRE_FALSE(alloc.try_expand(allocations[1].addr, 128, 192));
+
+    // aligned allocations
+    void* aligned = alloc.getShard(1).allocate(64, 256);
+    alloc.deallocate(aligned, 64, 256);
+    alloc.flushRemoteFrees();
+    REQUIRE(alloc.getShard(1).getNumberOfManagedAllocatedPages() == 0u);
+}
+
+// leaks are reported by the shards
+TEST_CASE("ShardedLeakCheckTest", "[allocator]")
+{
+    AllocationList cbLeaks;
+    void* leak = nullptr;
+    {
+        using Alloc = spsl::ShardedSensitivePageAllocator;
+        Alloc alloc(2);
+        alloc.setLeakCallback([&](const Alloc::Shard*, const Alloc::AllocationInfo& info, bool) {
+            cbLeaks.push_back(info);
+        });
+        leak = alloc.allocate(3 * 64);
+        alloc.deallocate(alloc.allocate(64), 64);
+    }
+
+    REQUIRE(cbLeaks.size() == 1u);
+    REQUIRE(cbLeaks[0].addr == leak);
+    REQUIRE(cbLeaks[0].size == 3 * 64u);
+}
+
+// many threads allocating, some memory is released by other threads
+TEST_CASE("ShardedMultiThreadTest", "[allocator]")
+{
+    spsl::ShardedSensitivePageAllocator alloc(4);
+
+    constexpr std::size_t numThreads = 8;
+    constexpr std::size_t numAllocations = 2000;
+    std::vector<std::vector<void*>> allocations(numThreads);
+
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < numThreads; ++t)
+    {
+        threads.emplace_back([&alloc, &allocations, t]() {
+            for (std::size_t i = 0; i < numAllocations; ++i)
+            {
+                void* mem = alloc.allocate(100);
+                static_cast<char*>(mem)[99] = 1;
+                if (i % 2)
+                    alloc.deallocate(mem, 100);
+                else
+                    allocations[t].push_back(mem);
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    // all addresses are different
+    std::vector<void*> addresses;
+    for (auto& list : allocations)
+        addresses.insert(addresses.end(), list.begin(), list.end());
+    REQUIRE(addresses.size() == numThreads * numAllocations / 2);
+    std::sort(addresses.begin(), addresses.end());
+    REQUIRE(std::unique(addresses.begin(), addresses.end()) == addresses.end());
+
+    // release the remaining allocations in another thread
+    std::thread releaser([&]() {
+        for (auto& list : allocations)
+        {
+            for (void* mem : list)
+                alloc.deallocate(mem, 100);
+        }
+    });
+    releaser.join();
+    alloc.flushRemoteFrees();
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+}
+
+// use the allocator for password strings
+TEST_CASE("ShardedAllocatorWithStorage", "[allocator]")
+{
+    using Allocator = spsl::SensitiveSegmentAllocator<char, spsl::ShardedSensitivePageAllocator>;
+    using StorageType = spsl::StoragePassword<char, 128, Allocator>;
+
+    {
+        // the default instance
+        StorageType s;
+        s.assign("secret", 6);
+        REQUIRE(s.size() == 6u);
+    }
+
+    spsl::ShardedSensitivePageAllocator alloc(2);
+    {
+        StorageType s{ Allocator(alloc) };
+        s.assign(1000, 'x');
+        REQUIRE(s.size() == 1000u);
+        REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 1u);
+    }
+    alloc.flushRemoteFrees();
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+}
@@ -5,6 +5,14 @@
  * @license MIT
  */
 
+#include <algorithm>
+#include <iterator>
+#include <new>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
 #include "catch.hpp"
 
 #include "spsl/storage_password.hpp"
@@ -12,6 +20,7 @@
 
 /**
  * Custom allocator that checks whether a memory area was zero'd out before freeing it.
+ * (The memory is zero'd when allocating it: StoragePassword only wipes what it has written.)
  */
 template <typename T>
 struct WipeCheckAllocator
@@ -24,7 +33,7 @@ struct WipeCheckAllocator
         if (n > this->max_size())
             throw std::bad_alloc();
 
-        return static_cast<pointer>(malloc(n * sizeof(T)));
+        return static_cast<pointer>(calloc(n, sizeof(T)));
     }
 
     void deallocate(pointer ptr, size_type size)
@@ -447,6 +456,279 @@ TEMPLATE_LIST_TEST_CASE("StoragePassword realloc", "[storage_password]", CharTyp
     REQUIRE(s.capacity() == 0u);
 }
 
+/* growth policies */
+TEMPLATE_LIST_TEST_CASE("StoragePassword growth policy", "[storage_password]", CharTypes)
+{
+    using CharType = TestType;
+    using Allocator = WipeCheckAllocator<CharType>;
+    using FixedType = spsl::StoragePassword<CharType, 32, Allocator>;
+    using GeometricType =
+      spsl::StoragePassword<CharType, 32, Allocator, 0, spsl::policy::growth::Geometric>;
+    using size_type = typename FixedType::size_type;
+    const TestData<CharType> data;
+    const CharType ch(data.hello_world[2]);
+    const size_type count = 1000;
+
+    // fixed blocks: one reallocation per block
+    FixedType fixed;
+    size_type reallocs = 0;
+    for (size_type i = 0; i < count; ++i)
+    {
+        const CharType* buffer = fixed.data();
+        fixed.push_back(ch);
+        if (fixed.data() != buffer)
+            ++reallocs;
+        REQUIRE(fixed.capacity() % 32 == 0);
+        REQUIRE(fixed.capacity() - fixed.size() <= 32);
+    }
+    REQUIRE(reallocs == 32u);
+
+    // geometric: the capacity doubles
+    GeometricType geometric;
+    reallocs = 0;
+    for (size_type i = 0; i < count; ++i)
+    {
+        const CharType* buffer = geometric.data();
+        geometric.push_back(ch);
+        if (geometric.data() != buffer)
+        {
+            ++reallocs;
+            REQUIRE(geometric.capacity() == 32u << (reallocs - 1));
+        }
+    }
+    REQUIRE(reallocs == 6u);
+    REQUIRE(geometric.capacity() == 1024u);
+    for (size_type i = 0; i < geometric.size(); ++i)
+        REQUIRE(geometric[i] == ch);
+    REQUIRE(geometric[geometric.size()] == GeometricType::nul());
+
+    // large requests are satisfied directly, copies only allocate what they need
+    geometric.reserve(5000);
+    REQUIRE(geometric.capacity() == 5024u);
+    GeometricType copy(geometric);
+    REQUIRE(copy.capacity() == 1024u);
+    geometric.shrink_to_fit();
+    REQUIRE(geometric.capacity() == 1024u);
+}
+
+/* growing the buffer in place */
+TEMPLATE_LIST_TEST_CASE("StoragePassword in-place growth", "[storage_password]", CharTypes)
+{
+    using CharType = TestType;
+    using StorageType = spsl::StoragePassword<CharType, 32>;
+    using size_type = typename StorageType::size_type;
+    const TestData<CharType> data;
+    const CharType ch(data.hello_world[2]);
+
+    spsl::SensitivePageAllocator alloc;
+    {
+        StorageType s{ spsl::SensitiveSegmentAllocator<CharType>(alloc) };
+        s.push_back(ch);
+        const CharType* buffer = s.data();
+
+        // appending character by character never moves the buffer
+        const size_type count = alloc.chunk_size / sizeof(CharType) - 1;
+        for (size_type i = 1; i < count; ++i)
+        {
+            s.push_back(ch);
+            REQUIRE(s.data() == buffer);
+        }
+        REQUIRE(s.size() == count);
+        REQUIRE(s.capacity() == count + 1);
+        for (size_type i = 0; i < s.size(); ++i)
+            REQUIRE(s[i] == ch);
+        REQUIRE(s[s.size()] == StorageType::nul());
+
+        // the chunk is full -> reallocation
+        s.push_back(ch);
+        REQUIRE(s.data() != buffer);
+        REQUIRE(s.size() == count + 1);
+    }
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+    REQUIRE(alloc.getNumberOfUnmanagedAreas() == 0u);
+}
+
+TEMPLATE_LIST_TEST_CASE("StoragePassword bulk creation", "[storage_password]", CharTypes)
+{
+    using CharType = TestType;
+    const TestData<CharType> data;
+    const CharType* s = data.hello_world;
+
+    // a few strings, including an empty one and one larger than a block
+    std::vector<std::vector<CharType>> values;
+    values.emplace_back(s, s + 5);
+    values.emplace_back();
+    values.emplace_back(s, s + 12);
+    values.emplace_back(100, s[0]);
+
+    spsl::SensitivePageAllocator alloc;
+    {
+        // allocated at once
+        using StorageType = spsl::StoragePassword<CharType, 32>;
+        auto storages =
+          StorageType::createBulk(values, spsl::SensitiveSegmentAllocator<CharType>(alloc));
+        REQUIRE(storages.size() == values.size());
+        const auto stats = alloc.getStatistics();
+        REQUIRE(std::accumulate(stats.allocations.begin(), stats.allocations.end(), 0u) == 3u);
+        for (std::size_t i = 0; i < values.size(); ++i)
+        {
+            REQUIRE(storages[i].size() == values[i].size());
+            REQUIRE(storages[i].capacity() ==
+                    (values[i].empty() ? 0 : (values[i].size() / 32 + 1) * 32));
+            REQUIRE(std::equal(values[i].begin(), values[i].end(), storages[i].data()));
+            REQUIRE(storages[i].data()[storages[i].size()] == StorageType::nul());
+        }
+    }
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+
+    // fallback: one by one
+    using StorageType = spsl::StoragePassword<CharType, 32, WipeCheckAllocator<CharType>>;
+    auto storages = StorageType::createBulk(values);
+    REQUIRE(storages.size() == values.size());
+    for (std::size_t i = 0; i < values.size(); ++i)
+    {
+        REQUIRE(storages[i].size() == values[i].size());
+        REQUIRE(std::equal(values[i].begin(), values[i].end(), storages[i].data()));
+    }
+    REQUIRE(StorageType::createBulk(std::vector<std::vector<CharType>>()).empty());
+}
+
+// @return true if the memory of @c obj contains the characters @c s
+template <typename T, typename CharType>
+static bool containsChars(const T& obj, const CharType* s, std::size_t n)
+{
+    auto begin = reinterpret_cast<const unsigned char*>(&obj);
+    auto pattern = reinterpret_cast<const unsigned char*>(s);
+    return std::search(begin, begin + sizeof(T), pattern, pattern + n * sizeof(CharType)) !=
+           begin + sizeof(T);
+}
+
+/* inline buffer */
+TEMPLATE_LIST_TEST_CASE("StoragePassword inline buffer", "[storage_password]", CharTypes)
+{
+    using CharType = TestType;
+    using Allocator = spsl::SensitiveSegmentAllocator<CharType>;
+    using StorageType = spsl::StoragePassword<CharType, 32, Allocator, 15>;
+    const TestData<CharType> data;
+    const CharType* hello = data.hello_world;
+    const CharType nul = StorageType::nul();
+
+    spsl::SensitivePageAllocator alloc;
+    auto numAllocations = [&alloc]() {
+        const auto stats = alloc.getStatistics();
+        return std::accumulate(stats.allocations.begin(), stats.allocations.end(), 0u);
+    };
+    REQUIRE(StorageType::inline_size() == 15u);
+
+    // short strings are stored inside the object
+    StorageType s{ Allocator(alloc) };
+    REQUIRE(s.capacity() == 16u);
+    s.assign(hello, 5);
+    REQUIRE(containsChars(s, hello, 5));
+    s.append(hello + 5, 7);
+    s.append(3, hello[0]);
+    REQUIRE(s.size() == 15u);
+    REQUIRE(s.capacity() == 16u);
+    REQUIRE(numAllocations() == 0u);
+
+    // one more character: the string is moved to an allocated buffer and the inline buffer wiped
+    s.push_back(hello[1]);
+    REQUIRE(numAllocations() == 1u);
+    REQUIRE(s.capacity() == 32u);
+    REQUIRE(std::equal(hello, hello + 12, s.data()));
+    REQUIRE(s.data()[16] == nul);
+    REQUIRE(!containsChars(s, hello, 5));
+
+    // back to the inline buffer
+    s.resize(5, nul);
+    s.shrink_to_fit();
+    REQUIRE(s.capacity() == 16u);
+    REQUIRE(alloc.getNumberOfManagedAllocatedPages() == 0u);
+    REQUIRE(std::equal(hello, hello + 5, s.data()));
+
+    // clear, copy, move and swap
+    StorageType copy(s);
+    REQUIRE(containsChars(copy, hello, 5));
+    copy.clear();
+    REQUIRE(!containsChars(copy, hello, 5));
+    StorageType moved(std::move(s));
+    REQUIRE(containsChars(moved, hello, 5));
+    REQUIRE(!containsChars(s, hello, 5));
+    REQUIRE(s.empty());
+
+    StorageType large{ Allocator(alloc) };
+    large.assign(20, hello[0]);
+    large.swap(moved);
+    REQUIRE(large.size() == 5u);
+    REQUIRE(moved.size() == 20u);
+    REQUIRE(containsChars(large, hello, 5));
+    REQUIRE(!containsChars(moved, hello, 5));
+    copy.assign(hello + 6, 5);
+    copy.swap(large);
+    REQUIRE(std::equal(hello, hello + 5, copy.data()));
+    REQUIRE(std::equal(hello + 6, hello + 11, large.data()));
+    REQUIRE(!containsChars(copy, hello + 6, 5));
+    REQUIRE(!containsChars(large, hello, 5));
+
+    // destruction wipes the inline buffer
+    alignas(StorageType) unsigned char buffer[sizeof(StorageType)];
+    auto* ptr = new (buffer) StorageType(Allocator(alloc));
+    ptr->assign(hello, 5);
+    REQUIRE(containsChars(*ptr, hello, 5));
+    ptr->~StorageType();
+    REQUIRE(!containsChars(*ptr, hello, 5));
+
+    // bulk creation: only the long strings allocate
+    std::vector<std::vector<CharType>> values;
+    values.emplace_back(hello, hello + 5);
+    values.emplace_back();
+    values.emplace_back(100, hello[0]);
+    const auto before = numAllocations();
+    auto storages = StorageType::createBulk(values, Allocator(alloc));
+    REQUIRE(numAllocations() == before + 1);
+    for (std::size_t i = 0; i < values.size(); ++i)
+    {
+        REQUIRE(storages[i].size() == values[i].size());
+        REQUIRE(std::equal(values[i].begin(), values[i].end(), storages[i].data()));
+    }
+    REQUIRE(storages[0].capacity() == 16u);
+}
+
+/* secure_memzero() */
+namespace
+{
+// a secret that is wiped in the destructor - the stores are dead stores for the compiler
+struct WipedSecret
+{
+    unsigned char data[256];
+    ~WipedSecret() { spsl::secure_memzero(data, sizeof(data)); }
+};
+} // namespace
+
+TEST_CASE("secure_memzero", "[storage_password]")
+{
+    // all sizes and alignments (including the head and tail of word-wide stores)
+    unsigned char buffer[160];
+    for (std::size_t offset = 0; offset < 16; ++offset)
+    {
+        for (std::size_t size = 0; size <= 128; ++size)
+        {
+            std::fill(std::begin(buffer), std::end(buffer), 0xa5);
+            REQUIRE(spsl::secure_memzero(buffer + offset, size) == buffer + offset);
+            for (std::size_t i = 0; i < sizeof(buffer); ++i)
+                REQUIRE(buffer[i] == ((i >= offset && i < offset + size) ? 0 : 0xa5));
+        }
+    }
+
+    // the memory is wiped even if it isn't used afterwards
+    alignas(WipedSecret) unsigned char storage[sizeof(WipedSecret)];
+    auto* secret = new (storage) WipedSecret;
+    std::fill(std::begin(secret->data), std::end(secret->data), 0x5a);
+    secret->~WipedSecret();
+    for (auto byte : storage)
+        REQUIRE(byte == 0);
+}
+
 /* wiping memory */
 TEMPLATE_LIST_TEST_CASE("StoragePassword wiping", "[storage_password]", CharTypes)
 {
@@ -619,6 +901,227 @@ TEMPLATE_LIST_TEST_CASE("StoragePassword replace", "[storage_password]", CharTyp
     }
 }
 
+/* wiping up to the high-water mark */
+TEMPLATE_LIST_TEST_CASE("StoragePassword high-water mark", "[storage_password]", CharTypes)
+{
+    using CharType = TestType;
+    using StorageType = spsl::StoragePassword<CharType, 32, WipeCheckAllocator<CharType>>;
+    using size_type = typename StorageType::size_type;
+    const TestData<CharType> data;
+    const CharType nul = StorageType::nul();
+    const CharType ch = data.blablabla[0];
+    const CharType fill = data.hello_world[0];
+
+    // fills all unused memory, so that we see what's wiped (and what isn't)
+    StorageType s;
+    s.reserve(255);
+    const size_type cap = s.capacity();
+    REQUIRE(cap == 256u);
+    std::fill(s.data() + 1, s.data() + cap, fill);
+    auto numUntouched = [&s, cap, fill]() {
+        return static_cast<size_type>(std::count(s.data(), s.data() + cap, fill));
+    };
+
+    // only the used part is wiped
+    s.assign(data.hello_world, data.hello_world_len);
+    s.clear();
+    REQUIRE(numUntouched() == cap - data.hello_world_len - 1);
+    for (size_type i = 0; i <= data.hello_world_len; ++i)
+        REQUIRE(s[i] == nul);
+
+    // the mark stays when the string shrinks (and covers writes through data())
+    s.assign(40, ch);
+    s.data()[10] = data.hello_world[1];
+    s.resize(5, ch);
+    s.append(2, ch);
+    REQUIRE(numUntouched() == cap - 41);
+    s.clear();
+    REQUIRE(numUntouched() == cap - 41);
+    for (size_type i = 0; i <= 40; ++i)
+        REQUIRE(s[i] == nul);
+
+    // the same for insert/replace/erase and push_back
+    s.assign(data.hello_world, data.hello_world_len);
+    s.insert(2, 30, ch);
+    s.replace(0, 40, data.blablabla, 3);
+    s.erase(0, 2);
+    s.push_back(ch);
+    s.clear();
+    REQUIRE(numUntouched() == cap - data.hello_world_len - 31);
+
+    // clearing an empty string doesn't wipe anything
+    s.clear();
+    REQUIRE(numUntouched() == cap - data.hello_world_len - 31);
+
+    // the remaining fill characters must be wiped before freeing the buffer
+    s.assign(cap - 1, nul);
+
+    // growing via resize() only writes up to the new size (the allocator checks the rest)
+    StorageType r;
+    r.resize(20, ch);
+    r.resize(31, ch);
+    REQUIRE(r.capacity() == 32u);
+    REQUIRE(r.size() == 31u);
+    r.resize(40, ch);
+    REQUIRE(r.capacity() == 64u);
+    for (size_type i = 0; i < r.size(); ++i)
+        REQUIRE(r[i] == ch);
+    REQUIRE(r[r.size()] == nul);
+    for (size_type i = r.size() + 1; i < r.capacity(); ++i)
+        REQUIRE(r.data()[i] == nul);
+}
+
+/* replacing in place */
+TEMPLATE_LIST_TEST_CASE("StoragePassword replace in place", "[storage_password]", CharTypes)
+{
+    using CharType = TestType;
+    // block size 16: the test string (12 characters) may grow by 3 characters in place
+    using StorageType = spsl::StoragePassword<CharType, 16, WipeCheckAllocator<CharType>>;
+    using size_type = typename StorageType::size_type;
+    using Traits = typename StorageType::traits_type;
+    const TestData<CharType> data;
+    using RefType = std::basic_string<CharType>;
+    const size_type len = data.hello_world_len;
+    const CharType nul = StorageType::nul();
+
+    // no reallocation if the capacity is sufficient, the vacated part is wiped
+    {
+        StorageType s;
+        s.reserve(63);
+        s.assign(data.hello_world, len);
+        const CharType* buffer = s.data();
+        s.replace(2, 3, data.blablabla, data.blablabla_len);
+        s.insert(0, 5, data.hello_world[0]);
+        s.insert(s.size(), data.hello_world, len);
+        REQUIRE(s.data() == buffer);
+        REQUIRE(s.size() == 2 * len - 3 + data.blablabla_len + 5);
+        const size_type size = s.size();
+        s.replace(0, size - 1, 0, nul);
+        REQUIRE(s.size() == 1u);
+        REQUIRE(s.data() == buffer);
+        for (size_type i = 1; i <= size; ++i)
+            REQUIRE(s[i] == nul);
+    }
+
+    // replacing with parts of the string itself, in place or not
+    for (size_type pos = 0; pos <= len; ++pos)
+    {
+        for (size_type count = 0; pos + count <= len; ++count)
+        {
+            for (size_type offset = 0; offset < len; ++offset)
+            {
+                for (size_type count2 = 0; offset + count2 <= len; ++count2)
+                {
+                    StorageType s;
+                    s.assign(data.hello_world, len);
+                    RefType ref(data.hello_world, len);
+                    s.replace(pos, count, s.data() + offset, count2);
+                    ref.replace(pos, count, ref.data() + offset, count2);
+                    REQUIRE(s.size() == ref.size());
+                    REQUIRE(Traits::compare(s.data(), ref.data(), ref.size()) == 0);
+                    REQUIRE(s[s.size()] == nul);
+                }
+            }
+        }
+    }
+
+    // the same with iterators (i.e. pointers)
+    {
+        StorageType s;
+        s.assign(data.hello_world, len);
+        RefType ref(data.hello_world, len);
+        s.insert(3, s.data() + 1, s.data() + 5);
+        ref.insert(3, ref.data() + 1, 4);
+        REQUIRE(s.size() == ref.size());
+        REQUIRE(Traits::compare(s.data(), ref.data(), ref.size()) == 0);
+        s.replace(0, 2, s.data() + 4, s.data() + 14);
+        ref.replace(0, 2, ref.data() + 4, 10);
+        REQUIRE(s.size() == ref.size());
+        REQUIRE(Traits::compare(s.data(), ref.data(), ref.size()) == 0);
+    }
+
+    // other iterators may refer to the string, too (e.g. reverse iterators)
+    {
+        using RevIter = std::reverse_iterator<const CharType*>;
+        StorageType s;
+        s.reserve(100);
+        s.assign(data.hello_world, len);
+        RefType ref(data.hello_world, len);
+        const CharType* buffer = s.data();
+        s.insert(2, RevIter(s.data() + 6), RevIter(s.data()));
+        ref.insert(2, RefType(ref.rbegin() + static_cast<std::ptrdiff_t>(len - 6), ref.rend()));
+        REQUIRE(s.size() == ref.size());
+        REQUIRE(Traits::compare(s.data(), ref.data(), ref.size()) == 0);
+        s.replace(1, 3, RevIter(s.data() + s.size()), RevIter(s.data() + 2));
+        ref.replace(1, 3, RefType(ref.rbegin(), ref.rend() - 2));
+        REQUIRE(s.size() == ref.size());
+        REQUIRE(Traits::compare(s.data(), ref.data(), ref.size()) == 0);
+        REQUIRE(s.data() == buffer);
+    }
+}
+
+namespace
+{
+// input iterator that throws after a number of characters
+struct ThrowingInputIterator
+{
+    using iterator_category = std::input_iterator_tag;
+    using value_type = char;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const char*;
+    using reference = char;
+
+    std::size_t remaining;
+    char operator*() const
+    {
+        if (remaining == 0)
+            throw std::runtime_error("read error");
+        return 'x';
+    }
+    ThrowingInputIterator& operator++()
+    {
+        --remaining;
+        return *this;
+    }
+    ThrowingInputIterator operator++(int)
+    {
+        auto copy = *this;
+        ++*this;
+        return copy;
+    }
+    // never at the end
+    bool operator==(const ThrowingInputIterator&) const { return false; }
+    bool operator!=(const ThrowingInputIterator&) const { return true; }
+};
+} // namespace
+
+TEST_CASE("StoragePassword replace with input iterators", "[storage_password]")
+{
+    using StorageType = spsl::StoragePassword<char, 16, WipeCheckAllocator<char>>;
+
+    StorageType s;
+    s.assign("Hello World!", 12);
+    std::istringstream in1("big ");
+    s.insert(6, std::istreambuf_iterator<char>(in1), std::istreambuf_iterator<char>());
+    REQUIRE(std::string(s.data()) == "Hello big World!");
+    std::istringstream in2("small");
+    s.replace(6, 3, std::istreambuf_iterator<char>(in2), std::istreambuf_iterator<char>());
+    REQUIRE(std::string(s.data()) == "Hello small World!");
+    std::istringstream in3("");
+    s.replace(0, 6, std::istreambuf_iterator<char>(in3), std::istreambuf_iterator<char>());
+    REQUIRE(std::string(s.data()) == "small World!");
+    REQUIRE(s.size() == 12u);
+
+    // strong exception guarantee: the string is unchanged if reading fails
+    REQUIRE_THROWS_AS(s.replace(2, 3, ThrowingInputIterator{ 5 }, ThrowingInputIterator{ 0 }),
+                      std::runtime_error);
+    REQUIRE(std::string(s.data()) == "small World!");
+    REQUIRE_THROWS_AS(s.insert(6, ThrowingInputIterator{ 20 }, ThrowingInputIterator{ 0 }),
+                      std::runtime_error);
+    REQUIRE(std::string(s.data()) == "small World!");
+    REQUIRE(s.size() == 12u);
+}
+
 /* copy & move tests */
 TEMPLATE_LIST_TEST_CASE("StoragePassword copy and move", "[storage_password]", CharTypes)
 {
@@ -209,3 +209,31 @@ TEMPLATE_LIST_TEST_CASE("StringCore constructor iterator", "[string_core]", Stri
         }
     }
 }
+
+TEST_CASE("makePasswordStrings", "[string_core]")
+{
+    const std::vector<std::string> values{ "user", "", "a much longer secret: 0123456789" };
+    auto passwords = spsl::makePasswordStrings(values);
+    REQUIRE(passwords.size() == values.size());
+    for (std::size_t i = 0; i < values.size(); ++i)
+        REQUIRE(passwords[i] == values[i]);
+
+    const std::vector<std::wstring> wvalues{ L"password", L"pin" };
+    auto wpasswords = spsl::makePasswordStrings<spsl::PasswordStringW>(wvalues);
+    REQUIRE(wpasswords.size() == 2u);
+    REQUIRE(wpasswords[0] == L"password");
+    REQUIRE(wpasswords[1] == L"pin");
+
+    // short ones are stored inline
+    auto pins = spsl::makePasswordStrings<spsl::InlinePasswordString<>>(values);
+    REQUIRE(pins.size() == values.size());
+    for (std::size_t i = 0; i < values.size(); ++i)
+        REQUIRE(pins[i] == values[i]);
+    auto isInline = [](const spsl::InlinePasswordString<>& s) {
+        auto obj = reinterpret_cast<const char*>(&s);
+        return s.data() >= obj && s.data() < obj + sizeof(s);
+    };
+    REQUIRE(isInline(pins[0]));
+    REQUIRE(isInline(pins[1]));
+    REQUIRE(!isInline(pins[2]));
+}
@@ -135,3 +135,26 @@ TEST_CASE("is_compatible", "[traits]")
     ASSERT_IS_NOT_COMPAT(char, size_t, std::exception);
     ASSERT_IS_NOT_COMPAT(char, size_t, std::vector<int>);
 }
+
+// test the has_try_expand traits template
+TEST_CASE("has_try_expand", "[traits]")
+{
+    const bool segmentAllocator =
+      spsl::has_try_expand<spsl::SensitiveSegmentAllocator<char>, char>::value;
+    REQUIRE(segmentAllocator == true);
+    const bool stdAllocator = spsl::has_try_expand<std::allocator<char>, char>::value;
+    REQUIRE(stdAllocator == false);
+}
+
+// test the has_allocate_bulk traits template
+TEST_CASE("has_allocate_bulk", "[traits]")
+{
+    const bool segmentAllocator =
+      spsl::has_allocate_bulk<spsl::SensitiveSegmentAllocator<char>, char>::value;
+    REQUIRE(segmentAllocator == true);
+    const bool wrongType =
+      spsl::has_allocate_bulk<spsl::SensitiveSegmentAllocator<char>, wchar_t>::value;
+    REQUIRE(wrongType == false);
+    const bool stdAllocator = spsl::has_allocate_bulk<std::allocator<char>, char>::value;
+    REQUIRE(stdAllocator == false);
+}
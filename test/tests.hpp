@@ -22,6 +22,8 @@ using StringBaseTestTypes =
              spsl::StringBase<spsl::StorageArray<wchar_t, 64, spsl::policy::overflow::Throw>>,
              spsl::StringBase<spsl::StoragePassword<char, 32>>,
              spsl::StringBase<spsl::StoragePassword<wchar_t, 32>>,
+             spsl::StringBase<
+               spsl::StoragePassword<char, 32, spsl::SensitiveSegmentAllocator<char>, 15>>,
              spsl::ArrayString<128, spsl::policy::overflow::Truncate>,
              spsl::ArrayStringW<128, spsl::policy::overflow::Truncate>,
              spsl::ArrayString<128, spsl::policy::overflow::Throw>,
@@ -47,7 +49,7 @@ using StringCoreTestTypes = std::tuple<
   spsl::ArrayStringW<128, spsl::policy::overflow::Truncate>,
   spsl::ArrayString<128, spsl::policy::overflow::Throw>,
   spsl::ArrayStringW<128, spsl::policy::overflow::Throw>, spsl::PasswordString,
-  spsl::PasswordStringW,
+  spsl::PasswordStringW, spsl::InlinePasswordString<>, spsl::InlinePasswordStringW<7>,
   // BYTE tests (using GSL)
   spsl::StringCore<spsl::StorageArray<gsl::byte, 64, spsl::policy::overflow::Truncate>>,
   spsl::StringBase<spsl::StoragePassword<gsl::byte>>>;